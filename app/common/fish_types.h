@@ -21,6 +21,71 @@ typedef enum
     FISH_EOK = 0                /* No error */
 } fish_error_t;
 
+#define FISH_VIDEO_SSRC 2222 /* SSRC of the full quality video stream */
+#define FISH_AUDIO_SSRC 1111 /* SSRC of the Opus stream, as signalled to the audio producer */
+
+/* Streaming options, filled with defaults by initStreamConfig() and overridden
+ * by --key=value arguments on the command line */
+typedef struct
+{
+    bool abr_enabled;            // Adapt encoder bitrate to RTCP receiver reports
+    uint32_t abr_start_kbps;     // Bitrate the encoder starts at
+    uint32_t abr_min_kbps;       // Floor the controller never goes below
+    uint32_t abr_max_kbps;       // Ceiling the controller never goes above
+    uint32_t abr_loss_low_pct;   // Loss at or below this counts as a good report
+    uint32_t abr_loss_high_pct;  // Loss at or above this backs off immediately
+    uint32_t abr_jitter_high_ms; // Jitter at or above this backs off immediately
+    uint32_t abr_hold_ms;        // Minimum time after a back-off before increasing again
+    uint32_t abr_max_frame_skip; // Encode 1 of every N frames at most once bitrate hits the floor
+    const char *video_profile;   // Name of the resolution/framerate profile to start with
+    uint32_t simulcast_layers;   // Encoded layers in the video producer, 1 disables simulcast
+    const char *encoder_profile; // x264 settings used wherever the software encoder runs
+    uint32_t encoder_threads;    // x264 thread limit, 0 lets x264 pick one per core
+    bool latency_stamp;          // Pixel-code a frame counter and timestamp into system-memory frames
+    uint32_t queue_max_ms;       // Data each leaky pipeline queue may hold before dropping the oldest
+    uint32_t stale_frame_ms;     // Frames older than this are dropped before encoding, 0 keeps all
+    const char *audio_source;    // "none", "test" (audiotestsrc) or "alsa"
+    const char *audio_device;    // ALSA capture device when audio_source is "alsa"
+    uint32_t audio_kbps;         // Opus bitrate
+    const char *file;            // Video file streamed when there is no camera
+    bool file_passthrough;       // Send the file's H.264 as is instead of re-encoding it
+    bool file_loop;              // Restart the file at the end instead of stopping
+    uint32_t loadgen_broadcasters; // Run as a load generator with this many broadcasters, 0 to stream normally
+    uint32_t loadgen_seconds;    // Load generator run time, 0 to run until interrupted
+    const char *record_dir;      // Directory for local segment recordings, empty to not record
+    const char *record_format;   // "mkv" or "mp4"
+    uint32_t record_segment_s;   // Target segment length
+    uint32_t record_max_mb;      // Delete oldest segments above this total size, 0 for no limit
+    uint32_t record_max_age_min; // Delete segments older than this, 0 for no limit
+    uint32_t replay_seconds;     // Encoded video kept in memory for instant replay, 0 to disable
+    uint32_t replay_max_mb;      // Memory cap for the replay ring, 0 for no cap
+    const char *replay_dir;      // Where exported replay clips are written
+    uint32_t keyframe_min_ms;    // Minimum gap between keyframes forced by PLI/FIR, 0 for no limit
+    uint32_t fec_pct;            // ULPFEC overhead at no loss, 0 disables FEC
+    uint32_t fec_max_pct;        // Ceiling the overhead may rise to as loss grows
+    uint32_t pace_pct;           // RTP send rate as a percentage of the media rate, 0 sends unpaced
+    uint32_t pace_max_ms;        // Most the pacer may hold packets back before sending a burst as is
+    bool udp_batch;              // Send video RTP with sendmmsg/UDP GSO instead of udpsink
+    const char *video_source;    // "auto", "csi", "v4l2", "v4l2-direct", "file", "test" or "shm"
+    const char *source_device;   // V4L2 device node
+    const char *source_caps;     // Caps forced right after the source, empty for its defaults
+    const char *shm_socket;      // shmsink socket the "shm" source reads from
+    const char *v4l2_format;     // "auto", "raw", "mjpeg" or "h264" for the "v4l2-direct" source
+    const char *v4l2_io;         // "mmap" or "dmabuf"
+    uint32_t v4l2_buffers;       // Driver buffers to capture into
+    bool underwater;             // Correct the blue-green cast and haze of underwater footage
+    uint32_t underwater_strength_pct; // How much of the estimated correction to apply
+    bool stabilize;              // Remove camera shake from processed frames
+    uint32_t stabilize_crop_pct; // Margin cropped from each edge to make room for the correction
+    bool analytics;              // Run a detector on a decimated copy of the stream
+    uint32_t analytics_fps;      // Most frames per second handed to the detector
+    uint32_t analytics_width;    // Size the detector sees
+    uint32_t analytics_height;
+    const char *analytics_model; // OpenCV DNN model file, empty for the motion detector
+    const char *analytics_publish; // host:port detections are sent to as JSON, empty to only log
+    bool hud;                    // Burn speed, fin angles and link stats into the video
+} fish_stream_config_t;
+
 /* State structure that gets passed to all threads */
 typedef struct
 {
@@ -30,6 +95,10 @@ typedef struct
     uint8_t next_right_angle;
     uint8_t curr_speed;
     uint8_t next_speed;
+    int curr_video_profile; // Index into the video profile table
+    int next_video_profile;
+    uint8_t next_simulcast_mask; // Bit i set means simulcast layer i has consumers
+    bool next_replay_save;       // Set by the control channel, cleared once the export starts
 
     const char *server_url;
     const char *room_id;
@@ -40,6 +109,8 @@ typedef struct
 
     const char *host; // Got lazy -- this is just the first part of the URL normally
     const char *port;
+
+    fish_stream_config_t stream_config;
 } fish_handle_t;
 
 extern std::mutex fish_handle_mtx;
@@ -8,9 +8,10 @@
 #include <string>
 #include <iostream>
 #include <errno.h>
+#include <chrono>
+#include <thread>
 
 #include "jsoncpp/json/json.h"
-#include <opencv2/opencv.hpp>
 #include <gst/gst.h>
 
 // Note: macro needs to be defined before including httplib
@@ -24,10 +25,27 @@
 #include <boost/uuid/random_generator.hpp>
 
 #include "../common/fish_types.h"
-
-#if defined(__aarch64__)
-#define JETSON_TARGET
-#endif
+#include "../processing/frame-pipe.hpp"
+#include "../processing/frame-processors.hpp"
+#include "../streaming/bitrate-control.hpp"
+#include "../streaming/video-profiles.hpp"
+#include "../streaming/simulcast.hpp"
+#include "../streaming/pipeline-desc.hpp"
+#include "../streaming/encoder-profiles.hpp"
+#include "../processing/latency-stamp.hpp"
+#include "../processing/underwater-correct.hpp"
+#include "../processing/stabilizer.hpp"
+#include "../processing/analytics.hpp"
+#include "../processing/hud-overlay.hpp"
+#include "../streaming/latency-guard.hpp"
+#include "../streaming/audio-monitor.hpp"
+#include "../streaming/recorder.hpp"
+#include "../streaming/replay-buffer.hpp"
+#include "../streaming/rtcp-feedback.hpp"
+#include "../streaming/fec-control.hpp"
+#include "../streaming/rtp-pacer.hpp"
+#include "../streaming/video-source.hpp"
+#include "../streaming/v4l2-capture.hpp"
 
 /* Checks if mediasoup room exists by sending a simple GET
  * request and checking for 200. Returns errno::EOK if succesful. */
@@ -296,7 +314,9 @@ fish_error_t createMediasoupProducerAudio(const char *server_url, const char *ro
  * our RTP parameters via a HTTP POST. */
 fish_error_t createMediasoupProducerVideo(const char *server_url, const char *room_id,
                                           std::string token, std::string broadcaster_id,
-                                          std::string video_transport_id)
+                                          std::string video_transport_id,
+                                          std::string encodings,
+                                          std::string extra_codecs)
 {
     std::string extension("/rooms/");
     extension += room_id;
@@ -310,7 +330,8 @@ fish_error_t createMediasoupProducerVideo(const char *server_url, const char *ro
     cli.enable_server_certificate_verification(false);
     cli.set_bearer_token_auth(token.c_str());
 
-    char json_msg[1024] = "\
+    char json_msg[2048];
+    sprintf(json_msg, "\
         {\
             \"kind\": \"video\",\
             \"rtpParameters\": {\
@@ -326,14 +347,12 @@ fish_error_t createMediasoupProducerVideo(const char *server_url, const char *ro
                             \"x-google-start-bitrate\":1000\
                         }\
                     }\
+                    %s\
                 ],\
-                \"encodings\": [\
-                    {\
-                        \"ssrc\": 2222\
-                    }\
-                ]\
+                \"encodings\": %s\
             }\
-        }";
+        }",
+            extra_codecs.c_str(), encodings.c_str());
 
     auto res = cli.Post(extension.c_str(), json_msg, "application/json");
     if (res->status != 200)
@@ -346,172 +365,443 @@ fish_error_t createMediasoupProducerVideo(const char *server_url, const char *ro
     return FISH_EOK;
 }
 
-#if defined(JETSON_TARGET)
-/* Run gstreamer command to stream from the
- * CSI2 camera. Will not run on non-Jetson hardware. */
-fish_error_t createCSI2Stream(std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port)
+#define PIPELINE_TICK_MS 100
+
+/* Blocks until the pipeline errors out or reaches EOS, running the
+ * periodic stream controls in between. Pipelines started with a segment
+ * seek are looped back to the start instead of ending. The pipeline is
+ * stopped before returning. */
+static void runPipelineLoop(GstElement *pipeline, fish_handle_t *handle)
 {
-    GstElement *pipeline;
     GstBus *bus;
     GstMessage *msg;
+    fish_bitrate_ctrl_t bitrate_ctrl;
+    fish_simulcast_ctrl_t simulcast_ctrl;
+    fish_latency_guard_t latency_guard;
+    fish_audio_monitor_t audio_monitor;
+    fish_replay_buffer_t replay;
+    fish_keyframe_ctrl_t keyframe_ctrl;
+    fish_fec_ctrl_t fec_ctrl;
+    fish_pacer_t pacer;
+
+    bool abr = (setupBitrateControl(&bitrate_ctrl, pipeline, &handle->stream_config, FISH_VIDEO_SSRC) == FISH_EOK);
+    bool simulcast = (setupSimulcast(&simulcast_ctrl, pipeline, &handle->stream_config) == FISH_EOK);
+    setupLatencyGuard(&latency_guard, pipeline, &handle->stream_config);
+    bool audio = (setupAudioMonitor(&audio_monitor, pipeline) == FISH_EOK);
+    bool replay_enabled = (setupReplayBuffer(&replay, pipeline, &handle->stream_config) == FISH_EOK);
+    bool keyframes = (setupKeyframeControl(&keyframe_ctrl, pipeline, &handle->stream_config) == FISH_EOK);
+    bool fec = (setupFecControl(&fec_ctrl, pipeline, &handle->stream_config) == FISH_EOK);
+    bool pacing = (setupPacer(&pacer, pipeline, "send_queue", &handle->stream_config) == FISH_EOK);
 
-    char gstcmd_buf[1024];
-
-    // Works with delay:
-    sprintf(gstcmd_buf, "rtpbin name=rtpbin rtp-profile=avpf \
-                         nvarguscamerasrc ! video/x-raw(memory:NVMM), \
-                         format=NV12, width=852, height=480 \
-                         ! nvv4l2h264enc insert-sps-pps=true ! h264parse \
-                         ! rtph264pay ssrc=2222 pt=100 \
-                         ! rtprtxqueue max-size-time=2000 max-size-packets=0 \
-                         ! rtpbin.send_rtp_sink_0 \
-                         rtpbin.send_rtp_src_0 ! udpsink  host=%s port=%s \
-                         rtpbin.send_rtcp_src_0 ! udpsink  host=%s port=%s sync=false async=false \
-                    ",
-            video_transport_ip.c_str(), video_transport_port.c_str(),
-            video_transport_ip.c_str(), video_transport_rtcp_port.c_str());
+    bus = gst_element_get_bus(pipeline);
+    while (true)
+    {
+        msg = gst_bus_timed_pop_filtered(bus, PIPELINE_TICK_MS * GST_MSECOND,
+                                         (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS |
+                                                          GST_MESSAGE_SEGMENT_DONE));
+        if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_SEGMENT_DONE)
+        {
+            // Non-flushing, so running time and RTP timestamps carry on across the loop
+            gst_message_unref(msg);
+            gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_SEGMENT,
+                             GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+        }
+        else if (msg != NULL)
+        {
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+            {
+                GError *error = NULL;
+                gst_message_parse_error(msg, &error, NULL);
+                printf("Pipeline error: %s\n", error->message);
+                g_error_free(error);
+            }
+            gst_message_unref(msg);
+            break;
+        }
+
+        if (abr)
+        {
+            updateBitrateControl(&bitrate_ctrl);
+        }
+        if (simulcast)
+        {
+            updateSimulcast(&simulcast_ctrl, handle);
+        }
+        updateVideoProfile(pipeline, handle);
+        updateLatencyGuard(&latency_guard);
+        if (audio)
+        {
+            updateAudioMonitor(&audio_monitor);
+        }
+        if (replay_enabled)
+        {
+            updateReplayBuffer(&replay, handle);
+        }
+        if (keyframes)
+        {
+            updateKeyframeControl(&keyframe_ctrl);
+        }
+        if (fec)
+        {
+            updateFecControl(&fec_ctrl);
+        }
+        if (pacing)
+        {
+            updatePacer(&pacer);
+        }
+    }
+
+    // Probes can still be running, or sleeping in the pacer, on streaming threads until
+    // the pipeline stops, so nothing they use is torn down before that
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    if (pacing)
+    {
+        teardownPacer(&pacer);
+    }
+    if (fec)
+    {
+        teardownFecControl(&fec_ctrl);
+    }
+    if (keyframes)
+    {
+        teardownKeyframeControl(&keyframe_ctrl);
+    }
+    if (replay_enabled)
+    {
+        teardownReplayBuffer(&replay);
+    }
+    if (audio)
+    {
+        teardownAudioMonitor(&audio_monitor);
+    }
+    teardownLatencyGuard(&latency_guard);
+    teardownSimulcast(&simulcast_ctrl);
+    teardownBitrateControl(&bitrate_ctrl);
+    gst_object_unref(bus);
+}
+
+/* Builds the head of the pipeline for a source. The direct V4L2 capture is
+ * opened here, since its launch string depends on the camera's format. */
+static fish_error_t buildSourceDesc(fish_handle_t *handle, int source, fish_v4l2_capture_t *capture, std::string &desc)
+{
+    if (source != FISH_SOURCE_V4L2_DIRECT)
+    {
+        desc = videoSourceDesc(&handle->stream_config, source);
+        return FISH_EOK;
+    }
+
+    fish_error_t err = openV4l2Capture(capture, &handle->stream_config);
+    if (err != FISH_EOK)
+    {
+        return err;
+    }
+    desc = v4l2CaptureDesc(capture);
+    return FISH_EOK;
+}
+
+/* Streams from whichever source type selectVideoSource() picked, through
+ * the same encode and send stages on every machine. */
+fish_error_t createVideoStream(fish_handle_t *handle, int source,
+                               std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port,
+                               std::string audio_transport_ip, std::string audio_transport_port, std::string audio_transport_rtcp_port)
+{
+    GstElement *pipeline;
+    fish_recorder_t recorder;
+    fish_v4l2_capture_t capture;
+    fish_analytics_t analytics;
+    bool direct = (source == FISH_SOURCE_V4L2_DIRECT);
+
+    std::string pipeline_desc;
+    if (buildSourceDesc(handle, source, &capture, pipeline_desc) != FISH_EOK)
+    {
+        return FISH_EIO;
+    }
+
+    /* Cameras with their own H.264 encoder skip ours */
+    if (direct && capture.format == FISH_V4L2_H264)
+    {
+        pipeline_desc += h264LiveSendDesc(handle, video_transport_ip, video_transport_port, video_transport_rtcp_port);
+    }
+    else
+    {
+        pipeline_desc += videoSendDesc(handle, video_transport_ip, video_transport_port, video_transport_rtcp_port);
+    }
+    pipeline_desc += audioSendDesc(handle, audio_transport_ip, audio_transport_port, audio_transport_rtcp_port);
 
     /* Build the pipeline */
-    pipeline = gst_parse_launch(gstcmd_buf, NULL);
+    GError *error = NULL;
+    pipeline = gst_parse_launch(pipeline_desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Failed to build video pipeline: %s\n", error->message);
+        g_error_free(error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        if (direct)
+        {
+            teardownV4l2Capture(&capture);
+        }
+        return FISH_EINVAL;
+    }
+
+    /* Frames captured before PLAYING have no clock to be stamped with and go straight back */
+    if (direct && startV4l2Capture(&capture, pipeline) != FISH_EOK)
+    {
+        gst_object_unref(pipeline);
+        teardownV4l2Capture(&capture);
+        return FISH_EIO;
+    }
+
+    /* Recording needs its muxer before the pipeline starts */
+    bool recording = (setupRecorder(&recorder, pipeline, &handle->stream_config) == FISH_EOK);
+    connectRtcpFeedback(pipeline);
+    bool analysing = (setupAnalytics(&analytics, pipeline, &handle->stream_config) == FISH_EOK);
 
     /* Start playing */
     gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    printf(">> Streaming video from %s\n", getVideoSource(source)->name);
 
     /* Wait until error or EOS */
-    bus = gst_element_get_bus(pipeline);
-    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
-                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    runPipelineLoop(pipeline, handle);
 
     /* Free resources */
-    if (msg != NULL)
+    if (direct)
     {
-        gst_message_unref(msg);
+        teardownV4l2Capture(&capture);
+    }
+    if (recording)
+    {
+        teardownRecorder(&recorder);
+    }
+    if (analysing)
+    {
+        teardownAnalytics(&analytics);
     }
-
-    gst_object_unref(bus);
-    gst_element_set_state(pipeline, GST_STATE_NULL);
     gst_object_unref(pipeline);
 
     return FISH_EOK;
 }
 
-fish_error_t createCSI2ProcessedStream(std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port)
+/* Maps NV12 buffers from appsink in place and pushes them into appsrc, so frames
+ * never leave NV12 and the CPU only touches pixels when a processor needs to. */
+fish_error_t createProcessedStream(fish_handle_t *handle, int source,
+                                   std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port,
+                                   std::string audio_transport_ip, std::string audio_transport_port, std::string audio_transport_rtcp_port)
 {
-    cv::VideoCapture cap("nvarguscamerasrc ! video/x-raw(memory:NVMM), width=(int)1280, height=(int)720, format=(string)NV12, framerate=(fraction)120/1 \
-                        ! nvvidconv ! video/x-raw,format=(string)BGRx \
-                        ! videoconvert ! video/x-raw, format=(string)BGR ! appsink");
+    GstElement *pipeline;
+    fish_recorder_t recorder;
+    fish_frame_pipe_t frame_pipe;
+    fish_v4l2_capture_t capture;
+    fish_analytics_t analytics;
+    fish_underwater_t underwater;
+    fish_stabilizer_t stabilizer;
+    fish_hud_t hud;
+    bool direct = (source == FISH_SOURCE_V4L2_DIRECT);
+
+    std::string pipeline_desc;
+    if (buildSourceDesc(handle, source, &capture, pipeline_desc) != FISH_EOK)
+    {
+        return FISH_EIO;
+    }
+    if (direct && capture.format == FISH_V4L2_H264)
+    {
+        printf("H.264 from the camera cannot be processed, use --v4l2-format=raw or mjpeg\n");
+        teardownV4l2Capture(&capture);
+        return FISH_EINVAL;
+    }
+
+    /* Processors work on system memory, so NVMM frames are copied out once here. I420
+     * sources (e.g. jpegdec) pass through videoconvert untouched, as the frame pipe and
+     * color-kernels.hpp handle both layouts. */
+    pipeline_desc += getVideoSource(source)->nvmm ? " ! nvvidconv" : " ! videoconvert";
+    pipeline_desc += " ! video/x-raw, format=(string){ NV12, I420 } \
+                      ! appsink name=frame_sink max-buffers=2 drop=true sync=false \
+                      appsrc name=frame_src";
+    pipeline_desc += videoSendDesc(handle, video_transport_ip, video_transport_port, video_transport_rtcp_port);
+    pipeline_desc += audioSendDesc(handle, audio_transport_ip, audio_transport_port, audio_transport_rtcp_port);
+
+    /* Build the pipeline */
+    pipeline = gst_parse_launch(pipeline_desc.c_str(), NULL);
+    if (pipeline == NULL)
+    {
+        printf("Failed to build processed video pipeline\n");
+        if (direct)
+        {
+            teardownV4l2Capture(&capture);
+        }
+        return FISH_EINVAL;
+    }
 
-    if (!cap.isOpened())
+    /* Frames are processed by whatever was passed to registerFrameProcessor() */
+    if (setupFramePipe(&frame_pipe, pipeline, "frame_sink", "frame_src", runFrameProcessors, NULL) != FISH_EOK)
     {
-        std::cerr << "VideoCapture not opened" << std::endl;
+        gst_object_unref(pipeline);
+        if (direct)
+        {
+            teardownV4l2Capture(&capture);
+        }
         return FISH_EINVAL;
     }
+    if (direct && startV4l2Capture(&capture, pipeline) != FISH_EOK)
+    {
+        teardownFramePipe(&frame_pipe);
+        gst_object_unref(pipeline);
+        teardownV4l2Capture(&capture);
+        return FISH_EIO;
+    }
+    bool correcting = (setupUnderwaterCorrection(&underwater, &handle->stream_config) == FISH_EOK);
+    setupStabilizer(&stabilizer, &handle->stream_config);
+    startFrameProcessors(0);
+
+    /* With analytics on, draw only on the tee's encoder side, so the detector sees neither
+     * the stamp nor the text. The tee shares buffers, so that costs a copy of each frame. */
+    GstElement *overlay = frame_pipe.appsrc;
+    const char *overlay_pad = "src";
+    GstElement *analytics_tee = gst_bin_get_by_name(GST_BIN(pipeline), ANALYTICS_TEE_NAME);
+    if (analytics_tee != NULL)
+    {
+        overlay = analytics_tee;
+        overlay_pad = ANALYTICS_ENCODE_PAD;
+    }
 
-    int width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-    int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    /* Stamp after processing so the measurement covers encode, network and decode */
+    if (handle->stream_config.latency_stamp)
+    {
+        addLatencyStampProbe(overlay, overlay_pad);
+    }
+    /* Drawn after processing, so the stabilizer's crop and warp leave the text alone */
+    bool drawing = (setupHud(&hud, pipeline, overlay, overlay_pad, handle) == FISH_EOK);
+    if (analytics_tee != NULL)
+    {
+        gst_object_unref(analytics_tee);
+    }
 
-    char gstcmd_buf[1024];
+    /* Recording needs its muxer before the pipeline starts */
+    bool recording = (setupRecorder(&recorder, pipeline, &handle->stream_config) == FISH_EOK);
+    connectRtcpFeedback(pipeline);
+    bool analysing = (setupAnalytics(&analytics, pipeline, &handle->stream_config) == FISH_EOK);
 
-    // Works with delay:
-    sprintf(gstcmd_buf, "rtpbin name=rtpbin rtp-profile=avpf \
-                         appsrc \
-                         ! videoconvert \
-                         ! video/x-raw,format=I420,framerate=120/1 \
-                         ! x264enc tune=zerolatency speed-preset=1 dct8x8=true quantizer=23 pass=qual \
-                         ! rtph264pay pt=100 ssrc=2222 \
-                         ! rtpbin.send_rtp_sink_0 \
-                         rtpbin.send_rtp_src_0 ! udpsink host=%s port=%s \
-                         rtpbin.send_rtcp_src_0 ! udpsink host=%s port=%s sync=false async=false \
-                    ",
-            video_transport_ip.c_str(), video_transport_port.c_str(),
-            video_transport_ip.c_str(), video_transport_rtcp_port.c_str());
+    /* Start playing */
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    printf(">> Streaming processed video from %s\n", getVideoSource(source)->name);
 
-    cv::VideoWriter writer(gstcmd_buf,
-                           0,   // fourcc
-                           120, // fps
-                           cv::Size(width, height),
-                           true); // isColor
+    /* Wait until error or EOS */
+    runPipelineLoop(pipeline, handle);
 
-    if (!writer.isOpened())
+    /* Free resources */
+    if (direct)
     {
-        std::cerr << "VideoWriter not opened" << std::endl;
-        return FISH_EIO;
+        teardownV4l2Capture(&capture);
+    }
+    if (recording)
+    {
+        teardownRecorder(&recorder);
+    }
+    if (analysing)
+    {
+        teardownAnalytics(&analytics);
     }
-    printf(">> Streaming video from file\n");
+    if (drawing)
+    {
+        teardownHud(&hud);
+    }
+    stopFrameProcessors();
+    if (correcting)
+    {
+        teardownUnderwaterCorrection(&underwater);
+    }
+    teardownFramePipe(&frame_pipe);
+    gst_object_unref(pipeline);
 
-    bool incoming_frame;
-    while (true)
+    return FISH_EOK;
+}
+
+/* Logs a warning if the file's H.264 profile is not one the video producer
+ * (profile-level-id 42e01f) can advertise to browsers. */
+static void checkFileProfile(GstElement *pipeline)
+{
+    GstElement *parse = gst_bin_get_by_name(GST_BIN(pipeline), "file_parse");
+    GstPad *pad = gst_element_get_static_pad(parse, "src");
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+
+    if (caps != NULL)
     {
-        cv::Mat frame;
-        incoming_frame = cap.read(frame);
-        if (!incoming_frame)
+        const gchar *profile = gst_structure_get_string(gst_caps_get_structure(caps, 0), "profile");
+        if (profile != NULL && strcmp(profile, "constrained-baseline") != 0 && strcmp(profile, "baseline") != 0)
         {
-            break;
+            printf("Warning: file is H.264 %s, but the producer signals constrained baseline\n", profile);
         }
-        /* Process image here if desired */
-        writer.write(frame);
+        gst_caps_unref(caps);
     }
 
-    return FISH_EOK;
+    gst_object_unref(pad);
+    gst_object_unref(parse);
 }
-#endif
-
-/* Run gstreamer command to stream from the
- * a webcam. */
-fish_error_t videoStreamFile(std::string video_transport_ip,
-                             std::string video_transport_port,
-                             std::string video_transport_rtcp_port,
-                             std::string file_name)
+
+/* Replays the H.264 track of an MP4 file without decoding or re-encoding
+ * it, paced to the file's timestamps and optionally looped forever. */
+fish_error_t streamH264File(fish_handle_t *handle,
+                            std::string video_transport_ip,
+                            std::string video_transport_port,
+                            std::string video_transport_rtcp_port,
+                            std::string audio_transport_ip,
+                            std::string audio_transport_port,
+                            std::string audio_transport_rtcp_port,
+                            std::string file_name)
 {
-    cv::VideoCapture cap(file_name);
-    if (!cap.isOpened())
+    GstElement *pipeline;
+
+    std::string pipeline_desc = h264FileSendDesc(handle, file_name, video_transport_ip,
+                                                 video_transport_port, video_transport_rtcp_port);
+    pipeline_desc += audioSendDesc(handle, audio_transport_ip, audio_transport_port, audio_transport_rtcp_port);
+
+    /* Build the pipeline */
+    GError *error = NULL;
+    pipeline = gst_parse_launch(pipeline_desc.c_str(), &error);
+    if (error != NULL)
     {
-        std::cerr << "VideoCapture not opened" << std::endl;
+        printf("Failed to build file pipeline: %s\n", error->message);
+        g_error_free(error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
         return FISH_EINVAL;
     }
 
-    int width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
-    int height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
-
-    char gstcmd_buf[600];
-    sprintf(gstcmd_buf, "rtpbin name=rtpbin rtp-profile=avpf \
-                         appsrc \
-                         ! videoconvert \
-                         ! video/x-raw,format=I420,framerate=30/1 \
-                         ! x264enc tune=zerolatency speed-preset=1 dct8x8=true quantizer=23 pass=qual \
-                         ! rtph264pay pt=100 ssrc=2222 \
-                         ! rtpbin.send_rtp_sink_0 \
-                         rtpbin.send_rtp_src_0 ! udpsink host=%s port=%s \
-                         rtpbin.send_rtcp_src_0 ! udpsink host=%s port=%s sync=false async=false \
-                    ",
-            video_transport_ip.c_str(), video_transport_port.c_str(),
-            video_transport_ip.c_str(), video_transport_rtcp_port.c_str());
-
-    cv::VideoWriter writer(
-        gstcmd_buf,
-        0,  // fourcc
-        30, // fps
-        cv::Size(width, height),
-        true); // isColor
-
-    if (!writer.isOpened())
-    {
-        std::cerr << "VideoWriter not opened" << std::endl;
+    connectRtcpFeedback(pipeline);
+
+    /* Preroll so the demuxer knows the file before seeking */
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE)
+    {
+        printf("Could not open %s\n", file_name.c_str());
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
         return FISH_EIO;
     }
-    printf(">> Streaming video from file\n");
+    checkFileProfile(pipeline);
 
-    bool incoming_frame;
-    while (true)
+    /* A segment seek ends in SEGMENT_DONE instead of EOS, which runPipelineLoop loops on */
+    if (handle->stream_config.file_loop)
     {
-        cv::Mat frame;
-        incoming_frame = cap.read(frame);
-        if (!incoming_frame)
-        {
-            break;
-        }
-        writer.write(frame);
+        gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT),
+                         GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
     }
 
+    /* Start playing */
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    printf(">> Streaming %s without re-encoding%s\n", file_name.c_str(),
+           handle->stream_config.file_loop ? " (looping)" : "");
+
+    /* Wait until error or EOS */
+    runPipelineLoop(pipeline, handle);
+
+    /* Free resources */
+    gst_object_unref(pipeline);
+
     return FISH_EOK;
-}
+}
\ No newline at end of file
@@ -3,10 +3,6 @@
 
 #include "../common/fish_types.h"
 
-#if defined(__aarch64__)
-#define JETSON_TARGET
-#endif
-
 /* Checks if mediasoup room exists by sending a simple GET
  * request and checking for 200. Returns errno::EOK if succesful. */
 fish_error_t checkRoom(const char *server_url, const char *room_id);
@@ -50,27 +46,39 @@ fish_error_t createMediasoupProducerAudio(const char *server_url, const char *ro
                                           std::string audio_transport_id);
 
 /* Create a mediasoup Producer to send video by sending
- * our RTP parameters via a HTTP POST. */
+ * our RTP parameters via a HTTP POST. encodings is the JSON
+ * array of RTP encodings, one per simulcast layer. extra_codecs
+ * is appended to the codecs array after H.264, e.g. for FEC. */
 fish_error_t createMediasoupProducerVideo(const char *server_url, const char *room_id,
                                           std::string token, std::string broadcaster_id,
-                                          std::string video_transport_id);
+                                          std::string video_transport_id,
+                                          std::string encodings,
+                                          std::string extra_codecs);
 
-#if defined(JETSON_TARGET)
-/* Run gstreamer command to stream from the
- * CSI2 camera. Will not run on non-Jetson hardware. */
-fish_error_t createCSI2Stream(std::string video_transport_ip,
-                              std::string video_transport_port,
-                              std::string video_transport_rtcp_port);
+/* Stream from the given fish_source_type_t, as
+ * resolved by selectVideoSource(). */
+fish_error_t createVideoStream(fish_handle_t *handle, int source,
+                               std::string video_transport_ip,
+                               std::string video_transport_port,
+                               std::string video_transport_rtcp_port,
+                               std::string audio_transport_ip,
+                               std::string audio_transport_port,
+                               std::string audio_transport_rtcp_port);
 
-/* Uses OpenCV to allow for processing. Worse performance due to memory copying to CPU
- */
-fish_error_t createCSI2ProcessedStream(std::string video_transport_ip,
-                                       std::string video_transport_port,
-                                       std::string video_transport_rtcp_port);
-#endif
+/* Maps source buffers through an appsink/appsrc pair to allow for processing.
+ * Frames stay in NV12 (or I420) and are only copied when a processing step writes them. */
+fish_error_t createProcessedStream(fish_handle_t *handle, int source,
+                                   std::string video_transport_ip,
+                                   std::string video_transport_port,
+                                   std::string video_transport_rtcp_port,
+                                   std::string audio_transport_ip,
+                                   std::string audio_transport_port,
+                                   std::string audio_transport_rtcp_port);
 
-/* Run gstreamer command to stream from the
- * a file. */
-fish_error_t videoStreamFile(std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port, std::string file_name);
+/* Replay the H.264 track of an MP4 file without decoding
+ * or re-encoding it. */
+fish_error_t streamH264File(fish_handle_t *handle, std::string video_transport_ip, std::string video_transport_port, std::string video_transport_rtcp_port,
+                            std::string audio_transport_ip, std::string audio_transport_port, std::string audio_transport_rtcp_port,
+                            std::string file_name);
 
 #endif /* __FISHGST_HPP__ */
\ No newline at end of file
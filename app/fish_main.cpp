@@ -5,6 +5,11 @@
 */
 
 #include "streaming/gst-streamer.hpp"
+#include "streaming/load-gen.hpp"
+#include "streaming/stream-config.hpp"
+#include "streaming/video-profiles.hpp"
+#include "streaming/encoder-profiles.hpp"
+#include "streaming/batch-udp-sink.hpp"
 #include "actuators/serial-actuators.hpp"
 #include "socks/boost-sock.hpp"
 #include "common/fish_types.h"
@@ -20,6 +25,11 @@ fish_handle_t handle = {90, 90, 90, 90, 0, 0};
 
 void sigint_handler(int s)
 {
+    // The load generator deletes its broadcasters from its own loop, a second ^C skips that
+    if (stopLoadGen())
+    {
+        return;
+    }
     cleanupBroadcaster(handle.server_url, handle.room_id, handle.token, handle.broadcaster_id);
     exit(0);
 }
@@ -28,13 +38,39 @@ int main(int argc, char *argv[])
 {
     signal(SIGINT, sigint_handler);
 
-    if (argc != 7)
+    if (argc < 7)
     {
-        std::cout << "Usage: ./nemo <server url> <room id> <username> <password> <host> <port>\n";
+        std::cout << "Usage: ./nemo <server url> <room id> <username> <password> <host> <port> [options]\n";
         std::cout << "Example:\n";
         std::cout << "  ./nemo https://192.168.0.142:4443 FISH username@gmail.com password123 192.168.0.142 4443\n";
+        std::cout << "Options:\n";
+        printStreamOptions();
+        return EXIT_FAILURE;
+    }
+
+    initStreamConfig(&handle.stream_config);
+    for (int i = 7; i < argc; i++)
+    {
+        if (parseStreamOption(argv[i], &handle.stream_config) != FISH_EOK)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    handle.curr_video_profile = findVideoProfile(handle.stream_config.video_profile);
+    if (handle.curr_video_profile < 0)
+    {
+        std::cout << "Unknown video profile: " << handle.stream_config.video_profile << "\n";
+        return EXIT_FAILURE;
+    }
+    handle.next_video_profile = handle.curr_video_profile;
+
+    if (findEncoderProfile(handle.stream_config.encoder_profile) < 0)
+    {
+        std::cout << "Unknown encoder profile: " << handle.stream_config.encoder_profile << "\n";
         return EXIT_FAILURE;
     }
+    handle.next_simulcast_mask = 0xFF;
 
     const char *server_url = argv[1];
     const char *room_id = argv[2];
@@ -51,6 +87,14 @@ int main(int argc, char *argv[])
     handle.port = port;
 
     gst_init(&argc, &argv);
+    registerBatchUdpSink();
+
+    // Load testing replaces the robot services entirely
+    if (handle.stream_config.loadgen_broadcasters > 0)
+    {
+        runLoadGenService(&handle);
+        return 0;
+    }
 
     // Spawn 3 main services
     std::thread video_thread(runVideoService, &handle);
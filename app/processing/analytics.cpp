@@ -0,0 +1,371 @@
+#include "analytics.hpp"
+#include "color-kernels.hpp"
+#include "frame-pipe.hpp"
+
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "jsoncpp/json/json.h"
+
+#define ANALYTICS_PULL_TIMEOUT (100 * GST_MSECOND) // How often the worker checks for shutdown
+#define ANALYTICS_DNN_SIZE 300                     // MobileNet-SSD input, scaled to -1..1
+#define ANALYTICS_DNN_SCALE (1.0 / 127.5)
+#define ANALYTICS_DNN_MEAN 127.5
+#define ANALYTICS_MIN_SCORE 0.4
+#define ANALYTICS_BACKGROUND_RATE 0.05 // Weight of each frame in the motion background
+#define ANALYTICS_MOTION_THRESHOLD 25  // Luma difference that counts as motion
+#define ANALYTICS_MIN_AREA 0.002       // Smallest motion blob as a fraction of the frame
+#define ANALYTICS_MAX_OBJECTS 32
+#define ANALYTICS_REPORT_US (5 * G_USEC_PER_SEC)
+
+std::string analyticsTeeDesc(const fish_stream_config_t *config)
+{
+    if (!config->analytics)
+    {
+        return "";
+    }
+    return " ! tee name=" ANALYTICS_TEE_NAME;
+}
+
+std::string analyticsBranchDesc(const fish_stream_config_t *config, bool hardware)
+{
+    if (!config->analytics)
+    {
+        return "";
+    }
+
+    std::string desc = " " ANALYTICS_TEE_NAME ". ! queue max-size-buffers=1 max-size-bytes=0 max-size-time=0 leaky=downstream";
+    // Drop before scaling so skipped frames cost nothing
+    desc += " ! videorate drop-only=true max-rate=" + std::to_string(std::max(config->analytics_fps, (uint32_t)1));
+    desc += hardware ? " ! nvvidconv" : " ! videoscale ! videoconvert";
+    desc += " ! video/x-raw, format=(string)NV12, width=(int)" + std::to_string(config->analytics_width) +
+            ", height=(int)" + std::to_string(config->analytics_height);
+    desc += " ! appsink name=" ANALYTICS_SINK_NAME " max-buffers=1 drop=true sync=false async=false";
+    return desc;
+}
+
+/* Moving blobs against a running average of the luma */
+static void detectMotion(fish_analytics_t *analytics, const fish_frame_t *frame)
+{
+    cv::Mat blurred;
+    cv::GaussianBlur(frame->y, blurred, cv::Size(5, 5), 0);
+    if (analytics->background.rows != blurred.rows || analytics->background.cols != blurred.cols)
+    {
+        blurred.convertTo(analytics->background, CV_32F);
+        return;
+    }
+
+    cv::Mat reference;
+    cv::Mat mask;
+    analytics->background.convertTo(reference, CV_8U);
+    cv::absdiff(blurred, reference, mask);
+    cv::threshold(mask, mask, ANALYTICS_MOTION_THRESHOLD, 255, cv::THRESH_BINARY);
+    cv::dilate(mask, mask, cv::Mat(), cv::Point(-1, -1), 2);
+    cv::accumulateWeighted(blurred, analytics->background, ANALYTICS_BACKGROUND_RATE);
+
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+    int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids);
+    double min_area = ANALYTICS_MIN_AREA * frame->width * frame->height;
+    for (int i = 1; i < count && analytics->detections.size() < ANALYTICS_MAX_OBJECTS; i++) // 0 is the background
+    {
+        int area = stats.at<int>(i, cv::CC_STAT_AREA);
+        if (area < min_area)
+        {
+            continue;
+        }
+
+        int w = stats.at<int>(i, cv::CC_STAT_WIDTH);
+        int h = stats.at<int>(i, cv::CC_STAT_HEIGHT);
+        fish_detection_t detection;
+        detection.class_id = -1;
+        detection.score = (float)area / (w * h); // How much of the box actually moved
+        detection.x = (float)stats.at<int>(i, cv::CC_STAT_LEFT) / frame->width;
+        detection.y = (float)stats.at<int>(i, cv::CC_STAT_TOP) / frame->height;
+        detection.w = (float)w / frame->width;
+        detection.h = (float)h / frame->height;
+        analytics->detections.push_back(detection);
+    }
+}
+
+/* SSD-style detector output: one row of image, class, score, x1, y1, x2, y2 per box */
+static void detectObjects(fish_analytics_t *analytics, const fish_frame_t *frame)
+{
+    frameToBgr(frame, analytics->bgr);
+    cv::Mat blob = cv::dnn::blobFromImage(analytics->bgr, ANALYTICS_DNN_SCALE, cv::Size(ANALYTICS_DNN_SIZE, ANALYTICS_DNN_SIZE),
+                                          cv::Scalar(ANALYTICS_DNN_MEAN, ANALYTICS_DNN_MEAN, ANALYTICS_DNN_MEAN), false, false);
+    analytics->net.setInput(blob);
+    cv::Mat out = analytics->net.forward();
+
+    cv::Mat rows(out.size[2], out.size[3], CV_32F, out.ptr<float>());
+    for (int i = 0; i < rows.rows && analytics->detections.size() < ANALYTICS_MAX_OBJECTS; i++)
+    {
+        float score = rows.at<float>(i, 2);
+        if (score < ANALYTICS_MIN_SCORE)
+        {
+            continue;
+        }
+
+        float x1 = std::min(1.0f, std::max(0.0f, rows.at<float>(i, 3)));
+        float y1 = std::min(1.0f, std::max(0.0f, rows.at<float>(i, 4)));
+        float x2 = std::min(1.0f, std::max(0.0f, rows.at<float>(i, 5)));
+        float y2 = std::min(1.0f, std::max(0.0f, rows.at<float>(i, 6)));
+        fish_detection_t detection;
+        detection.class_id = (int)rows.at<float>(i, 1);
+        detection.score = score;
+        detection.x = x1;
+        detection.y = y1;
+        detection.w = x2 - x1;
+        detection.h = y2 - y1;
+        analytics->detections.push_back(detection);
+    }
+}
+
+/* Age of a frame from its running-time PTS, in ns, or -1 if there is no clock yet */
+static gint64 frameAgeNs(fish_analytics_t *analytics, GstClockTime pts)
+{
+    GstClock *clock = gst_element_get_clock(analytics->pipeline);
+    if (clock == NULL || !GST_CLOCK_TIME_IS_VALID(pts))
+    {
+        if (clock != NULL)
+        {
+            gst_object_unref(clock);
+        }
+        return -1;
+    }
+
+    GstClockTime running = gst_clock_get_time(clock) - gst_element_get_base_time(analytics->pipeline);
+    gst_object_unref(clock);
+    return (gint64)running - (gint64)pts;
+}
+
+static void publishDetections(fish_analytics_t *analytics, const fish_frame_t *frame)
+{
+    gint64 age_ns = frameAgeNs(analytics, frame->pts);
+
+    Json::Value root;
+    root["type"] = "detections";
+    root["frame"] = (Json::UInt64)analytics->frames;
+    root["pts_ns"] = (Json::UInt64)frame->pts;
+    root["capture_us"] = (Json::Int64)(g_get_real_time() - std::max(age_ns, (gint64)0) / 1000);
+    root["detector"] = analytics->use_dnn ? "dnn" : "motion";
+    root["width"] = frame->width;
+    root["height"] = frame->height;
+    root["latency_ms"] = age_ns >= 0 ? age_ns / 1e6 : 0.0;
+    root["objects"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < analytics->detections.size(); i++)
+    {
+        const fish_detection_t *detection = &analytics->detections[i];
+        Json::Value object;
+        object["class"] = detection->class_id;
+        object["score"] = detection->score;
+        object["x"] = detection->x;
+        object["y"] = detection->y;
+        object["w"] = detection->w;
+        object["h"] = detection->h;
+        root["objects"].append(object);
+    }
+
+    Json::FastWriter writer;
+    std::string message = writer.write(root);
+    if (sendto(analytics->fd, message.data(), message.size(), 0, (struct sockaddr *)&analytics->addr, analytics->addr_len) >= 0)
+    {
+        analytics->published++;
+    }
+}
+
+static void reportAnalytics(fish_analytics_t *analytics)
+{
+    gint64 now_us = g_get_monotonic_time();
+    gint64 wall_us = now_us - analytics->report_us;
+    if (wall_us < ANALYTICS_REPORT_US)
+    {
+        return;
+    }
+
+    uint64_t frames = analytics->frames - analytics->report_frames;
+    printf(">> Analytics: %.1f fps, avg %.1f ms, %llu objects, %llu published\n",
+           frames * (double)G_USEC_PER_SEC / wall_us, analytics->frames ? analytics->total_ms / analytics->frames : 0.0,
+           (unsigned long long)analytics->objects, (unsigned long long)analytics->published);
+    analytics->report_us = now_us;
+    analytics->report_frames = analytics->frames;
+}
+
+static void analyticsLoop(fish_analytics_t *analytics)
+{
+    GstAppSink *appsink = GST_APP_SINK(analytics->appsink);
+    while (analytics->running)
+    {
+        GstSample *sample = gst_app_sink_try_pull_sample(appsink, ANALYTICS_PULL_TIMEOUT);
+        if (sample == NULL)
+        {
+            // Returns at once when stopped or at EOS, so do not spin
+            if (gst_app_sink_is_eos(appsink))
+            {
+                g_usleep(ANALYTICS_PULL_TIMEOUT / GST_USECOND);
+            }
+            continue;
+        }
+
+        GstVideoInfo info;
+        GstVideoFrame vframe;
+        GstBuffer *buf = gst_sample_get_buffer(sample);
+        if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+            !gst_video_frame_map(&vframe, &info, buf, GST_MAP_READ))
+        {
+            gst_sample_unref(sample);
+            continue;
+        }
+
+        fish_frame_t frame;
+        wrapVideoFrame(&vframe, GST_BUFFER_PTS(buf), &frame);
+        gint64 start_us = g_get_monotonic_time();
+        analytics->detections.clear();
+        if (analytics->use_dnn)
+        {
+            detectObjects(analytics, &frame);
+        }
+        else
+        {
+            detectMotion(analytics, &frame);
+        }
+        analytics->total_ms += (g_get_monotonic_time() - start_us) / 1000.0;
+        analytics->frames++;
+        analytics->objects += analytics->detections.size();
+
+        if (analytics->fd >= 0)
+        {
+            publishDetections(analytics, &frame);
+        }
+        gst_video_frame_unmap(&vframe);
+        gst_sample_unref(sample);
+
+        reportAnalytics(analytics);
+    }
+}
+
+/* Resolves "host:port" into the publish socket */
+static fish_error_t openPublishSocket(fish_analytics_t *analytics, const char *target)
+{
+    std::string address(target);
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+    {
+        printf("Analytics publish address must be host:port: %s\n", target);
+        return FISH_EINVAL;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0 || res == NULL)
+    {
+        printf("Cannot resolve %s: %s\n", target, gai_strerror(err));
+        return FISH_EINVAL;
+    }
+
+    analytics->fd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    memcpy(&analytics->addr, res->ai_addr, res->ai_addrlen);
+    analytics->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    if (analytics->fd < 0)
+    {
+        printf("Cannot open analytics socket: %s\n", strerror(errno));
+        return FISH_EIO;
+    }
+    return FISH_EOK;
+}
+
+fish_error_t setupAnalytics(fish_analytics_t *analytics, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    analytics->pipeline = pipeline;
+    analytics->config = config;
+    analytics->appsink = NULL;
+    analytics->running = false;
+    analytics->fd = -1;
+    analytics->frames = 0;
+    analytics->published = 0;
+    analytics->objects = 0;
+    analytics->total_ms = 0.0;
+    analytics->report_frames = 0;
+    analytics->report_us = g_get_monotonic_time();
+
+    if (!config->analytics)
+    {
+        return FISH_EPERM;
+    }
+    analytics->appsink = gst_bin_get_by_name(GST_BIN(pipeline), ANALYTICS_SINK_NAME);
+    if (analytics->appsink == NULL)
+    {
+        // H.264 cameras and file pass-through have no raw frames to tap
+        printf("Analytics need raw video, skipping\n");
+        return FISH_EPERM;
+    }
+
+    analytics->use_dnn = (config->analytics_model[0] != '\0');
+    if (analytics->use_dnn)
+    {
+        try
+        {
+            analytics->net = cv::dnn::readNet(config->analytics_model);
+        }
+        catch (const cv::Exception &e)
+        {
+            printf("Cannot load analytics model %s: %s\n", config->analytics_model, e.what());
+        }
+        if (analytics->net.empty())
+        {
+            gst_object_unref(analytics->appsink);
+            analytics->appsink = NULL;
+            return FISH_EINVAL;
+        }
+    }
+
+    if (config->analytics_publish[0] != '\0' && openPublishSocket(analytics, config->analytics_publish) != FISH_EOK)
+    {
+        gst_object_unref(analytics->appsink);
+        analytics->appsink = NULL;
+        return FISH_EINVAL;
+    }
+
+    analytics->running = true;
+    analytics->worker = std::thread(analyticsLoop, analytics);
+
+    printf(">> Analytics on %ux%u at %u fps with the %s detector, publishing to %s\n",
+           config->analytics_width, config->analytics_height, config->analytics_fps,
+           analytics->use_dnn ? "DNN" : "motion", analytics->fd >= 0 ? config->analytics_publish : "nowhere");
+    return FISH_EOK;
+}
+
+void teardownAnalytics(fish_analytics_t *analytics)
+{
+    analytics->running = false;
+    if (analytics->worker.joinable())
+    {
+        analytics->worker.join();
+    }
+    if (analytics->appsink != NULL)
+    {
+        gst_object_unref(analytics->appsink);
+        analytics->appsink = NULL;
+    }
+    if (analytics->fd >= 0)
+    {
+        close(analytics->fd);
+        analytics->fd = -1;
+    }
+}
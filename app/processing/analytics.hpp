@@ -0,0 +1,94 @@
+#ifndef __ANALYTICS_HPP__
+#define __ANALYTICS_HPP__
+
+#include <gst/gst.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+#include "../common/fish_types.h"
+
+#define ANALYTICS_TEE_NAME "analytics_tee"
+#define ANALYTICS_SINK_NAME "analytics_sink"
+#define ANALYTICS_ENCODE_PAD "src_0" // Tee pad towards the encoder, see analyticsTeeDesc()
+
+/* The analytics branch taps raw frames ahead of the profile scale/rate stage, so its rate
+ * and size do not follow the encoder. It starts with a one-frame leaky queue and ends in
+ * an appsink that keeps only the newest frame, so the encode path never waits on it and a
+ * slow detector just analyses fewer frames.
+ *
+ * The detector is an OpenCV DNN model with SSD-style output ([1, 1, N, 7] rows of image,
+ * class, score, x1, y1, x2, y2), e.g. MobileNet-SSD, when --analytics-model is given. It
+ * falls back to a motion detector against a running background otherwise. Results go out
+ * as one JSON datagram per analysed frame to --analytics-publish:
+ *   {"type": "detections", "frame": 12, "pts_ns": ..., "capture_us": ..., "detector": "motion",
+ *    "width": 320, "height": 180, "latency_ms": 8.1,
+ *    "objects": [{"class": -1, "score": 0.4, "x": 0.1, "y": 0.2, "w": 0.05, "h": 0.1}]}
+ * Boxes are normalised to the frame, and capture_us is the wall clock (g_get_real_time())
+ * at capture, for matching results with other services. */
+
+typedef struct
+{
+    int class_id; // -1 for motion
+    float score;
+    float x;      // Box normalised to 0..1
+    float y;
+    float w;
+    float h;
+} fish_detection_t;
+
+typedef struct
+{
+    GstElement *pipeline;
+    GstElement *appsink;
+    const fish_stream_config_t *config;
+    std::thread worker;
+    std::atomic<bool> running;
+
+    // Detector state, only touched by the worker
+    bool use_dnn;
+    cv::dnn::Net net;
+    cv::Mat bgr;
+    cv::Mat background; // Running average of the luma, CV_32F
+    std::vector<fish_detection_t> detections;
+
+    int fd; // Publish socket, -1 when results are only logged
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+
+    uint64_t frames;
+    uint64_t published;
+    uint64_t objects;
+    double total_ms;
+    uint64_t report_frames;
+    gint64 report_us;
+} fish_analytics_t;
+
+/* Description: Returns the tee that splits raw video towards the analytics branch, to be
+ *              placed before the profile stage. Whatever follows it in the description is
+ *              linked first, so the encoder gets ANALYTICS_ENCODE_PAD; anything drawn on
+ *              the streamed video only goes there. Empty when analytics are off.
+ */
+std::string analyticsTeeDesc(const fish_stream_config_t *config);
+
+/* Description: Returns the analytics branch hanging off the tee, decimated and scaled
+ *              with nvvidconv when hardware is set and videoscale otherwise. Empty when
+ *              analytics are off.
+ */
+std::string analyticsBranchDesc(const fish_stream_config_t *config, bool hardware);
+
+/* Description: Loads the detector, opens the publish socket and starts the worker that
+ *              pulls frames from the branch's appsink. Returns FISH_EPERM if analytics are
+ *              off or the pipeline has no branch, FISH_EINVAL if the model cannot be loaded.
+ */
+fish_error_t setupAnalytics(fish_analytics_t *analytics, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Stops the worker and closes the socket. */
+void teardownAnalytics(fish_analytics_t *analytics);
+
+#endif /* __ANALYTICS_HPP__ */
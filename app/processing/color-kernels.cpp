@@ -0,0 +1,707 @@
+#include "color-kernels.hpp"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define COLOR_KERNELS_NEON
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define COLOR_KERNELS_SSSE3
+// Built for SSSE3 on its own so the rest of the app keeps the baseline x86-64 flags
+#define SSSE3_FN __attribute__((target("ssse3")))
+#endif
+
+// YUV -> BGR in Q6: 1.164 * 64, 1.596 * 64, 0.813 * 64, 0.391 * 64 and 2.018 * 64. Every
+// intermediate fits in int16, which is what lets the SIMD paths work 8 lanes at a time.
+#define YUV_Y 74
+#define YUV_VR 102
+#define YUV_VG 52
+#define YUV_UG 25
+#define YUV_UB 129
+#define YUV_ROUND 32
+
+// BGR -> YUV in Q7, rounded so each chroma row sums to zero and grey stays grey
+#define RGB_YR 33
+#define RGB_YG 64
+#define RGB_YB 13
+#define RGB_UR 19
+#define RGB_UG 37
+#define RGB_UB 56
+#define RGB_VR 56
+#define RGB_VG 47
+#define RGB_VB 9
+#define RGB_ROUND 64
+
+static inline uint8_t clampByte(int value)
+{
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/* ---- Scalar reference, also used for the tail of every row ---- */
+
+static void yuvRowToBgrScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                              uint8_t *bgr, int x, int width)
+{
+    for (; x < width; x++)
+    {
+        int c = (x >> 1) * uv_step;
+        int cu = u[c] - 128;
+        int cv = v[c] - 128;
+        int luma = (y[x] - 16) * YUV_Y + YUV_ROUND;
+        bgr[3 * x] = clampByte((luma + YUV_UB * cu) >> 6);
+        bgr[3 * x + 1] = clampByte((luma - YUV_VG * cv - YUV_UG * cu) >> 6);
+        bgr[3 * x + 2] = clampByte((luma + YUV_VR * cv) >> 6);
+    }
+}
+
+static inline uint8_t bgrToLuma(const uint8_t *px)
+{
+    return (uint8_t)(((RGB_YR * px[2] + RGB_YG * px[1] + RGB_YB * px[0] + RGB_ROUND) >> 7) + 16);
+}
+
+static void bgrRowsToYuvScalar(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1,
+                               uint8_t *u, uint8_t *v, int uv_step, int x, int width)
+{
+    for (; x < width; x += 2)
+    {
+        const uint8_t *p00 = bgr0 + 3 * x;
+        const uint8_t *p01 = p00 + 3;
+        const uint8_t *p10 = bgr1 + 3 * x;
+        const uint8_t *p11 = p10 + 3;
+        y0[x] = bgrToLuma(p00);
+        y0[x + 1] = bgrToLuma(p01);
+        y1[x] = bgrToLuma(p10);
+        y1[x + 1] = bgrToLuma(p11);
+
+        int b = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+        int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+        int r = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+        int c = (x >> 1) * uv_step;
+        u[c] = clampByte(((RGB_UB * b - RGB_UR * r - RGB_UG * g + RGB_ROUND) >> 7) + 128);
+        v[c] = clampByte(((RGB_VR * r - RGB_VG * g - RGB_VB * b + RGB_ROUND) >> 7) + 128);
+    }
+}
+
+/* channels is 1 for Y and I420 chroma planes, 2 for the interleaved NV12 chroma plane */
+static void downscaleRowScalar(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int channels,
+                               int x, int out_width)
+{
+    for (; x < out_width; x++)
+    {
+        for (int k = 0; k < channels; k++)
+        {
+            int i = 2 * x * channels + k;
+            dst[x * channels + k] = (uint8_t)((row0[i] + row0[i + channels] + row1[i] + row1[i + channels] + 2) >> 2);
+        }
+    }
+}
+
+static void lutRowScalar(const uint8_t *src, uint8_t *dst, const uint8_t *lut, int x, int width)
+{
+    for (; x < width; x++)
+    {
+        dst[x] = lut[src[x]];
+    }
+}
+
+/* Interleaved NV12 chroma, width counts U/V pairs */
+static void lutPairRowScalar(const uint8_t *src, uint8_t *dst, const uint8_t *lut_u, const uint8_t *lut_v,
+                             int x, int width)
+{
+    for (; x < width; x++)
+    {
+        dst[2 * x] = lut_u[src[2 * x]];
+        dst[2 * x + 1] = lut_v[src[2 * x + 1]];
+    }
+}
+
+/* ---- NEON (Jetson) ---- */
+
+#if defined(COLOR_KERNELS_NEON)
+static int yuvRowToBgrSimd(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                           uint8_t *bgr, int width)
+{
+    const int16x8_t y_offset = vdupq_n_s16(YUV_ROUND - 16 * YUV_Y);
+    const int16x8_t c_offset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t yv = vld1q_u8(y + x);
+        uint8x8_t u8;
+        uint8x8_t v8;
+        if (uv_step == 2)
+        {
+            uint8x8x2_t uv = vld2_u8(u + x);
+            u8 = uv.val[0];
+            v8 = uv.val[1];
+        }
+        else
+        {
+            u8 = vld1_u8(u + x / 2);
+            v8 = vld1_u8(v + x / 2);
+        }
+
+        int16x8_t cu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c_offset);
+        int16x8_t cv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c_offset);
+        int16x8x2_t r_uv = vzipq_s16(vmulq_n_s16(cv, YUV_VR), vmulq_n_s16(cv, YUV_VR));
+        int16x8_t g = vmlaq_n_s16(vmulq_n_s16(cv, YUV_VG), cu, YUV_UG);
+        int16x8x2_t g_uv = vzipq_s16(g, g);
+        int16x8x2_t b_uv = vzipq_s16(vmulq_n_s16(cu, YUV_UB), vmulq_n_s16(cu, YUV_UB));
+
+        int16x8_t y_lo = vmlaq_n_s16(y_offset, vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv))), YUV_Y);
+        int16x8_t y_hi = vmlaq_n_s16(y_offset, vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv))), YUV_Y);
+
+        uint8x16x3_t out;
+        out.val[0] = vcombine_u8(vqshrun_n_s16(vqaddq_s16(y_lo, b_uv.val[0]), 6),
+                                 vqshrun_n_s16(vqaddq_s16(y_hi, b_uv.val[1]), 6));
+        out.val[1] = vcombine_u8(vqshrun_n_s16(vqsubq_s16(y_lo, g_uv.val[0]), 6),
+                                 vqshrun_n_s16(vqsubq_s16(y_hi, g_uv.val[1]), 6));
+        out.val[2] = vcombine_u8(vqshrun_n_s16(vqaddq_s16(y_lo, r_uv.val[0]), 6),
+                                 vqshrun_n_s16(vqaddq_s16(y_hi, r_uv.val[1]), 6));
+        vst3q_u8(bgr + 3 * x, out);
+    }
+    return x;
+}
+
+static inline uint8x16_t lumaNeon(const uint8x16x3_t &px)
+{
+    uint16x8_t lo = vmull_u8(vget_low_u8(px.val[2]), vdup_n_u8(RGB_YR));
+    lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(RGB_YG));
+    lo = vmlal_u8(lo, vget_low_u8(px.val[0]), vdup_n_u8(RGB_YB));
+    uint16x8_t hi = vmull_u8(vget_high_u8(px.val[2]), vdup_n_u8(RGB_YR));
+    hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(RGB_YG));
+    hi = vmlal_u8(hi, vget_high_u8(px.val[0]), vdup_n_u8(RGB_YB));
+    return vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 7), vrshrn_n_u16(hi, 7)), vdupq_n_u8(16));
+}
+
+/* Average of each 2x2 block of one channel, 16 pixels wide */
+static inline int16x8_t blockAverageNeon(uint8x16_t row0, uint8x16_t row1)
+{
+    return vreinterpretq_s16_u16(vrshrq_n_u16(vaddq_u16(vpaddlq_u8(row0), vpaddlq_u8(row1)), 2));
+}
+
+static int bgrRowsToYuvSimd(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int uv_step, int width)
+{
+    const int16x8_t c_offset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x3_t p0 = vld3q_u8(bgr0 + 3 * x);
+        uint8x16x3_t p1 = vld3q_u8(bgr1 + 3 * x);
+        vst1q_u8(y0 + x, lumaNeon(p0));
+        vst1q_u8(y1 + x, lumaNeon(p1));
+
+        int16x8_t b = blockAverageNeon(p0.val[0], p1.val[0]);
+        int16x8_t g = blockAverageNeon(p0.val[1], p1.val[1]);
+        int16x8_t r = blockAverageNeon(p0.val[2], p1.val[2]);
+
+        int16x8_t cu = vmlsq_n_s16(vmlsq_n_s16(vmulq_n_s16(b, RGB_UB), r, RGB_UR), g, RGB_UG);
+        int16x8_t cv = vmlsq_n_s16(vmlsq_n_s16(vmulq_n_s16(r, RGB_VR), g, RGB_VG), b, RGB_VB);
+        uint8x8_t u8 = vqmovun_s16(vaddq_s16(vrshrq_n_s16(cu, 7), c_offset));
+        uint8x8_t v8 = vqmovun_s16(vaddq_s16(vrshrq_n_s16(cv, 7), c_offset));
+        if (uv_step == 2)
+        {
+            uint8x8x2_t uv = {{u8, v8}};
+            vst2_u8(u + x, uv);
+        }
+        else
+        {
+            vst1_u8(u + x / 2, u8);
+            vst1_u8(v + x / 2, v8);
+        }
+    }
+    return x;
+}
+
+static int downscaleRowSimd(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int channels, int out_width)
+{
+    int x = 0;
+    if (channels == 1)
+    {
+        for (; x + 16 <= out_width; x += 16)
+        {
+            uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x)), vpaddlq_u8(vld1q_u8(row1 + 2 * x)));
+            uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x + 16)), vpaddlq_u8(vld1q_u8(row1 + 2 * x + 16)));
+            vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+    }
+    else
+    {
+        for (; x + 8 <= out_width; x += 8)
+        {
+            uint8x16x2_t a = vld2q_u8(row0 + 4 * x);
+            uint8x16x2_t b = vld2q_u8(row1 + 4 * x);
+            uint8x8x2_t out;
+            out.val[0] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[0]), vpaddlq_u8(b.val[0])), 2);
+            out.val[1] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[1]), vpaddlq_u8(b.val[1])), 2);
+            vst2_u8(dst + 2 * x, out);
+        }
+    }
+    return x;
+}
+#endif
+
+#if defined(COLOR_KERNELS_NEON) && defined(__aarch64__)
+/* A 256-entry table lives in 16 registers; tbl covers the first 64 entries and zeroes the
+ * rest, then each tbx fills in the next 64 and leaves lanes outside its range alone. */
+typedef struct
+{
+    uint8x16x4_t part[4];
+} neon_lut_t;
+
+static inline neon_lut_t loadLutNeon(const uint8_t *lut)
+{
+    neon_lut_t table;
+    for (int part = 0; part < 4; part++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            table.part[part].val[i] = vld1q_u8(lut + 64 * part + 16 * i);
+        }
+    }
+    return table;
+}
+
+static inline uint8x16_t lookupNeon(const neon_lut_t &table, uint8x16_t index)
+{
+    const uint8x16_t step = vdupq_n_u8(64);
+    uint8x16_t out = vqtbl4q_u8(table.part[0], index);
+    index = vsubq_u8(index, step);
+    out = vqtbx4q_u8(out, table.part[1], index);
+    index = vsubq_u8(index, step);
+    out = vqtbx4q_u8(out, table.part[2], index);
+    index = vsubq_u8(index, step);
+    return vqtbx4q_u8(out, table.part[3], index);
+}
+
+static int lutRowSimd(const uint8_t *src, uint8_t *dst, const uint8_t *lut, int width)
+{
+    neon_lut_t table = loadLutNeon(lut);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        vst1q_u8(dst + x, lookupNeon(table, vld1q_u8(src + x)));
+    }
+    return x;
+}
+
+static int lutPairRowSimd(const uint8_t *src, uint8_t *dst, const uint8_t *lut_u, const uint8_t *lut_v, int width)
+{
+    neon_lut_t table_u = loadLutNeon(lut_u);
+    neon_lut_t table_v = loadLutNeon(lut_v);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x2_t uv = vld2q_u8(src + 2 * x);
+        uv.val[0] = lookupNeon(table_u, uv.val[0]);
+        uv.val[1] = lookupNeon(table_v, uv.val[1]);
+        vst2q_u8(dst + 2 * x, uv);
+    }
+    return x;
+}
+#else
+/* Without AArch64's four-register tbl, a 256-entry table takes 16 pshufb rounds per register
+ * on x86, which is no faster than plain loads */
+static int lutRowSimd(const uint8_t *, uint8_t *, const uint8_t *, int)
+{
+    return 0;
+}
+
+static int lutPairRowSimd(const uint8_t *, uint8_t *, const uint8_t *, const uint8_t *, int)
+{
+    return 0;
+}
+#endif
+
+/* ---- SSSE3 (x86) ---- */
+
+#if defined(COLOR_KERNELS_SSSE3)
+/* pshufb masks that move bytes between three planar registers and 48 bytes of packed BGR */
+typedef struct
+{
+    __m128i interleave[3][3];   // [output block][channel]
+    __m128i deinterleave[3][3]; // [channel][input block]
+} shuffle_masks_t;
+
+static shuffle_masks_t buildShuffleMasks()
+{
+    shuffle_masks_t masks;
+    for (int block = 0; block < 3; block++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            alignas(16) uint8_t to_packed[16];
+            for (int i = 0; i < 16; i++)
+            {
+                int k = 16 * block + i; // Byte in the packed data
+                to_packed[i] = (k % 3 == channel) ? (uint8_t)(k / 3) : 0x80;
+            }
+            masks.interleave[block][channel] = _mm_load_si128((const __m128i *)to_packed);
+        }
+    }
+    for (int channel = 0; channel < 3; channel++)
+    {
+        for (int block = 0; block < 3; block++)
+        {
+            alignas(16) uint8_t to_planar[16];
+            for (int i = 0; i < 16; i++)
+            {
+                int p = 3 * i + channel; // Packed byte of pixel i
+                to_planar[i] = (p / 16 == block) ? (uint8_t)(p % 16) : 0x80;
+            }
+            masks.deinterleave[channel][block] = _mm_load_si128((const __m128i *)to_planar);
+        }
+    }
+    return masks;
+}
+
+static const shuffle_masks_t &shuffleMasks()
+{
+    static const shuffle_masks_t masks = buildShuffleMasks();
+    return masks;
+}
+
+static bool ssse3Supported()
+{
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+SSSE3_FN static inline void storeBgr(uint8_t *dst, __m128i b, __m128i g, __m128i r, const shuffle_masks_t &m)
+{
+    for (int block = 0; block < 3; block++)
+    {
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, m.interleave[block][0]),
+                                                _mm_shuffle_epi8(g, m.interleave[block][1])),
+                                   _mm_shuffle_epi8(r, m.interleave[block][2]));
+        _mm_storeu_si128((__m128i *)(dst + 16 * block), out);
+    }
+}
+
+SSSE3_FN static inline void loadBgr(const uint8_t *src, __m128i *b, __m128i *g, __m128i *r, const shuffle_masks_t &m)
+{
+    __m128i in[3];
+    for (int block = 0; block < 3; block++)
+    {
+        in[block] = _mm_loadu_si128((const __m128i *)(src + 16 * block));
+    }
+    __m128i *out[3] = {b, g, r};
+    for (int channel = 0; channel < 3; channel++)
+    {
+        *out[channel] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], m.deinterleave[channel][0]),
+                                                  _mm_shuffle_epi8(in[1], m.deinterleave[channel][1])),
+                                     _mm_shuffle_epi8(in[2], m.deinterleave[channel][2]));
+    }
+}
+
+SSSE3_FN static int yuvRowToBgrSsse3(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                                     uint8_t *bgr, int width)
+{
+    const shuffle_masks_t &masks = shuffleMasks();
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c_offset = _mm_set1_epi16(128);
+    const __m128i y_offset = _mm_set1_epi16(YUV_ROUND - 16 * YUV_Y);
+    const __m128i even = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i odd = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i u8;
+        __m128i v8;
+        if (uv_step == 2)
+        {
+            __m128i uv = _mm_loadu_si128((const __m128i *)(u + x));
+            u8 = _mm_shuffle_epi8(uv, even);
+            v8 = _mm_shuffle_epi8(uv, odd);
+        }
+        else
+        {
+            u8 = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+            v8 = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+        }
+
+        __m128i cu = _mm_sub_epi16(_mm_unpacklo_epi8(u8, zero), c_offset);
+        __m128i cv = _mm_sub_epi16(_mm_unpacklo_epi8(v8, zero), c_offset);
+        __m128i r_uv = _mm_mullo_epi16(cv, _mm_set1_epi16(YUV_VR));
+        __m128i g_uv = _mm_add_epi16(_mm_mullo_epi16(cv, _mm_set1_epi16(YUV_VG)),
+                                     _mm_mullo_epi16(cu, _mm_set1_epi16(YUV_UG)));
+        __m128i b_uv = _mm_mullo_epi16(cu, _mm_set1_epi16(YUV_UB));
+
+        __m128i y_lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(yv, zero), _mm_set1_epi16(YUV_Y)), y_offset);
+        __m128i y_hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(yv, zero), _mm_set1_epi16(YUV_Y)), y_offset);
+
+        // Each chroma sample covers two neighbouring pixels
+        __m128i b = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(y_lo, _mm_unpacklo_epi16(b_uv, b_uv)), 6),
+                                     _mm_srai_epi16(_mm_adds_epi16(y_hi, _mm_unpackhi_epi16(b_uv, b_uv)), 6));
+        __m128i g = _mm_packus_epi16(_mm_srai_epi16(_mm_subs_epi16(y_lo, _mm_unpacklo_epi16(g_uv, g_uv)), 6),
+                                     _mm_srai_epi16(_mm_subs_epi16(y_hi, _mm_unpackhi_epi16(g_uv, g_uv)), 6));
+        __m128i r = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(y_lo, _mm_unpacklo_epi16(r_uv, r_uv)), 6),
+                                     _mm_srai_epi16(_mm_adds_epi16(y_hi, _mm_unpackhi_epi16(r_uv, r_uv)), 6));
+        storeBgr(bgr + 3 * x, b, g, r, masks);
+    }
+    return x;
+}
+
+SSSE3_FN static inline __m128i lumaSsse3(__m128i b, __m128i g, __m128i r)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(RGB_ROUND);
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), _mm_set1_epi16(RGB_YR)),
+                                             _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), _mm_set1_epi16(RGB_YG))),
+                               _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), _mm_set1_epi16(RGB_YB)), round));
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), _mm_set1_epi16(RGB_YR)),
+                                             _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), _mm_set1_epi16(RGB_YG))),
+                               _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), _mm_set1_epi16(RGB_YB)), round));
+    __m128i luma = _mm_packus_epi16(_mm_srli_epi16(lo, 7), _mm_srli_epi16(hi, 7));
+    return _mm_add_epi8(luma, _mm_set1_epi8(16));
+}
+
+/* Average of each 2x2 block of one channel, 16 pixels wide */
+SSSE3_FN static inline __m128i blockAverageSsse3(__m128i row0, __m128i row1)
+{
+    const __m128i ones = _mm_set1_epi8(1);
+    __m128i sum = _mm_add_epi16(_mm_maddubs_epi16(row0, ones), _mm_maddubs_epi16(row1, ones));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+SSSE3_FN static int bgrRowsToYuvSsse3(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1,
+                                      uint8_t *u, uint8_t *v, int uv_step, int width)
+{
+    const shuffle_masks_t &masks = shuffleMasks();
+    const __m128i round = _mm_set1_epi16(RGB_ROUND);
+    const __m128i c_offset = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i b0, g0, r0, b1, g1, r1;
+        loadBgr(bgr0 + 3 * x, &b0, &g0, &r0, masks);
+        loadBgr(bgr1 + 3 * x, &b1, &g1, &r1, masks);
+        _mm_storeu_si128((__m128i *)(y0 + x), lumaSsse3(b0, g0, r0));
+        _mm_storeu_si128((__m128i *)(y1 + x), lumaSsse3(b1, g1, r1));
+
+        __m128i b = blockAverageSsse3(b0, b1);
+        __m128i g = blockAverageSsse3(g0, g1);
+        __m128i r = blockAverageSsse3(r0, r1);
+        __m128i cu = _mm_sub_epi16(_mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(RGB_UB)),
+                                                 _mm_mullo_epi16(r, _mm_set1_epi16(RGB_UR))),
+                                   _mm_mullo_epi16(g, _mm_set1_epi16(RGB_UG)));
+        __m128i cv = _mm_sub_epi16(_mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(RGB_VR)),
+                                                 _mm_mullo_epi16(g, _mm_set1_epi16(RGB_VG))),
+                                   _mm_mullo_epi16(b, _mm_set1_epi16(RGB_VB)));
+        cu = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(cu, round), 7), c_offset);
+        cv = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(cv, round), 7), c_offset);
+        __m128i u8 = _mm_packus_epi16(cu, cu);
+        __m128i v8 = _mm_packus_epi16(cv, cv);
+        if (uv_step == 2)
+        {
+            _mm_storeu_si128((__m128i *)(u + x), _mm_unpacklo_epi8(u8, v8));
+        }
+        else
+        {
+            _mm_storel_epi64((__m128i *)(u + x / 2), u8);
+            _mm_storel_epi64((__m128i *)(v + x / 2), v8);
+        }
+    }
+    return x;
+}
+
+SSSE3_FN static int downscaleRowSsse3(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int channels, int out_width)
+{
+    // Interleaved chroma is regrouped so that each byte pair holds the same channel of
+    // two neighbouring pixels: U0 U1 V0 V1 U2 U3 V2 V3 ...
+    const __m128i pairs = (channels == 1) ? _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+                                          : _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+    int step = 16 / channels; // Output pixels per 32 input bytes
+    int x = 0;
+    for (; x + step <= out_width; x += step)
+    {
+        int i = 2 * x * channels;
+        __m128i lo = blockAverageSsse3(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row0 + i)), pairs),
+                                       _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row1 + i)), pairs));
+        __m128i hi = blockAverageSsse3(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row0 + i + 16)), pairs),
+                                       _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row1 + i + 16)), pairs));
+        _mm_storeu_si128((__m128i *)(dst + x * channels), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+static int yuvRowToBgrSimd(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step,
+                           uint8_t *bgr, int width)
+{
+    return ssse3Supported() ? yuvRowToBgrSsse3(y, u, v, uv_step, bgr, width) : 0;
+}
+
+static int bgrRowsToYuvSimd(const uint8_t *bgr0, const uint8_t *bgr1, uint8_t *y0, uint8_t *y1,
+                            uint8_t *u, uint8_t *v, int uv_step, int width)
+{
+    return ssse3Supported() ? bgrRowsToYuvSsse3(bgr0, bgr1, y0, y1, u, v, uv_step, width) : 0;
+}
+
+static int downscaleRowSimd(const uint8_t *row0, const uint8_t *row1, uint8_t *dst, int channels, int out_width)
+{
+    return ssse3Supported() ? downscaleRowSsse3(row0, row1, dst, channels, out_width) : 0;
+}
+#endif
+
+#if !defined(COLOR_KERNELS_NEON) && !defined(COLOR_KERNELS_SSSE3)
+static int yuvRowToBgrSimd(const uint8_t *, const uint8_t *, const uint8_t *, int, uint8_t *, int)
+{
+    return 0;
+}
+
+static int bgrRowsToYuvSimd(const uint8_t *, const uint8_t *, uint8_t *, uint8_t *, uint8_t *, uint8_t *, int, int)
+{
+    return 0;
+}
+
+static int downscaleRowSimd(const uint8_t *, const uint8_t *, uint8_t *, int, int)
+{
+    return 0;
+}
+#endif
+
+/* ---- Frame level ---- */
+
+const char *colorKernelIsa()
+{
+#if defined(COLOR_KERNELS_NEON)
+    return "NEON";
+#elif defined(COLOR_KERNELS_SSSE3)
+    return ssse3Supported() ? "SSSE3" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+/* Chroma row pointers for a luma row. NV12 interleaves U and V with a step of 2. */
+static void chromaRow(const fish_frame_t *frame, int row, uint8_t **u, uint8_t **v, int *uv_step)
+{
+    if (frame->format == GST_VIDEO_FORMAT_NV12)
+    {
+        *u = (uint8_t *)frame->uv.ptr(row / 2);
+        *v = *u + 1;
+        *uv_step = 2;
+    }
+    else
+    {
+        *u = (uint8_t *)frame->uv.ptr(row / 2);
+        *v = (uint8_t *)frame->v.ptr(row / 2);
+        *uv_step = 1;
+    }
+}
+
+void frameToBgr(const fish_frame_t *frame, cv::Mat &bgr)
+{
+    bgr.create(frame->height, frame->width, CV_8UC3);
+    for (int row = 0; row < frame->height; row++)
+    {
+        uint8_t *u;
+        uint8_t *v;
+        int uv_step;
+        chromaRow(frame, row, &u, &v, &uv_step);
+        const uint8_t *y = frame->y.ptr(row);
+        uint8_t *out = bgr.ptr(row);
+
+        int x = yuvRowToBgrSimd(y, u, v, uv_step, out, frame->width);
+        yuvRowToBgrScalar(y, u, v, uv_step, out, x, frame->width);
+    }
+}
+
+fish_error_t bgrToFrame(const cv::Mat &bgr, fish_frame_t *frame)
+{
+    if (bgr.type() != CV_8UC3 || bgr.cols != frame->width || bgr.rows != frame->height ||
+        (frame->width & 1) || (frame->height & 1))
+    {
+        return FISH_EINVAL;
+    }
+
+    for (int row = 0; row < frame->height; row += 2)
+    {
+        uint8_t *u;
+        uint8_t *v;
+        int uv_step;
+        chromaRow(frame, row, &u, &v, &uv_step);
+        const uint8_t *bgr0 = bgr.ptr(row);
+        const uint8_t *bgr1 = bgr.ptr(row + 1);
+        uint8_t *y0 = frame->y.ptr(row);
+        uint8_t *y1 = frame->y.ptr(row + 1);
+
+        int x = bgrRowsToYuvSimd(bgr0, bgr1, y0, y1, u, v, uv_step, frame->width);
+        bgrRowsToYuvScalar(bgr0, bgr1, y0, y1, u, v, uv_step, x, frame->width);
+    }
+    return FISH_EOK;
+}
+
+static void downscalePlane(const cv::Mat &in, cv::Mat &out, int channels)
+{
+    out.create(in.rows / 2, in.cols / 2, channels == 1 ? CV_8UC1 : CV_8UC2);
+    for (int row = 0; row < out.rows; row++)
+    {
+        const uint8_t *row0 = in.ptr(2 * row);
+        const uint8_t *row1 = in.ptr(2 * row + 1);
+        uint8_t *dst = out.ptr(row);
+
+        int x = downscaleRowSimd(row0, row1, dst, channels, out.cols);
+        downscaleRowScalar(row0, row1, dst, channels, x, out.cols);
+    }
+}
+
+static void lutPlane(const cv::Mat &in, cv::Mat &out, const uint8_t *lut)
+{
+    for (int row = 0; row < in.rows; row++)
+    {
+        int x = lutRowSimd(in.ptr(row), out.ptr(row), lut, in.cols);
+        lutRowScalar(in.ptr(row), out.ptr(row), lut, x, in.cols);
+    }
+}
+
+void initPlaneLuts(fish_plane_luts_t *luts)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        luts->y[i] = (uint8_t)i;
+        luts->u[i] = (uint8_t)i;
+        luts->v[i] = (uint8_t)i;
+    }
+}
+
+void applyFrameLuts(const fish_frame_t *in, fish_frame_t *out, const fish_plane_luts_t *luts)
+{
+    lutPlane(in->y, out->y, luts->y);
+    if (in->format == GST_VIDEO_FORMAT_NV12)
+    {
+        for (int row = 0; row < in->uv.rows; row++)
+        {
+            const uint8_t *src = in->uv.ptr(row);
+            uint8_t *dst = out->uv.ptr(row);
+            int x = lutPairRowSimd(src, dst, luts->u, luts->v, in->uv.cols);
+            lutPairRowScalar(src, dst, luts->u, luts->v, x, in->uv.cols);
+        }
+    }
+    else
+    {
+        lutPlane(in->uv, out->uv, luts->u);
+        lutPlane(in->v, out->v, luts->v);
+    }
+}
+
+void downscaleFrame2x(const fish_frame_t *in, fish_frame_t *out)
+{
+    out->width = in->width / 2;
+    out->height = in->height / 2;
+    out->format = in->format;
+    out->pts = in->pts;
+
+    downscalePlane(in->y, out->y, 1);
+    if (in->format == GST_VIDEO_FORMAT_NV12)
+    {
+        downscalePlane(in->uv, out->uv, 2);
+        out->v = cv::Mat();
+    }
+    else
+    {
+        downscalePlane(in->uv, out->uv, 1);
+        downscalePlane(in->v, out->v, 1);
+    }
+}
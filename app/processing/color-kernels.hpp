@@ -0,0 +1,52 @@
+#ifndef __COLOR_KERNELS_HPP__
+#define __COLOR_KERNELS_HPP__
+
+#include <opencv2/core.hpp>
+
+#include "frame-pipe.hpp"
+
+/* Hand-vectorized conversions between the NV12/I420 frames of the processed path and the
+ * packed BGR that OpenCV algorithms expect. They use NEON on the Jetson, SSSE3 on x86
+ * (any AVX2 machine has it) and plain C elsewhere, and every path gives bit-identical
+ * results. Colour is BT.601 limited range, the same as cv::cvtColor's YUV conversions. */
+
+/* Description: Returns the instruction set the kernels were built for: "NEON", "SSSE3" or
+ *              "scalar".
+ */
+const char *colorKernelIsa();
+
+/* Description: Converts an NV12 or I420 frame to packed BGR. bgr is (re)allocated to the
+ *              frame size, so passing the same Mat every frame allocates only once.
+ */
+void frameToBgr(const fish_frame_t *frame, cv::Mat &bgr);
+
+/* Description: Writes a CV_8UC3 BGR image into an NV12 or I420 frame of the same size.
+ *              Chroma is taken from the average of each 2x2 block. Returns FISH_EINVAL if
+ *              the sizes differ or are odd.
+ */
+fish_error_t bgrToFrame(const cv::Mat &bgr, fish_frame_t *frame);
+
+/* Description: Halves an NV12 or I420 frame in both directions with a 2x2 box filter, e.g.
+ *              to decimate frames for analysis. out's planes are (re)allocated and owned by
+ *              out; pts and format are copied from in.
+ */
+void downscaleFrame2x(const fish_frame_t *in, fish_frame_t *out);
+
+/* One lookup table per plane, indexed by the input sample */
+typedef struct
+{
+    uint8_t y[256];
+    uint8_t u[256];
+    uint8_t v[256];
+} fish_plane_luts_t;
+
+/* Description: Fills luts with tables that leave every sample unchanged. */
+void initPlaneLuts(fish_plane_luts_t *luts);
+
+/* Description: Maps every sample of in through the table for its plane and writes the
+ *              result to out, which must have the same size and format. Uses four-register
+ *              table lookups on AArch64; other targets do the lookups in plain C.
+ */
+void applyFrameLuts(const fish_frame_t *in, fish_frame_t *out, const fish_plane_luts_t *luts);
+
+#endif /* __COLOR_KERNELS_HPP__ */
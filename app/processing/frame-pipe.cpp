@@ -0,0 +1,299 @@
+#include "frame-pipe.hpp"
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <sys/resource.h>
+#include <stdio.h>
+
+#define FRAME_PIPE_POOL_MIN 4
+#define FRAME_PIPE_POOL_MAX 8
+#define FRAME_PIPE_REPORT_US (5 * G_USEC_PER_SEC)
+
+static gint64 processCpuTimeUs()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void wrapVideoFrame(GstVideoFrame *vframe, GstClockTime pts, fish_frame_t *frame)
+{
+    frame->width = GST_VIDEO_FRAME_WIDTH(vframe);
+    frame->height = GST_VIDEO_FRAME_HEIGHT(vframe);
+    frame->format = GST_VIDEO_FRAME_FORMAT(vframe);
+    frame->pts = pts;
+
+    frame->y = cv::Mat(GST_VIDEO_FRAME_COMP_HEIGHT(vframe, 0), GST_VIDEO_FRAME_COMP_WIDTH(vframe, 0),
+                       CV_8UC1, GST_VIDEO_FRAME_PLANE_DATA(vframe, 0),
+                       GST_VIDEO_FRAME_PLANE_STRIDE(vframe, 0));
+
+    if (frame->format == GST_VIDEO_FORMAT_NV12)
+    {
+        frame->uv = cv::Mat(GST_VIDEO_FRAME_COMP_HEIGHT(vframe, 1), GST_VIDEO_FRAME_COMP_WIDTH(vframe, 1),
+                            CV_8UC2, GST_VIDEO_FRAME_PLANE_DATA(vframe, 1),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(vframe, 1));
+        frame->v = cv::Mat();
+    }
+    else
+    {
+        frame->uv = cv::Mat(GST_VIDEO_FRAME_COMP_HEIGHT(vframe, 1), GST_VIDEO_FRAME_COMP_WIDTH(vframe, 1),
+                            CV_8UC1, GST_VIDEO_FRAME_PLANE_DATA(vframe, 1),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(vframe, 1));
+        frame->v = cv::Mat(GST_VIDEO_FRAME_COMP_HEIGHT(vframe, 2), GST_VIDEO_FRAME_COMP_WIDTH(vframe, 2),
+                           CV_8UC1, GST_VIDEO_FRAME_PLANE_DATA(vframe, 2),
+                           GST_VIDEO_FRAME_PLANE_STRIDE(vframe, 2));
+    }
+}
+
+/* (Re)creates the output pool and appsrc caps whenever the appsink caps change */
+static fish_error_t configureForCaps(fish_frame_pipe_t *frame_pipe, GstCaps *caps)
+{
+    if (frame_pipe->caps != NULL && gst_caps_is_equal(frame_pipe->caps, caps))
+    {
+        return FISH_EOK;
+    }
+
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps))
+    {
+        printf("Frame pipe received non-video caps\n");
+        return FISH_EINVAL;
+    }
+    if (GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_FORMAT_NV12 &&
+        GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_FORMAT_I420)
+    {
+        printf("Frame pipe only supports NV12 and I420\n");
+        return FISH_EINVAL;
+    }
+
+    if (frame_pipe->pool != NULL)
+    {
+        gst_buffer_pool_set_active(frame_pipe->pool, FALSE);
+        gst_object_unref(frame_pipe->pool);
+    }
+
+    frame_pipe->pool = gst_video_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(frame_pipe->pool);
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&info),
+                                      FRAME_PIPE_POOL_MIN, FRAME_PIPE_POOL_MAX);
+    if (!gst_buffer_pool_set_config(frame_pipe->pool, config) ||
+        !gst_buffer_pool_set_active(frame_pipe->pool, TRUE))
+    {
+        printf("Failed to activate frame pipe buffer pool\n");
+        gst_object_unref(frame_pipe->pool);
+        frame_pipe->pool = NULL;
+        return FISH_EIO;
+    }
+
+    gst_caps_replace(&frame_pipe->caps, caps);
+    frame_pipe->info = info;
+    g_object_set(frame_pipe->appsrc, "caps", caps, NULL);
+
+    printf(">> Frame pipe negotiated %s %dx%d\n", gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&info)),
+           GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info));
+    return FISH_EOK;
+}
+
+/* Takes a buffer from the pool, only allocating if every pooled buffer is still in flight */
+static GstBuffer *acquireOutputBuffer(fish_frame_pipe_t *frame_pipe, GstBufferPool *pool, const GstVideoInfo *info)
+{
+    GstBuffer *buffer = NULL;
+    GstBufferPoolAcquireParams params = {};
+    params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+    if (gst_buffer_pool_acquire_buffer(pool, &buffer, &params) != GST_FLOW_OK)
+    {
+        buffer = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(info), NULL);
+
+        std::lock_guard<std::mutex> lock(frame_pipe->stats_mtx);
+        frame_pipe->stats.allocations++;
+    }
+    return buffer;
+}
+
+GstBuffer *processFrameBuffer(fish_frame_pipe_t *frame_pipe, GstBufferPool *pool, const GstVideoInfo *info,
+                              GstBuffer *in_buf, fish_frame_fn_t process, void *user_data)
+{
+    GstVideoFrame in_vframe;
+    GstVideoFrame out_vframe;
+    fish_frame_t in_frame;
+    fish_frame_t out_frame;
+
+    GstBuffer *out_buf = acquireOutputBuffer(frame_pipe, pool, info);
+    if (out_buf == NULL)
+    {
+        return NULL;
+    }
+
+    if (!gst_video_frame_map(&in_vframe, info, in_buf, GST_MAP_READ))
+    {
+        gst_buffer_unref(out_buf);
+        return NULL;
+    }
+    if (!gst_video_frame_map(&out_vframe, info, out_buf, GST_MAP_WRITE))
+    {
+        gst_video_frame_unmap(&in_vframe);
+        gst_buffer_unref(out_buf);
+        return NULL;
+    }
+
+    wrapVideoFrame(&in_vframe, GST_BUFFER_PTS(in_buf), &in_frame);
+    wrapVideoFrame(&out_vframe, GST_BUFFER_PTS(in_buf), &out_frame);
+    fish_error_t err = process(&in_frame, &out_frame, user_data);
+
+    gst_video_frame_unmap(&out_vframe);
+    gst_video_frame_unmap(&in_vframe);
+
+    if (err != FISH_EOK)
+    {
+        gst_buffer_unref(out_buf);
+        return NULL;
+    }
+
+    gst_buffer_copy_into(out_buf, in_buf, (GstBufferCopyFlags)(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS), 0, -1);
+
+    std::lock_guard<std::mutex> lock(frame_pipe->stats_mtx);
+    frame_pipe->stats.copies++;
+    return out_buf;
+}
+
+static void updateStats(fish_frame_pipe_t *frame_pipe, bool passthrough)
+{
+    std::lock_guard<std::mutex> lock(frame_pipe->stats_mtx);
+    fish_frame_pipe_stats_t *stats = &frame_pipe->stats;
+
+    stats->frames++;
+    if (passthrough)
+    {
+        stats->passthrough++;
+    }
+
+    gint64 now_us = g_get_monotonic_time();
+    gint64 wall_us = now_us - frame_pipe->report_wall_us;
+    if (wall_us < FRAME_PIPE_REPORT_US)
+    {
+        return;
+    }
+
+    gint64 cpu_now_us = processCpuTimeUs();
+    uint64_t frames = stats->frames - frame_pipe->report_frames;
+    stats->cpu_percent = 100.0 * (cpu_now_us - frame_pipe->report_cpu_us) / wall_us;
+
+    printf(">> Frame pipe: %.1f fps, cpu %.1f%%, copies %llu, allocations %llu, passthrough %llu\n",
+           frames * (double)G_USEC_PER_SEC / wall_us, stats->cpu_percent,
+           (unsigned long long)stats->copies, (unsigned long long)stats->allocations,
+           (unsigned long long)stats->passthrough);
+
+    frame_pipe->report_wall_us = now_us;
+    frame_pipe->report_cpu_us = cpu_now_us;
+    frame_pipe->report_frames = stats->frames;
+}
+
+static GstFlowReturn onNewSample(GstAppSink *appsink, gpointer user_data)
+{
+    fish_frame_pipe_t *frame_pipe = (fish_frame_pipe_t *)user_data;
+
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (sample == NULL)
+    {
+        return GST_FLOW_EOS;
+    }
+
+    if (configureForCaps(frame_pipe, gst_sample_get_caps(sample)) != FISH_EOK)
+    {
+        gst_sample_unref(sample);
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    GstBuffer *in_buf = gst_sample_get_buffer(sample);
+    GstBuffer *out_buf = NULL;
+    if (frame_pipe->hook != NULL)
+    {
+        out_buf = frame_pipe->hook(frame_pipe, in_buf, frame_pipe->user_data);
+    }
+
+    bool passthrough = (out_buf == NULL);
+    if (passthrough)
+    {
+        // Hand the captured buffer straight to appsrc, no pixels are touched
+        out_buf = gst_buffer_ref(in_buf);
+    }
+    gst_sample_unref(sample);
+
+    updateStats(frame_pipe, passthrough);
+
+    // appsrc takes ownership of out_buf
+    return gst_app_src_push_buffer(GST_APP_SRC(frame_pipe->appsrc), out_buf);
+}
+
+static void onEos(GstAppSink *appsink, gpointer user_data)
+{
+    fish_frame_pipe_t *frame_pipe = (fish_frame_pipe_t *)user_data;
+    gst_app_src_end_of_stream(GST_APP_SRC(frame_pipe->appsrc));
+}
+
+fish_error_t setupFramePipe(fish_frame_pipe_t *frame_pipe, GstElement *pipeline,
+                            const char *sink_name, const char *src_name,
+                            fish_buffer_hook_t hook, void *user_data)
+{
+    frame_pipe->pool = NULL;
+    frame_pipe->caps = NULL;
+    frame_pipe->hook = hook;
+    frame_pipe->user_data = user_data;
+    frame_pipe->stats = fish_frame_pipe_stats_t();
+    frame_pipe->report_wall_us = g_get_monotonic_time();
+    frame_pipe->report_cpu_us = processCpuTimeUs();
+    frame_pipe->report_frames = 0;
+
+    frame_pipe->appsink = gst_bin_get_by_name(GST_BIN(pipeline), sink_name);
+    frame_pipe->appsrc = gst_bin_get_by_name(GST_BIN(pipeline), src_name);
+    if (frame_pipe->appsink == NULL || frame_pipe->appsrc == NULL)
+    {
+        printf("Pipeline is missing %s or %s\n", sink_name, src_name);
+        teardownFramePipe(frame_pipe);
+        return FISH_EINVAL;
+    }
+
+    // Timestamps are copied from the captured buffers, so appsrc must not add its own
+    g_object_set(frame_pipe->appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME,
+                 "do-timestamp", FALSE, NULL);
+
+    GstAppSinkCallbacks callbacks = {};
+    callbacks.eos = onEos;
+    callbacks.new_sample = onNewSample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(frame_pipe->appsink), &callbacks, frame_pipe, NULL);
+
+    return FISH_EOK;
+}
+
+void teardownFramePipe(fish_frame_pipe_t *frame_pipe)
+{
+    if (frame_pipe->pool != NULL)
+    {
+        gst_buffer_pool_set_active(frame_pipe->pool, FALSE);
+        gst_object_unref(frame_pipe->pool);
+        frame_pipe->pool = NULL;
+    }
+    if (frame_pipe->caps != NULL)
+    {
+        gst_caps_unref(frame_pipe->caps);
+        frame_pipe->caps = NULL;
+    }
+    if (frame_pipe->appsink != NULL)
+    {
+        gst_object_unref(frame_pipe->appsink);
+        frame_pipe->appsink = NULL;
+    }
+    if (frame_pipe->appsrc != NULL)
+    {
+        gst_object_unref(frame_pipe->appsrc);
+        frame_pipe->appsrc = NULL;
+    }
+}
+
+void getFramePipeStats(fish_frame_pipe_t *frame_pipe, fish_frame_pipe_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(frame_pipe->stats_mtx);
+    *stats = frame_pipe->stats;
+}
@@ -0,0 +1,91 @@
+#ifndef __FRAME_PIPE_HPP__
+#define __FRAME_PIPE_HPP__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/core.hpp>
+#include <mutex>
+
+#include "../common/fish_types.h"
+
+/* Non-owning view of a mapped NV12 or I420 frame. The planes point straight
+ * into GstBuffer memory, so they are only valid inside the processing call. */
+typedef struct
+{
+    int width;
+    int height;
+    GstVideoFormat format;
+    GstClockTime pts;
+    cv::Mat y;  // Luma plane (CV_8UC1)
+    cv::Mat uv; // NV12: interleaved chroma (CV_8UC2), I420: U plane (CV_8UC1)
+    cv::Mat v;  // I420 only: V plane (CV_8UC1), empty for NV12
+} fish_frame_t;
+
+/* Processes one mapped frame. Must write the whole output frame. Returning
+ * anything but FISH_EOK discards the output. */
+typedef fish_error_t (*fish_frame_fn_t)(const fish_frame_t *in, fish_frame_t *out, void *user_data);
+
+/* Copy and allocation counters for the appsink -> appsrc stage */
+typedef struct
+{
+    uint64_t frames;       // Frames pulled from appsink
+    uint64_t passthrough;  // Input buffers forwarded as-is (zero copy)
+    uint64_t copies;       // Frames written into an output buffer
+    uint64_t allocations;  // Output buffers allocated because the pool was empty
+    double cpu_percent;    // Process CPU usage over the last report interval
+} fish_frame_pipe_stats_t;
+
+typedef struct fish_frame_pipe fish_frame_pipe_t;
+
+/* Called once per frame on the appsink streaming thread. Returns a new reference
+ * to the buffer to push into appsrc, or NULL to forward in_buf unmodified. */
+typedef GstBuffer *(*fish_buffer_hook_t)(fish_frame_pipe_t *frame_pipe, GstBuffer *in_buf, void *user_data);
+
+struct fish_frame_pipe
+{
+    GstElement *appsink;
+    GstElement *appsrc;
+    GstBufferPool *pool; // Only replaced on the streaming thread when caps change
+    GstCaps *caps;
+    GstVideoInfo info;
+
+    fish_buffer_hook_t hook;
+    void *user_data;
+
+    std::mutex stats_mtx;
+    fish_frame_pipe_stats_t stats;
+    gint64 report_wall_us;
+    gint64 report_cpu_us;
+    uint64_t report_frames;
+};
+
+/* Description: Hooks the named appsink and appsrc of a parsed pipeline together and
+ *              hands every buffer to hook(). Output frames come from a preallocated pool
+ *              sized to the negotiated caps. Pass NULL for hook to forward buffers without
+ *              touching them.
+ */
+fish_error_t setupFramePipe(fish_frame_pipe_t *frame_pipe, GstElement *pipeline,
+                            const char *sink_name, const char *src_name,
+                            fish_buffer_hook_t hook, void *user_data);
+
+/* Description: Wraps the planes of a mapped NV12 or I420 video frame as fish_frame_t views,
+ *              without copying them. The views are valid until vframe is unmapped.
+ */
+void wrapVideoFrame(GstVideoFrame *vframe, GstClockTime pts, fish_frame_t *frame);
+
+/* Description: Maps in_buf and a buffer from pool, wraps both as fish_frame_t views and runs
+ *              process() on them. Safe to call from any thread as long as the caller holds a
+ *              reference to pool. Returns the written buffer, or NULL if process() failed.
+ */
+GstBuffer *processFrameBuffer(fish_frame_pipe_t *frame_pipe, GstBufferPool *pool, const GstVideoInfo *info,
+                              GstBuffer *in_buf, fish_frame_fn_t process, void *user_data);
+
+/* Description: Releases the elements and buffer pool held by the frame pipe. Call after
+ *              the pipeline has been set to GST_STATE_NULL.
+ */
+void teardownFramePipe(fish_frame_pipe_t *frame_pipe);
+
+/* Description: Copies out the current counters. Safe to call from any thread. */
+void getFramePipeStats(fish_frame_pipe_t *frame_pipe, fish_frame_pipe_stats_t *stats);
+
+#endif /* __FRAME_PIPE_HPP__ */
@@ -0,0 +1,304 @@
+#include "frame-processors.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+
+#define PROCESSOR_REPORT_US (5 * G_USEC_PER_SEC)
+
+typedef struct
+{
+    fish_processor_t desc;
+    fish_processor_stats_t stats;
+    uint64_t jobs;
+    uint64_t total_us;
+    bool busy;           // A job for this processor is queued or running
+    GstBuffer *last_out; // Last finished output, kept for FISH_OVERRUN_REUSE_LAST
+} processor_entry_t;
+
+/* One processor run on one frame. Shared between the streaming thread and a worker
+ * so that an abandoned job can finish without touching freed state. */
+typedef struct
+{
+    processor_entry_t *entry;
+    fish_frame_pipe_t *frame_pipe;
+    GstBufferPool *pool;
+    GstVideoInfo info;
+    GstBuffer *in_buf;
+    GstBuffer *out_buf;
+    bool done;
+    bool abandoned;
+} processor_job_t;
+
+static std::mutex processors_mtx;
+static std::condition_variable job_cv;
+static std::condition_variable done_cv;
+static std::deque<std::shared_ptr<processor_job_t>> job_queue;
+static std::vector<processor_entry_t *> processors;
+static std::vector<std::thread> workers;
+static bool workers_running = false;
+static gint64 report_us = 0;
+
+static void workerLoop()
+{
+    while (true)
+    {
+        std::shared_ptr<processor_job_t> job;
+        {
+            std::unique_lock<std::mutex> lock(processors_mtx);
+            job_cv.wait(lock, []
+                        { return !workers_running || !job_queue.empty(); });
+            if (!workers_running)
+            {
+                return;
+            }
+            job = job_queue.front();
+            job_queue.pop_front();
+        }
+
+        processor_entry_t *entry = job->entry;
+        gint64 start_us = g_get_monotonic_time();
+        GstBuffer *out_buf = processFrameBuffer(job->frame_pipe, job->pool, &job->info, job->in_buf,
+                                                entry->desc.process, entry->desc.user_data);
+        uint32_t elapsed_us = (uint32_t)(g_get_monotonic_time() - start_us);
+
+        gst_buffer_unref(job->in_buf);
+        job->in_buf = NULL;
+        gst_object_unref(job->pool);
+        job->pool = NULL;
+
+        std::lock_guard<std::mutex> lock(processors_mtx);
+        fish_processor_stats_t *stats = &entry->stats;
+        entry->busy = false;
+        entry->jobs++;
+        entry->total_us += elapsed_us;
+        stats->last_us = elapsed_us;
+        if (elapsed_us > stats->max_us)
+        {
+            stats->max_us = elapsed_us;
+        }
+
+        if (out_buf == NULL)
+        {
+            stats->failures++;
+        }
+        else
+        {
+            // Late results still become the frame to repeat on the next overrun
+            gst_buffer_replace(&entry->last_out, out_buf);
+        }
+
+        if (job->abandoned)
+        {
+            if (out_buf != NULL)
+            {
+                gst_buffer_unref(out_buf);
+            }
+        }
+        else
+        {
+            job->out_buf = out_buf;
+            job->done = true;
+            done_cv.notify_all();
+        }
+    }
+}
+
+/* Picks the buffer to push when a processor could not deliver in time. Must hold
+ * processors_mtx. Returns NULL to forward the input. */
+static GstBuffer *overrunResult(processor_entry_t *entry, GstBuffer *in_buf)
+{
+    if (entry->desc.overrun_policy != FISH_OVERRUN_REUSE_LAST || entry->last_out == NULL)
+    {
+        return NULL;
+    }
+
+    // Shallow copy shares the pixel memory, only the timestamps are new
+    GstBuffer *out_buf = gst_buffer_copy(entry->last_out);
+    gst_buffer_copy_into(out_buf, in_buf, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    return out_buf;
+}
+
+/* Runs one processor on in_buf, waiting at most its budget. Returns NULL to forward in_buf. */
+static GstBuffer *runProcessor(processor_entry_t *entry, fish_frame_pipe_t *frame_pipe, GstBuffer *in_buf)
+{
+    std::unique_lock<std::mutex> lock(processors_mtx);
+    entry->stats.frames++;
+
+    if (entry->busy)
+    {
+        entry->stats.busy++;
+        return overrunResult(entry, in_buf);
+    }
+
+    std::shared_ptr<processor_job_t> job = std::make_shared<processor_job_t>();
+    job->entry = entry;
+    job->frame_pipe = frame_pipe;
+    job->pool = (GstBufferPool *)gst_object_ref(frame_pipe->pool);
+    job->info = frame_pipe->info;
+    job->in_buf = gst_buffer_ref(in_buf);
+    job->out_buf = NULL;
+    job->done = false;
+    job->abandoned = false;
+
+    entry->busy = true;
+    job_queue.push_back(job);
+    job_cv.notify_one();
+
+    std::chrono::microseconds budget(entry->desc.budget_us);
+    if (!done_cv.wait_for(lock, budget, [&job]
+                          { return job->done; }))
+    {
+        job->abandoned = true;
+        entry->stats.overruns++;
+        return overrunResult(entry, in_buf);
+    }
+
+    if (job->out_buf != NULL)
+    {
+        entry->stats.in_budget++;
+    }
+    return job->out_buf;
+}
+
+static void reportStats()
+{
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - report_us < PROCESSOR_REPORT_US)
+    {
+        return;
+    }
+    report_us = now_us;
+
+    std::vector<fish_processor_stats_t> stats;
+    getFrameProcessorStats(stats);
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        printf(">> Processor %s: avg %.0fus, max %uus, budget %uus, overruns %llu, busy %llu\n",
+               stats[i].name, stats[i].avg_us, stats[i].max_us, stats[i].budget_us,
+               (unsigned long long)stats[i].overruns, (unsigned long long)stats[i].busy);
+    }
+}
+
+fish_error_t registerFrameProcessor(const fish_processor_t *processor)
+{
+    if (processor == NULL || processor->process == NULL || processor->budget_us == 0)
+    {
+        printf("Invalid frame processor\n");
+        return FISH_EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(processors_mtx);
+    if (workers_running)
+    {
+        printf("Cannot register %s while processors are running\n", processor->name);
+        return FISH_EPERM;
+    }
+
+    processor_entry_t *entry = new processor_entry_t();
+    entry->desc = *processor;
+    entry->stats.name = processor->name;
+    entry->stats.budget_us = processor->budget_us;
+    entry->last_out = NULL;
+    entry->busy = false;
+    processors.push_back(entry);
+
+    printf(">> Registered frame processor %s (budget %uus)\n", processor->name, processor->budget_us);
+    return FISH_EOK;
+}
+
+fish_error_t startFrameProcessors(unsigned int num_workers)
+{
+    std::lock_guard<std::mutex> lock(processors_mtx);
+    if (workers_running)
+    {
+        return FISH_EPERM;
+    }
+
+    if (num_workers == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        num_workers = (cores > 1) ? cores - 1 : 1;
+    }
+
+    workers_running = true;
+    for (unsigned int i = 0; i < num_workers; i++)
+    {
+        workers.push_back(std::thread(workerLoop));
+    }
+    report_us = g_get_monotonic_time();
+
+    return FISH_EOK;
+}
+
+void stopFrameProcessors()
+{
+    {
+        std::lock_guard<std::mutex> lock(processors_mtx);
+        workers_running = false;
+    }
+    job_cv.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    workers.clear();
+
+    // Nothing waits on these any more, so drop the buffers they hold
+    std::lock_guard<std::mutex> lock(processors_mtx);
+    for (size_t i = 0; i < job_queue.size(); i++)
+    {
+        gst_buffer_unref(job_queue[i]->in_buf);
+        gst_object_unref(job_queue[i]->pool);
+        job_queue[i]->entry->busy = false;
+    }
+    job_queue.clear();
+
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        gst_buffer_replace(&processors[i]->last_out, NULL);
+    }
+}
+
+GstBuffer *runFrameProcessors(fish_frame_pipe_t *frame_pipe, GstBuffer *in_buf, void *user_data)
+{
+    GstBuffer *frame = gst_buffer_ref(in_buf);
+
+    // The chain is fixed once workers are running, so it can be walked without the lock
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        GstBuffer *out_buf = runProcessor(processors[i], frame_pipe, frame);
+        if (out_buf != NULL)
+        {
+            gst_buffer_unref(frame);
+            frame = out_buf;
+        }
+    }
+
+    reportStats();
+
+    if (frame == in_buf)
+    {
+        gst_buffer_unref(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+void getFrameProcessorStats(std::vector<fish_processor_stats_t> &stats)
+{
+    std::lock_guard<std::mutex> lock(processors_mtx);
+    stats.clear();
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        fish_processor_stats_t entry_stats = processors[i]->stats;
+        uint64_t jobs = processors[i]->jobs;
+        entry_stats.avg_us = jobs ? (double)processors[i]->total_us / jobs : 0.0;
+        stats.push_back(entry_stats);
+    }
+}
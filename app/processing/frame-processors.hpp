@@ -0,0 +1,61 @@
+#ifndef __FRAME_PROCESSORS_HPP__
+#define __FRAME_PROCESSORS_HPP__
+
+#include <vector>
+
+#include "frame-pipe.hpp"
+
+/* What to push when a processor misses its latency budget */
+typedef enum
+{
+    FISH_OVERRUN_PASSTHROUGH, /* Forward the processor's input unmodified */
+    FISH_OVERRUN_REUSE_LAST   /* Repeat the processor's last finished output */
+} fish_overrun_policy_t;
+
+typedef struct
+{
+    const char *name; // Must outlive the processor, normally a string literal
+    fish_frame_fn_t process;
+    void *user_data;
+    uint32_t budget_us;
+    fish_overrun_policy_t overrun_policy;
+} fish_processor_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t budget_us;
+    uint64_t frames;    // Frames offered to the processor
+    uint64_t in_budget; // Results that made it onto the frame they were computed from
+    uint64_t overruns;  // Frames where the budget expired before the result was ready
+    uint64_t busy;      // Frames skipped because the previous job was still running
+    uint64_t failures;  // Jobs where process() returned an error
+    uint32_t last_us;
+    uint32_t max_us;
+    double avg_us;
+} fish_processor_stats_t;
+
+/* Description: Adds a processor to the end of the chain. Processors run in registration
+ *              order, each on the previous one's output. Must be called before
+ *              startFrameProcessors().
+ */
+fish_error_t registerFrameProcessor(const fish_processor_t *processor);
+
+/* Description: Spawns the worker threads that run processor jobs. Passing 0 uses one
+ *              worker per core, leaving one core for capture and encode.
+ */
+fish_error_t startFrameProcessors(unsigned int num_workers);
+
+/* Description: Joins the worker threads and drops any buffers still held by the chain. */
+void stopFrameProcessors();
+
+/* Description: fish_buffer_hook_t that runs the registered chain on the worker pool. The
+ *              streaming thread never waits longer than a processor's budget; late or busy
+ *              processors fall back to their overrun policy so encoding never stalls.
+ */
+GstBuffer *runFrameProcessors(fish_frame_pipe_t *frame_pipe, GstBuffer *in_buf, void *user_data);
+
+/* Description: Copies out timing counters for every registered processor. */
+void getFrameProcessorStats(std::vector<fish_processor_stats_t> &stats);
+
+#endif /* __FRAME_PROCESSORS_HPP__ */
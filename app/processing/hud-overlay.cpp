@@ -0,0 +1,423 @@
+#include "hud-overlay.hpp"
+#include "../streaming/bitrate-control.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+
+#define HUD_POLL_US (100 * 1000)        // Telemetry changes at control-channel rate, not frame rate
+#define HUD_LINK_POLL_US G_USEC_PER_SEC // Receiver reports arrive every few seconds at most
+#define HUD_REPORT_US (5 * G_USEC_PER_SEC)
+#define HUD_RTP_CLOCK_RATE 90000
+#define HUD_LINES_PER_SCALE 240 // One font pixel per this many frame lines, so 480p gets 2x
+
+// 5x7 font for ' ' to 'Z', one byte per column, bit 0 at the top
+#define HUD_FONT_FIRST ' '
+#define HUD_FONT_LAST 'Z'
+#define HUD_GLYPH_WIDTH 5
+#define HUD_GLYPH_HEIGHT 7
+#define HUD_ADVANCE 6     // Glyph plus one column of spacing
+#define HUD_LINE_HEIGHT 9 // Glyph plus two rows of spacing
+#define HUD_PADDING 2     // Panel around the text, in font pixels
+#define HUD_MARGIN 4      // Panel to frame edge, in font pixels
+
+// Panel halves luma and chroma saturation, glyphs are video white with no chroma
+#define HUD_PANEL_MUL 128
+#define HUD_PANEL_LUMA_ADD 8
+#define HUD_PANEL_CHROMA_ADD 64
+#define HUD_GLYPH_LUMA 235
+#define HUD_GLYPH_CHROMA 128
+
+static const uint8_t hud_font[HUD_FONT_LAST - HUD_FONT_FIRST + 1][HUD_GLYPH_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x00, 0x00, 0x5F, 0x00, 0x00}, // !
+    {0x00, 0x07, 0x00, 0x07, 0x00}, // "
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, // #
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, // $
+    {0x23, 0x13, 0x08, 0x64, 0x62}, // %
+    {0x36, 0x49, 0x55, 0x22, 0x50}, // &
+    {0x00, 0x05, 0x03, 0x00, 0x00}, // '
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, // (
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, // )
+    {0x08, 0x2A, 0x1C, 0x2A, 0x08}, // *
+    {0x08, 0x08, 0x3E, 0x08, 0x08}, // +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, // ,
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // -
+    {0x00, 0x60, 0x60, 0x00, 0x00}, // .
+    {0x20, 0x10, 0x08, 0x04, 0x02}, // /
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, // 0
+    {0x00, 0x42, 0x7F, 0x40, 0x00}, // 1
+    {0x42, 0x61, 0x51, 0x49, 0x46}, // 2
+    {0x21, 0x41, 0x45, 0x4B, 0x31}, // 3
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, // 4
+    {0x27, 0x45, 0x45, 0x45, 0x39}, // 5
+    {0x3C, 0x4A, 0x49, 0x49, 0x30}, // 6
+    {0x01, 0x71, 0x09, 0x05, 0x03}, // 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, // 8
+    {0x06, 0x49, 0x49, 0x29, 0x1E}, // 9
+    {0x00, 0x36, 0x36, 0x00, 0x00}, // :
+    {0x00, 0x56, 0x36, 0x00, 0x00}, // ;
+    {0x00, 0x08, 0x14, 0x22, 0x41}, // <
+    {0x14, 0x14, 0x14, 0x14, 0x14}, // =
+    {0x41, 0x22, 0x14, 0x08, 0x00}, // >
+    {0x02, 0x01, 0x51, 0x09, 0x06}, // ?
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, // @
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, // A
+    {0x7F, 0x49, 0x49, 0x49, 0x36}, // B
+    {0x3E, 0x41, 0x41, 0x41, 0x22}, // C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, // D
+    {0x7F, 0x49, 0x49, 0x49, 0x41}, // E
+    {0x7F, 0x09, 0x09, 0x01, 0x01}, // F
+    {0x3E, 0x41, 0x41, 0x51, 0x32}, // G
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, // H
+    {0x00, 0x41, 0x7F, 0x41, 0x00}, // I
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, // J
+    {0x7F, 0x08, 0x14, 0x22, 0x41}, // K
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, // L
+    {0x7F, 0x02, 0x04, 0x02, 0x7F}, // M
+    {0x7F, 0x04, 0x08, 0x10, 0x7F}, // N
+    {0x3E, 0x41, 0x41, 0x41, 0x3E}, // O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, // P
+    {0x3E, 0x41, 0x51, 0x21, 0x5E}, // Q
+    {0x7F, 0x09, 0x19, 0x29, 0x46}, // R
+    {0x46, 0x49, 0x49, 0x49, 0x31}, // S
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, // T
+    {0x3F, 0x40, 0x40, 0x40, 0x3F}, // U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, // V
+    {0x7F, 0x20, 0x18, 0x20, 0x7F}, // W
+    {0x63, 0x14, 0x08, 0x14, 0x63}, // X
+    {0x03, 0x04, 0x78, 0x04, 0x03}, // Y
+    {0x61, 0x51, 0x49, 0x45, 0x43}, // Z
+};
+
+static bool glyphPixel(char c, int col, int row)
+{
+    c = (char)toupper((unsigned char)c);
+    if (c < HUD_FONT_FIRST || c > HUD_FONT_LAST)
+    {
+        c = '?';
+    }
+    return (hud_font[c - HUD_FONT_FIRST][col] >> row) & 1;
+}
+
+static bool isBlendable(const GstVideoInfo *info)
+{
+    switch (GST_VIDEO_INFO_FORMAT(info))
+    {
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_I420:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Applies one row of the blend table. Branch-free, so the compiler vectorises it. */
+static inline void blendRow(guint8 *dst, const uint8_t *mul, const uint8_t *add, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[i] = (guint8)(((dst[i] * mul[i]) >> 8) + add[i]);
+    }
+}
+
+/* Same for NV12 chroma, where U and V of a pixel share one table entry */
+static inline void blendRowInterleaved(guint8 *dst, const uint8_t *mul, const uint8_t *add, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        dst[2 * i] = (guint8)(((dst[2 * i] * mul[i]) >> 8) + add[i]);
+        dst[2 * i + 1] = (guint8)(((dst[2 * i + 1] * mul[i]) >> 8) + add[i]);
+    }
+}
+
+void initHud(fish_hud_t *hud)
+{
+    hud->text.clear();
+    hud->scale = 0;
+    hud->box_width = 0;
+    hud->box_height = 0;
+    hud->speed = 0;
+    hud->left_angle = 0;
+    hud->right_angle = 0;
+    hud->have_link = false;
+    hud->loss_pct = 0.0;
+    hud->rtt_ms = 0.0;
+    hud->jitter_ms = 0.0;
+    hud->poll_us = 0;
+    hud->link_poll_us = 0;
+    hud->frames = 0;
+    hud->renders = 0;
+    hud->total_us = 0;
+    hud->max_us = 0;
+    hud->report_us = g_get_monotonic_time();
+}
+
+bool setHudText(fish_hud_t *hud, const std::string &text, int frame_height)
+{
+    int scale = std::max(1, frame_height / HUD_LINES_PER_SCALE);
+    if (text == hud->text && scale == hud->scale)
+    {
+        return false;
+    }
+    hud->text = text;
+    hud->scale = scale;
+    hud->renders++;
+
+    std::vector<std::string> lines;
+    size_t start = 0;
+    size_t longest = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        lines.push_back(text.substr(start, end - start));
+        longest = std::max(longest, end - start);
+        start = end + 1;
+    }
+
+    // Even sizes and positions keep the box aligned with the 2x2 chroma grid
+    int pad = HUD_PADDING * scale;
+    int width = 2 * pad + std::max(0, (int)longest * HUD_ADVANCE - 1) * scale;
+    int height = 2 * pad + ((int)lines.size() * HUD_LINE_HEIGHT - 2) * scale;
+    hud->box_width = (width + 1) & ~1;
+    hud->box_height = (height + 1) & ~1;
+
+    hud->luma_mul.assign(hud->box_width * hud->box_height, HUD_PANEL_MUL);
+    hud->luma_add.assign(hud->box_width * hud->box_height, HUD_PANEL_LUMA_ADD);
+    for (size_t line = 0; line < lines.size(); line++)
+    {
+        for (size_t i = 0; i < lines[line].size(); i++)
+        {
+            for (int col = 0; col < HUD_GLYPH_WIDTH; col++)
+            {
+                for (int row = 0; row < HUD_GLYPH_HEIGHT; row++)
+                {
+                    if (!glyphPixel(lines[line][i], col, row))
+                    {
+                        continue;
+                    }
+
+                    int x = pad + ((int)i * HUD_ADVANCE + col) * scale;
+                    int y = pad + ((int)line * HUD_LINE_HEIGHT + row) * scale;
+                    for (int dy = 0; dy < scale; dy++)
+                    {
+                        int offset = (y + dy) * hud->box_width + x;
+                        std::fill(hud->luma_mul.begin() + offset, hud->luma_mul.begin() + offset + scale, 0);
+                        std::fill(hud->luma_add.begin() + offset, hud->luma_add.begin() + offset + scale, HUD_GLYPH_LUMA);
+                    }
+                }
+            }
+        }
+    }
+
+    // A chroma sample is neutral if any luma pixel it covers belongs to a glyph
+    int chroma_width = hud->box_width / 2;
+    int chroma_height = hud->box_height / 2;
+    hud->chroma_mul.assign(chroma_width * chroma_height, HUD_PANEL_MUL);
+    hud->chroma_add.assign(chroma_width * chroma_height, HUD_PANEL_CHROMA_ADD);
+    for (int y = 0; y < chroma_height; y++)
+    {
+        for (int x = 0; x < chroma_width; x++)
+        {
+            const uint8_t *top = &hud->luma_mul[(2 * y) * hud->box_width + 2 * x];
+            const uint8_t *bottom = top + hud->box_width;
+            if (top[0] == 0 || top[1] == 0 || bottom[0] == 0 || bottom[1] == 0)
+            {
+                hud->chroma_mul[y * chroma_width + x] = 0;
+                hud->chroma_add[y * chroma_width + x] = HUD_GLYPH_CHROMA;
+            }
+        }
+    }
+
+    return true;
+}
+
+void blendHud(fish_hud_t *hud, GstVideoFrame *frame)
+{
+    int margin = (HUD_MARGIN * hud->scale + 1) & ~1;
+    int x0 = margin;
+    int y0 = (GST_VIDEO_FRAME_HEIGHT(frame) - margin - hud->box_height) & ~1;
+    if (hud->box_width == 0 || y0 < 0 || x0 + hud->box_width > GST_VIDEO_FRAME_WIDTH(frame))
+    {
+        return;
+    }
+
+    guint8 *luma = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    int luma_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+    for (int y = 0; y < hud->box_height; y++)
+    {
+        blendRow(luma + (y0 + y) * luma_stride + x0, &hud->luma_mul[y * hud->box_width],
+                 &hud->luma_add[y * hud->box_width], hud->box_width);
+    }
+
+    int chroma_width = hud->box_width / 2;
+    int chroma_height = hud->box_height / 2;
+    if (GST_VIDEO_FRAME_FORMAT(frame) == GST_VIDEO_FORMAT_NV12)
+    {
+        guint8 *uv = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 1);
+        int uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 1);
+        for (int y = 0; y < chroma_height; y++)
+        {
+            blendRowInterleaved(uv + (y0 / 2 + y) * uv_stride + x0, &hud->chroma_mul[y * chroma_width],
+                                &hud->chroma_add[y * chroma_width], chroma_width);
+        }
+        return;
+    }
+
+    for (int plane = 1; plane <= 2; plane++)
+    {
+        guint8 *chroma = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, plane);
+        int chroma_stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane);
+        for (int y = 0; y < chroma_height; y++)
+        {
+            blendRow(chroma + (y0 / 2 + y) * chroma_stride + x0 / 2, &hud->chroma_mul[y * chroma_width],
+                     &hud->chroma_add[y * chroma_width], chroma_width);
+        }
+    }
+}
+
+/* Refreshes the telemetry at most every HUD_POLL_US and the link stats every HUD_LINK_POLL_US */
+static void pollHud(fish_hud_t *hud, gint64 now_us)
+{
+    if (now_us - hud->poll_us < HUD_POLL_US)
+    {
+        return;
+    }
+    hud->poll_us = now_us;
+
+    fish_handle_mtx.lock();
+    hud->speed = hud->handle->curr_speed;
+    hud->left_angle = hud->handle->curr_left_angle;
+    hud->right_angle = hud->handle->curr_right_angle;
+    fish_handle_mtx.unlock();
+
+    fish_rtcp_report_t report;
+    if (hud->rtpbin != NULL && now_us - hud->link_poll_us >= HUD_LINK_POLL_US)
+    {
+        hud->link_poll_us = now_us;
+        if (readReceiverReport(hud->rtpbin, FISH_VIDEO_SSRC, &report))
+        {
+            hud->have_link = true;
+            hud->loss_pct = 100.0 * report.fraction_lost / 256.0;
+            hud->rtt_ms = 1000.0 * report.round_trip / 65536.0;
+            hud->jitter_ms = 1000.0 * report.jitter / HUD_RTP_CLOCK_RATE;
+        }
+    }
+}
+
+static void reportHud(fish_hud_t *hud, gint64 now_us)
+{
+    if (now_us - hud->report_us < HUD_REPORT_US)
+    {
+        return;
+    }
+    hud->report_us = now_us;
+
+    printf(">> HUD: avg %.0fus, max %lldus per frame, %llu re-renders in %llu frames\n",
+           hud->frames ? (double)hud->total_us / hud->frames : 0.0, (long long)hud->max_us,
+           (unsigned long long)hud->renders, (unsigned long long)hud->frames);
+}
+
+static GstPadProbeReturn hudProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_hud_t *hud = (fish_hud_t *)user_data;
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (caps == NULL)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstVideoInfo video_info;
+    GstCapsFeatures *features = gst_caps_get_features(caps, 0);
+    bool blendable = gst_video_info_from_caps(&video_info, caps) && isBlendable(&video_info) &&
+                     (features == NULL || gst_caps_features_is_equal(features, GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY));
+    gst_caps_unref(caps);
+    if (!blendable)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 start_us = g_get_monotonic_time();
+    pollHud(hud, start_us);
+
+    char text[128];
+    if (hud->have_link)
+    {
+        snprintf(text, sizeof(text), "SPD %3u  L %3u  R %3u\nLOSS %.1f%%  RTT %.0fMS  JIT %.0fMS",
+                 hud->speed, hud->left_angle, hud->right_angle, hud->loss_pct, hud->rtt_ms, hud->jitter_ms);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "SPD %3u  L %3u  R %3u\nLINK --", hud->speed, hud->left_angle, hud->right_angle);
+    }
+    setHudText(hud, text, GST_VIDEO_INFO_HEIGHT(&video_info));
+
+    // Blend into a private copy if anything else still holds the buffer
+    GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+    GstVideoFrame frame;
+    if (gst_video_frame_map(&frame, &video_info, buf, GST_MAP_READWRITE))
+    {
+        blendHud(hud, &frame);
+        gst_video_frame_unmap(&frame);
+    }
+
+    gint64 elapsed_us = g_get_monotonic_time() - start_us;
+    hud->frames++;
+    hud->total_us += elapsed_us;
+    hud->max_us = std::max(hud->max_us, elapsed_us);
+    reportHud(hud, start_us);
+    return GST_PAD_PROBE_OK;
+}
+
+fish_error_t setupHud(fish_hud_t *hud, GstElement *pipeline, GstElement *element, const char *pad_name,
+                      fish_handle_t *handle)
+{
+    hud->handle = handle;
+    hud->rtpbin = NULL;
+    hud->pad = NULL;
+    hud->probe = 0;
+
+    if (!handle->stream_config.hud)
+    {
+        return FISH_EPERM;
+    }
+
+    hud->pad = gst_element_get_static_pad(element, pad_name);
+    if (hud->pad == NULL)
+    {
+        printf("No %s pad to draw the HUD on\n", pad_name);
+        return FISH_EINVAL;
+    }
+
+    initHud(hud);
+    hud->rtpbin = gst_bin_get_by_name(GST_BIN(pipeline), "rtpbin");
+    hud->probe = gst_pad_add_probe(hud->pad, GST_PAD_PROBE_TYPE_BUFFER, hudProbe, hud, NULL);
+
+    printf(">> Drawing the telemetry HUD on %s:%s\n", GST_ELEMENT_NAME(element), pad_name);
+    return FISH_EOK;
+}
+
+void teardownHud(fish_hud_t *hud)
+{
+    if (hud->pad != NULL)
+    {
+        if (hud->probe != 0)
+        {
+            gst_pad_remove_probe(hud->pad, hud->probe);
+        }
+        gst_object_unref(hud->pad);
+        hud->pad = NULL;
+    }
+    if (hud->rtpbin != NULL)
+    {
+        gst_object_unref(hud->rtpbin);
+        hud->rtpbin = NULL;
+    }
+}
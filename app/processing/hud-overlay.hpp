@@ -0,0 +1,77 @@
+#ifndef __HUD_OVERLAY_HPP__
+#define __HUD_OVERLAY_HPP__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <string>
+#include <vector>
+
+#include "../common/fish_types.h"
+
+/* Telemetry burned into the bottom-left of the video: speed, fin angles and what the
+ * receiver reports about the link. The text is rendered with a built-in 5x7 font into a
+ * cached per-pixel blend table, only when the text changes. Every frame then only has the
+ * box under the text blended in, directly on the Y and chroma planes:
+ *   out = (in * mul >> 8) + add
+ * which darkens and desaturates the panel and puts white glyphs on it. */
+
+typedef struct
+{
+    fish_handle_t *handle;
+    GstElement *rtpbin;
+    GstPad *pad;
+    gulong probe;
+
+    // Only touched on the streaming thread
+    std::string text;               // What the cached blend table shows
+    int scale;                      // Luma pixels per font pixel
+    int box_width;                  // Size of the blend table in luma pixels, both even
+    int box_height;
+    std::vector<uint8_t> luma_mul;
+    std::vector<uint8_t> luma_add;
+    std::vector<uint8_t> chroma_mul; // Half resolution, shared by both chroma planes
+    std::vector<uint8_t> chroma_add;
+
+    uint8_t speed;
+    uint8_t left_angle;
+    uint8_t right_angle;
+    bool have_link;                 // A receiver report has arrived
+    double loss_pct;
+    double rtt_ms;
+    double jitter_ms;
+    gint64 poll_us;
+    gint64 link_poll_us;
+
+    uint64_t frames;
+    uint64_t renders;
+    gint64 total_us;
+    gint64 max_us;
+    gint64 report_us;
+} fish_hud_t;
+
+/* Description: Resets the cached text and counters, without attaching to a pipeline. For
+ *              calling setHudText() and blendHud() directly.
+ */
+void initHud(fish_hud_t *hud);
+
+/* Description: Re-renders the blend table if text ('\n' separates lines) or the glyph
+ *              scale for frame_height differs from what is cached. Returns true if it did.
+ */
+bool setHudText(fish_hud_t *hud, const std::string &text, int frame_height);
+
+/* Description: Blends the cached text into the bottom-left of a mapped NV12 or I420 frame.
+ *              Frames too small to hold the box are left alone.
+ */
+void blendHud(fish_hud_t *hud, GstVideoFrame *frame);
+
+/* Description: Overlays the telemetry on every system-memory NV12 or I420 buffer leaving
+ *              element's pad. Link stats come from the pipeline's rtpbin, when it has one.
+ *              Returns FISH_EPERM if the HUD is off.
+ */
+fish_error_t setupHud(fish_hud_t *hud, GstElement *pipeline, GstElement *element, const char *pad_name,
+                      fish_handle_t *handle);
+
+/* Description: Removes the probe and drops element references. */
+void teardownHud(fish_hud_t *hud);
+
+#endif /* __HUD_OVERLAY_HPP__ */
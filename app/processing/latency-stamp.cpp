@@ -0,0 +1,244 @@
+#include "latency-stamp.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#define STAMP_TIME_MASK ((1ULL << 48) - 1)
+#define STAMP_LUMA_HIGH 235
+#define STAMP_LUMA_LOW 16
+#define STAMP_LUMA_THRESHOLD 128
+
+typedef struct
+{
+    uint32_t frame_no;
+} stamp_probe_t;
+
+static uint16_t stampCheck(uint32_t frame_no, uint64_t stamp_us)
+{
+    // Never zero for an all-black frame, so a blank picture is not read as frame 0
+    return (uint16_t)(0xA5A5 ^ frame_no ^ (frame_no >> 16) ^ stamp_us ^ (stamp_us >> 16) ^ (stamp_us >> 32));
+}
+
+static int stampBlockSize(const GstVideoFrame *frame)
+{
+    int block = GST_VIDEO_FRAME_WIDTH(frame) / LATENCY_STAMP_COLUMNS;
+    int rows = LATENCY_STAMP_BITS / LATENCY_STAMP_COLUMNS;
+    if (block < 4 || GST_VIDEO_FRAME_HEIGHT(frame) < block * rows)
+    {
+        return 0;
+    }
+    return block;
+}
+
+static bool isStampable(const GstVideoInfo *info)
+{
+    // Only planar or semi-planar YUV has a contiguous luma plane at index 0
+    switch (GST_VIDEO_INFO_FORMAT(info))
+    {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV21:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void writeLatencyStamp(GstVideoFrame *frame, uint32_t frame_no, uint64_t stamp_us)
+{
+    int block = stampBlockSize(frame);
+    if (block == 0)
+    {
+        return;
+    }
+
+    stamp_us &= STAMP_TIME_MASK;
+    uint16_t check = stampCheck(frame_no, stamp_us);
+
+    guint8 *luma = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    int stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+
+    for (int bit = 0; bit < LATENCY_STAMP_BITS; bit++)
+    {
+        bool set;
+        if (bit < 32)
+        {
+            set = (frame_no >> (31 - bit)) & 1;
+        }
+        else if (bit < 80)
+        {
+            set = (stamp_us >> (79 - bit)) & 1;
+        }
+        else
+        {
+            set = (check >> (95 - bit)) & 1;
+        }
+
+        int x = (bit % LATENCY_STAMP_COLUMNS) * block;
+        int y = (bit / LATENCY_STAMP_COLUMNS) * block;
+        for (int row = 0; row < block; row++)
+        {
+            memset(luma + (y + row) * stride + x, set ? STAMP_LUMA_HIGH : STAMP_LUMA_LOW, block);
+        }
+    }
+}
+
+fish_error_t readLatencyStamp(const GstVideoFrame *frame, uint32_t *frame_no, uint64_t *stamp_us)
+{
+    int block = stampBlockSize(frame);
+    if (block == 0)
+    {
+        return FISH_EINVAL;
+    }
+
+    const guint8 *luma = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    int stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+
+    // Sample the middle half of each block, away from edges smeared by the encoder
+    int margin = block / 4;
+    uint32_t frame_bits = 0;
+    uint64_t time_bits = 0;
+    uint16_t check_bits = 0;
+
+    for (int bit = 0; bit < LATENCY_STAMP_BITS; bit++)
+    {
+        int x = (bit % LATENCY_STAMP_COLUMNS) * block;
+        int y = (bit / LATENCY_STAMP_COLUMNS) * block;
+        uint32_t sum = 0;
+        uint32_t count = 0;
+        for (int row = margin; row < block - margin; row++)
+        {
+            const guint8 *line = luma + (y + row) * stride + x;
+            for (int col = margin; col < block - margin; col++)
+            {
+                sum += line[col];
+                count++;
+            }
+        }
+
+        uint32_t set = (sum > STAMP_LUMA_THRESHOLD * count) ? 1 : 0;
+        if (bit < 32)
+        {
+            frame_bits = (frame_bits << 1) | set;
+        }
+        else if (bit < 80)
+        {
+            time_bits = (time_bits << 1) | set;
+        }
+        else
+        {
+            check_bits = (uint16_t)((check_bits << 1) | set);
+        }
+    }
+
+    if (check_bits != stampCheck(frame_bits, time_bits))
+    {
+        return FISH_EINVAL;
+    }
+
+    *frame_no = frame_bits;
+    *stamp_us = time_bits;
+    return FISH_EOK;
+}
+
+static GstPadProbeReturn stampProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    stamp_probe_t *probe = (stamp_probe_t *)user_data;
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (caps == NULL)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstVideoInfo video_info;
+    GstCapsFeatures *features = gst_caps_get_features(caps, 0);
+    bool stampable = gst_video_info_from_caps(&video_info, caps) && isStampable(&video_info) &&
+                     (features == NULL || gst_caps_features_is_equal(features, GST_CAPS_FEATURE_MEMORY_SYSTEM_MEMORY));
+    gst_caps_unref(caps);
+    if (!stampable)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // Stamp a private copy if anything else still holds the buffer
+    GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+    GstVideoFrame frame;
+    if (gst_video_frame_map(&frame, &video_info, buf, GST_MAP_READWRITE))
+    {
+        writeLatencyStamp(&frame, probe->frame_no++, (uint64_t)g_get_real_time());
+        gst_video_frame_unmap(&frame);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+fish_error_t addLatencyStampProbe(GstElement *element, const char *pad_name)
+{
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (pad == NULL)
+    {
+        printf("No %s pad to stamp\n", pad_name);
+        return FISH_EINVAL;
+    }
+
+    stamp_probe_t *probe = g_new0(stamp_probe_t, 1);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, stampProbe, probe, g_free);
+    gst_object_unref(pad);
+
+    printf(">> Stamping frames on %s:%s for latency measurement\n", GST_ELEMENT_NAME(element), pad_name);
+    return FISH_EOK;
+}
+
+void initLatencyStats(fish_latency_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void updateLatencyStats(fish_latency_stats_t *stats, uint32_t frame_no, uint64_t stamp_us, uint64_t now_us)
+{
+    double latency_ms = (double)((now_us - stamp_us) & STAMP_TIME_MASK) / 1000.0;
+
+    if (stats->frames > 0)
+    {
+        int32_t gap = (int32_t)(frame_no - stats->last_frame);
+        if (gap <= 0)
+        {
+            stats->reordered++;
+        }
+        else
+        {
+            stats->dropped += gap - 1;
+        }
+
+        double delta = latency_ms - stats->last_ms;
+        stats->jitter_ms += ((delta < 0 ? -delta : delta) - stats->jitter_ms) / 16.0;
+    }
+
+    if (stats->frames == 0 || latency_ms < stats->min_ms)
+    {
+        stats->min_ms = latency_ms;
+    }
+    if (latency_ms > stats->max_ms)
+    {
+        stats->max_ms = latency_ms;
+    }
+
+    stats->frames++;
+    stats->total_ms += latency_ms;
+    stats->last_frame = frame_no;
+    stats->last_ms = latency_ms;
+}
+
+void printLatencyStats(const char *label, const fish_latency_stats_t *stats)
+{
+    double avg_ms = stats->frames ? stats->total_ms / stats->frames : 0.0;
+    printf(">> %s: %llu frames, latency avg %.1fms min %.1fms max %.1fms, jitter %.1fms, "
+           "dropped %llu, reordered %llu, unreadable %llu\n",
+           label, (unsigned long long)stats->frames, avg_ms, stats->min_ms, stats->max_ms, stats->jitter_ms,
+           (unsigned long long)stats->dropped, (unsigned long long)stats->reordered,
+           (unsigned long long)stats->invalid);
+}
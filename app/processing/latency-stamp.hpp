@@ -0,0 +1,54 @@
+#ifndef __LATENCY_STAMP_HPP__
+#define __LATENCY_STAMP_HPP__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "../common/fish_types.h"
+
+/* The stamp is 96 luma blocks in two rows across the top-left of the frame: a 32-bit frame
+ * counter, the low 48 bits of the wall clock in microseconds and a 16-bit check word.
+ * Blocks are width/48 pixels square so they survive encoding at any sane bitrate. */
+#define LATENCY_STAMP_BITS 96
+#define LATENCY_STAMP_COLUMNS 48
+
+/* Receiver-side counters, updated once per decoded frame */
+typedef struct
+{
+    uint64_t frames;     // Frames with a valid stamp
+    uint64_t invalid;    // Frames whose stamp failed the check word
+    uint64_t dropped;    // Gaps in the frame counter
+    uint64_t reordered;  // Frames that arrived with an older counter than the last one
+    uint32_t last_frame;
+    double last_ms;
+    double min_ms;
+    double max_ms;
+    double total_ms;
+    double jitter_ms;    // RFC 3550 style smoothed latency variation
+} fish_latency_stats_t;
+
+/* Description: Writes the stamp into the luma plane of a mapped YUV frame. */
+void writeLatencyStamp(GstVideoFrame *frame, uint32_t frame_no, uint64_t stamp_us);
+
+/* Description: Reads the stamp back from a decoded YUV frame. Returns FISH_EINVAL if the
+ *              frame is too small or the check word does not match.
+ */
+fish_error_t readLatencyStamp(const GstVideoFrame *frame, uint32_t *frame_no, uint64_t *stamp_us);
+
+/* Description: Stamps every system-memory YUV buffer leaving element's pad with a running
+ *              frame counter and g_get_real_time(). Other buffers pass through untouched.
+ */
+fish_error_t addLatencyStampProbe(GstElement *element, const char *pad_name);
+
+/* Description: Resets the receiver counters. */
+void initLatencyStats(fish_latency_stats_t *stats);
+
+/* Description: Accounts for one received stamp. now_us must come from g_get_real_time() on
+ *              a clock synchronised with the sender.
+ */
+void updateLatencyStats(fish_latency_stats_t *stats, uint32_t frame_no, uint64_t stamp_us, uint64_t now_us);
+
+/* Description: Prints one line summarising stats, prefixed with label. */
+void printLatencyStats(const char *label, const fish_latency_stats_t *stats);
+
+#endif /* __LATENCY_STAMP_HPP__ */
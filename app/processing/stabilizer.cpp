@@ -0,0 +1,197 @@
+#include "stabilizer.hpp"
+#include "frame-processors.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#define STABILIZER_BUDGET_US 20000 // Keeps the added latency under one frame at 30 fps
+#define STABILIZER_DECIMATION 4
+#define STABILIZER_FEATURES 100
+#define STABILIZER_MIN_POINTS 12   // Fewer tracked corners than this and the estimate is not trusted
+#define STABILIZER_SMOOTHING 0.1   // Weight of new motion in the smoothed path, lower is steadier
+#define STABILIZER_MAX_CROP 0.25
+#define STABILIZER_REPORT_US (5 * G_USEC_PER_SEC)
+
+/* Motion of the picture content since the last frame, in full-resolution pixels and radians.
+ * Returns false if it could not be estimated. */
+static bool estimateMotion(fish_stabilizer_t *stabilizer, const fish_frame_t *in, double *mx, double *my, double *ma)
+{
+    cv::resize(in->y, stabilizer->gray,
+               cv::Size(in->width / STABILIZER_DECIMATION, in->height / STABILIZER_DECIMATION), 0, 0, cv::INTER_AREA);
+
+    bool valid = false;
+    if (stabilizer->prev_gray.rows == stabilizer->gray.rows && stabilizer->prev_gray.cols == stabilizer->gray.cols)
+    {
+        cv::goodFeaturesToTrack(stabilizer->prev_gray, stabilizer->prev_points, STABILIZER_FEATURES, 0.01, 8);
+        if (stabilizer->prev_points.size() >= STABILIZER_MIN_POINTS)
+        {
+            std::vector<uchar> status;
+            std::vector<float> error;
+            cv::calcOpticalFlowPyrLK(stabilizer->prev_gray, stabilizer->gray, stabilizer->prev_points,
+                                     stabilizer->points, status, error, cv::Size(15, 15), 3);
+
+            std::vector<cv::Point2f> from;
+            std::vector<cv::Point2f> to;
+            for (size_t i = 0; i < status.size(); i++)
+            {
+                if (status[i])
+                {
+                    from.push_back(stabilizer->prev_points[i]);
+                    to.push_back(stabilizer->points[i]);
+                }
+            }
+
+            // RANSAC keeps fish and particles moving through the scene out of the estimate
+            if (from.size() >= STABILIZER_MIN_POINTS)
+            {
+                cv::Mat m = cv::estimateAffinePartial2D(from, to);
+                if (!m.empty())
+                {
+                    *mx = m.at<double>(0, 2) * STABILIZER_DECIMATION;
+                    *my = m.at<double>(1, 2) * STABILIZER_DECIMATION;
+                    *ma = atan2(m.at<double>(1, 0), m.at<double>(0, 0));
+                    valid = true;
+                }
+            }
+        }
+    }
+
+    cv::swap(stabilizer->prev_gray, stabilizer->gray);
+    return valid;
+}
+
+static void reportStabilizer(fish_stabilizer_t *stabilizer)
+{
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - stabilizer->report_us < STABILIZER_REPORT_US)
+    {
+        return;
+    }
+    stabilizer->report_us = now_us;
+
+    printf(">> Stabilizer: motion %.1f px/frame, correction %+.0f,%+.0f px %+.2f deg, failures %llu, clamped %llu\n",
+           stabilizer->frames ? stabilizer->motion_px / stabilizer->frames : 0.0,
+           stabilizer->dx, stabilizer->dy, stabilizer->da * 180.0 / M_PI,
+           (unsigned long long)stabilizer->failures, (unsigned long long)stabilizer->clamped);
+}
+
+static fish_error_t stabilizeProcessor(const fish_frame_t *in, fish_frame_t *out, void *user_data)
+{
+    return stabilizeFrame((fish_stabilizer_t *)user_data, in, out);
+}
+
+void initStabilizer(fish_stabilizer_t *stabilizer, double crop)
+{
+    stabilizer->crop = std::min(STABILIZER_MAX_CROP, std::max(0.0, crop));
+    stabilizer->prev_gray = cv::Mat();
+    stabilizer->dx = 0.0;
+    stabilizer->dy = 0.0;
+    stabilizer->da = 0.0;
+    stabilizer->frames = 0;
+    stabilizer->failures = 0;
+    stabilizer->clamped = 0;
+    stabilizer->motion_px = 0.0;
+    stabilizer->total_us = 0;
+    stabilizer->report_us = g_get_monotonic_time();
+}
+
+fish_error_t setupStabilizer(fish_stabilizer_t *stabilizer, const fish_stream_config_t *config)
+{
+    if (!config->stabilize)
+    {
+        return FISH_EPERM;
+    }
+
+    initStabilizer(stabilizer, config->stabilize_crop_pct / 100.0);
+
+    // A passed-through frame would be neither cropped nor zoomed and flicker between warped
+    // ones, so a late frame repeats the last stabilized one instead
+    fish_processor_t processor = {"stabilizer", stabilizeProcessor, stabilizer, STABILIZER_BUDGET_US, FISH_OVERRUN_REUSE_LAST};
+    if (registerFrameProcessor(&processor) != FISH_EOK)
+    {
+        return FISH_EINVAL;
+    }
+
+    printf(">> Stabilizing with %.0f%% crop per edge\n", stabilizer->crop * 100.0);
+    return FISH_EOK;
+}
+
+fish_error_t stabilizeFrame(fish_stabilizer_t *stabilizer, const fish_frame_t *in, fish_frame_t *out)
+{
+    gint64 start_us = g_get_monotonic_time();
+    double width = in->width;
+    double height = in->height;
+
+    double mx = 0.0;
+    double my = 0.0;
+    double ma = 0.0;
+    if (!estimateMotion(stabilizer, in, &mx, &my, &ma) && stabilizer->frames > 0)
+    {
+        stabilizer->failures++;
+    }
+    stabilizer->frames++;
+    stabilizer->motion_px += sqrt(mx * mx + my * my);
+
+    // The correction is the smoothed path minus the actual one. Filtering it directly is the
+    // same as an exponential average of the path, and needs no future frames.
+    double keep = 1.0 - STABILIZER_SMOOTHING;
+    stabilizer->dx = keep * (stabilizer->dx - mx);
+    stabilizer->dy = keep * (stabilizer->dy - my);
+    stabilizer->da = keep * (stabilizer->da - ma);
+
+    // Rotation uses up margin at the corners, what is left goes to translation. Clamping the
+    // correction itself means a deliberate pan is followed once the margin runs out.
+    double crop = stabilizer->crop;
+    double max_angle = crop * height / width;
+    double clamped_a = std::min(max_angle, std::max(-max_angle, stabilizer->da));
+    double margin_x = std::max(0.0, crop * width - fabs(clamped_a) * height / 2.0);
+    double margin_y = std::max(0.0, crop * height - fabs(clamped_a) * width / 2.0);
+    double clamped_x = std::min(margin_x, std::max(-margin_x, stabilizer->dx));
+    double clamped_y = std::min(margin_y, std::max(-margin_y, stabilizer->dy));
+    if (clamped_x != stabilizer->dx || clamped_y != stabilizer->dy || clamped_a != stabilizer->da)
+    {
+        stabilizer->clamped++;
+    }
+    stabilizer->dx = clamped_x;
+    stabilizer->dy = clamped_y;
+    stabilizer->da = clamped_a;
+
+    // Shift and rotate about the centre, then zoom so the margin is cropped off
+    double scale = 1.0 / (1.0 - 2.0 * crop);
+    double a = scale * cos(stabilizer->da);
+    double b = scale * sin(stabilizer->da);
+    double cx = width / 2.0;
+    double cy = height / 2.0;
+    cv::Mat m(2, 3, CV_64F);
+    m.at<double>(0, 0) = a;
+    m.at<double>(0, 1) = -b;
+    m.at<double>(0, 2) = a * (stabilizer->dx - cx) - b * (stabilizer->dy - cy) + cx;
+    m.at<double>(1, 0) = b;
+    m.at<double>(1, 1) = a;
+    m.at<double>(1, 2) = b * (stabilizer->dx - cx) + a * (stabilizer->dy - cy) + cy;
+    warpFrame(in, out, m);
+
+    stabilizer->total_us += g_get_monotonic_time() - start_us;
+    reportStabilizer(stabilizer);
+    return FISH_EOK;
+}
+
+void warpFrame(const fish_frame_t *in, fish_frame_t *out, const cv::Mat &m)
+{
+    cv::warpAffine(in->y, out->y, m, cv::Size(in->y.cols, in->y.rows), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+
+    // Chroma planes are half size in both directions, so only the translation changes
+    cv::Mat chroma_m = m.clone();
+    chroma_m.at<double>(0, 2) /= 2.0;
+    chroma_m.at<double>(1, 2) /= 2.0;
+    cv::warpAffine(in->uv, out->uv, chroma_m, cv::Size(in->uv.cols, in->uv.rows), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    if (in->format != GST_VIDEO_FORMAT_NV12)
+    {
+        cv::warpAffine(in->v, out->v, chroma_m, cv::Size(in->v.cols, in->v.rows), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef __STABILIZER_HPP__
+#define __STABILIZER_HPP__
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "frame-pipe.hpp"
+
+/* Digital stabilization for the oscillation fins put into the camera. Frame-to-frame motion
+ * (translation and rotation) is tracked with pyramidal Lucas-Kanade on luma decimated 4x.
+ * A causal low-pass filter separates intended motion from shake, so no frames are held
+ * back. Each frame is then warped by the negative of the shake and zoomed in slightly, so
+ * the moving edges stay out of view. */
+
+typedef struct
+{
+    double crop;             // Fraction of each edge given up as margin
+    cv::Mat prev_gray;       // Decimated luma of the last stabilized frame
+    cv::Mat gray;
+    std::vector<cv::Point2f> prev_points;
+    std::vector<cv::Point2f> points;
+
+    // Correction applied to the current frame, in full-resolution pixels and radians
+    double dx;
+    double dy;
+    double da;
+
+    uint64_t frames;
+    uint64_t failures;       // Frames where no global motion could be estimated
+    uint64_t clamped;        // Frames where the correction hit the crop margin
+    double motion_px;        // Sum of per-frame translation magnitudes
+    gint64 total_us;
+    gint64 report_us;
+} fish_stabilizer_t;
+
+/* Description: Resets stabilizer with crop (0 to 0.25) of each edge as margin, without
+ *              registering it as a frame processor. For running stabilizeFrame() directly.
+ */
+void initStabilizer(fish_stabilizer_t *stabilizer, double crop);
+
+/* Description: Registers the stabilizer as a frame processor with the crop from config.
+ *              Must be called before startFrameProcessors(). Returns FISH_EPERM if
+ *              stabilization is off.
+ */
+fish_error_t setupStabilizer(fish_stabilizer_t *stabilizer, const fish_stream_config_t *config);
+
+/* Description: Estimates the motion since the previous call, updates the correction and
+ *              writes the stabilized, cropped frame to out. Frames must arrive in order.
+ */
+fish_error_t stabilizeFrame(fish_stabilizer_t *stabilizer, const fish_frame_t *in, fish_frame_t *out);
+
+/* Description: Warps every plane of in by m, a 2x3 CV_64F affine transform in luma pixel
+ *              coordinates, into out. Edges are filled by repeating the border. Planes of
+ *              out that are empty are allocated.
+ */
+void warpFrame(const fish_frame_t *in, fish_frame_t *out, const cv::Mat &m);
+
+#endif /* __STABILIZER_HPP__ */
@@ -0,0 +1,218 @@
+#include "underwater-correct.hpp"
+#include "frame-processors.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+
+#define UNDERWATER_BUDGET_US 5000
+#define UNDERWATER_SAMPLE_FRAMES 10   // Hand every Nth frame to the estimator
+#define UNDERWATER_SMOOTHING 0.2      // Weight of a new estimate, keeps the correction from pumping
+#define UNDERWATER_BLACK_FRACTION 0.01
+#define UNDERWATER_WHITE_FRACTION 0.99
+#define UNDERWATER_MAX_GAIN 2.5       // Luma stretch cap, so murky water does not turn into noise
+#define UNDERWATER_SATURATION 0.25    // Extra saturation at full strength
+#define UNDERWATER_REPORT_US (5 * G_USEC_PER_SEC)
+
+static uint8_t clampSample(double value)
+{
+    return (uint8_t)std::min(255.0, std::max(0.0, floor(value + 0.5)));
+}
+
+/* Luma percentiles and chroma averages of a (decimated) frame */
+static void measureFrame(const fish_frame_t *frame, double *black, double *white, double *u_mean, double *v_mean)
+{
+    uint32_t histogram[256] = {0};
+    for (int row = 0; row < frame->y.rows; row++)
+    {
+        const uint8_t *y = frame->y.ptr(row);
+        for (int x = 0; x < frame->y.cols; x++)
+        {
+            histogram[y[x]]++;
+        }
+    }
+
+    uint64_t total = (uint64_t)frame->y.rows * frame->y.cols;
+    uint64_t count = 0;
+    *black = 0.0;
+    *white = 255.0;
+    bool found_black = false;
+    for (int i = 0; i < 256; i++)
+    {
+        count += histogram[i];
+        if (!found_black && count >= total * UNDERWATER_BLACK_FRACTION)
+        {
+            *black = i;
+            found_black = true;
+        }
+        if (count >= total * UNDERWATER_WHITE_FRACTION)
+        {
+            *white = i;
+            break;
+        }
+    }
+
+    uint64_t u_sum = 0;
+    uint64_t v_sum = 0;
+    int rows = frame->uv.rows;
+    int cols = frame->uv.cols;
+    for (int row = 0; row < rows; row++)
+    {
+        if (frame->format == GST_VIDEO_FORMAT_NV12)
+        {
+            const uint8_t *uv = frame->uv.ptr(row);
+            for (int x = 0; x < cols; x++)
+            {
+                u_sum += uv[2 * x];
+                v_sum += uv[2 * x + 1];
+            }
+        }
+        else
+        {
+            const uint8_t *u = frame->uv.ptr(row);
+            const uint8_t *v = frame->v.ptr(row);
+            for (int x = 0; x < cols; x++)
+            {
+                u_sum += u[x];
+                v_sum += v[x];
+            }
+        }
+    }
+
+    uint64_t samples = std::max((uint64_t)1, (uint64_t)rows * cols);
+    *u_mean = (double)u_sum / samples;
+    *v_mean = (double)v_sum / samples;
+}
+
+/* Bakes the smoothed statistics into the lookup tables. Must hold underwater->mtx. */
+static void buildLuts(fish_underwater_t *underwater)
+{
+    double strength = underwater->strength;
+
+    // Stretch [black, white] over the nominal 16-235 range, blended with the input by strength
+    double gain = std::min(UNDERWATER_MAX_GAIN, 219.0 / std::max(1.0, underwater->white - underwater->black));
+    for (int i = 0; i < 256; i++)
+    {
+        double stretched = 16.0 + (i - underwater->black) * gain;
+        underwater->luts.y[i] = clampSample(i + strength * (stretched - i));
+    }
+
+    // Grey world: move the average chroma back to neutral, then widen around it
+    double saturation = 1.0 + UNDERWATER_SATURATION * strength;
+    double u_cast = strength * (underwater->u_mean - 128.0);
+    double v_cast = strength * (underwater->v_mean - 128.0);
+    for (int i = 0; i < 256; i++)
+    {
+        underwater->luts.u[i] = clampSample(128.0 + saturation * (i - 128.0 - u_cast));
+        underwater->luts.v[i] = clampSample(128.0 + saturation * (i - 128.0 - v_cast));
+    }
+}
+
+static void estimatorLoop(fish_underwater_t *underwater)
+{
+    std::unique_lock<std::mutex> lock(underwater->mtx);
+    while (true)
+    {
+        underwater->cv.wait(lock, [underwater]
+                            { return !underwater->running || underwater->pending; });
+        if (!underwater->running)
+        {
+            return;
+        }
+
+        // The processor leaves sample alone while pending is set
+        lock.unlock();
+        double black, white, u_mean, v_mean;
+        measureFrame(&underwater->sample, &black, &white, &u_mean, &v_mean);
+        lock.lock();
+
+        double weight = underwater->estimated ? UNDERWATER_SMOOTHING : 1.0;
+        underwater->black += weight * (black - underwater->black);
+        underwater->white += weight * (white - underwater->white);
+        underwater->u_mean += weight * (u_mean - underwater->u_mean);
+        underwater->v_mean += weight * (v_mean - underwater->v_mean);
+        underwater->estimated = true;
+        underwater->estimates++;
+        buildLuts(underwater);
+        underwater->pending = false;
+
+        gint64 now_us = g_get_monotonic_time();
+        if (now_us - underwater->report_us >= UNDERWATER_REPORT_US)
+        {
+            underwater->report_us = now_us;
+            printf(">> Underwater correction: black %.0f, white %.0f, cast U %+.1f V %+.1f (%llu estimates)\n",
+                   underwater->black, underwater->white, underwater->u_mean - 128.0, underwater->v_mean - 128.0,
+                   (unsigned long long)underwater->estimates);
+        }
+    }
+}
+
+static fish_error_t correctFrame(const fish_frame_t *in, fish_frame_t *out, void *user_data)
+{
+    fish_underwater_t *underwater = (fish_underwater_t *)user_data;
+    fish_plane_luts_t luts;
+    bool sample;
+    {
+        std::lock_guard<std::mutex> lock(underwater->mtx);
+        sample = (underwater->frames++ % UNDERWATER_SAMPLE_FRAMES == 0) && !underwater->pending;
+        luts = underwater->luts;
+    }
+
+    if (sample)
+    {
+        downscaleFrame2x(in, &underwater->half);
+        downscaleFrame2x(&underwater->half, &underwater->sample);
+
+        std::lock_guard<std::mutex> lock(underwater->mtx);
+        underwater->pending = true;
+        underwater->cv.notify_one();
+    }
+
+    applyFrameLuts(in, out, &luts);
+    return FISH_EOK;
+}
+
+fish_error_t setupUnderwaterCorrection(fish_underwater_t *underwater, const fish_stream_config_t *config)
+{
+    if (!config->underwater)
+    {
+        return FISH_EPERM;
+    }
+
+    uint32_t strength_pct = std::min(config->underwater_strength_pct, (uint32_t)100);
+    underwater->strength = strength_pct / 100.0;
+    underwater->frames = 0;
+    underwater->running = true;
+    underwater->pending = false;
+    underwater->estimated = false;
+    underwater->black = 16.0;
+    underwater->white = 235.0;
+    underwater->u_mean = 128.0;
+    underwater->v_mean = 128.0;
+    underwater->estimates = 0;
+    underwater->report_us = g_get_monotonic_time();
+    initPlaneLuts(&underwater->luts);
+
+    fish_processor_t processor = {"underwater", correctFrame, underwater, UNDERWATER_BUDGET_US, FISH_OVERRUN_PASSTHROUGH};
+    if (registerFrameProcessor(&processor) != FISH_EOK)
+    {
+        return FISH_EINVAL;
+    }
+    underwater->estimator = std::thread(estimatorLoop, underwater);
+
+    printf(">> Underwater correction at %u%% strength\n", strength_pct);
+    return FISH_EOK;
+}
+
+void teardownUnderwaterCorrection(fish_underwater_t *underwater)
+{
+    {
+        std::lock_guard<std::mutex> lock(underwater->mtx);
+        underwater->running = false;
+    }
+    underwater->cv.notify_all();
+    if (underwater->estimator.joinable())
+    {
+        underwater->estimator.join();
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __UNDERWATER_CORRECT_HPP__
+#define __UNDERWATER_CORRECT_HPP__
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "color-kernels.hpp"
+
+/* Water absorbs red first and scatters light back towards the camera, so footage comes out
+ * blue-green, low contrast and lifted in the blacks. The correction is a luma stretch that
+ * removes the haze floor and a chroma shift that pulls the average colour back to grey
+ * (grey world), with a little saturation boost to make up for the lost colour. All of it
+ * is baked into per-plane lookup tables, so each frame costs only a table lookup per sample
+ * in YUV. The tables are estimated on a frame decimated 4x on a background thread. */
+
+typedef struct
+{
+    double strength;         // 0 leaves frames alone, 1 applies the full correction
+    uint32_t frames;         // Frames seen by the processor
+    fish_frame_t half;       // Scratch for the first 2x decimation
+    fish_frame_t sample;     // Decimated frame waiting for the estimator
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread estimator;
+    bool running;
+    bool pending;            // sample holds a frame the estimator has not read yet
+    bool estimated;          // The smoothed statistics below have been seeded
+    double black;            // Smoothed luma low and high percentiles
+    double white;
+    double u_mean;           // Smoothed chroma averages
+    double v_mean;
+    fish_plane_luts_t luts;  // Current correction, guarded by mtx
+    uint64_t estimates;
+    gint64 report_us;
+} fish_underwater_t;
+
+/* Description: Registers the underwater correction as a frame processor and starts its
+ *              estimator thread. Frames pass unchanged until the first estimate is in.
+ *              Must be called before startFrameProcessors(). Returns FISH_EPERM if the
+ *              correction is off.
+ */
+fish_error_t setupUnderwaterCorrection(fish_underwater_t *underwater, const fish_stream_config_t *config);
+
+/* Description: Stops the estimator thread. Call after stopFrameProcessors(). */
+void teardownUnderwaterCorrection(fish_underwater_t *underwater);
+
+#endif /* __UNDERWATER_CORRECT_HPP__ */
@@ -1,5 +1,6 @@
 #include "root_certificates.hpp"
 #include "boost-sock.hpp"
+#include "../streaming/video-profiles.hpp"
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/ssl.hpp>
@@ -95,6 +96,59 @@ static void copyStopToHandle(fish_handle_t *handle, Json::Value root)
     }
 }
 
+static void copyVideoProfileToHandle(fish_handle_t *handle, Json::Value root)
+{
+    std::string value;
+    value = root.get("videoProfile", "error").asString();
+
+    int profile = findVideoProfile(value.c_str());
+    if (profile < 0)
+    {
+        std::cout << "Unknown video profile: " << value << std::endl;
+        return;
+    }
+
+    fish_handle_mtx.lock();
+    handle->next_video_profile = profile;
+    fish_handle_mtx.unlock();
+}
+
+static void copySimulcastLayersToHandle(fish_handle_t *handle, Json::Value root)
+{
+    Json::Value layers = root["simulcastLayers"];
+    if (!layers.isArray())
+    {
+        std::cout << "simulcastLayers must be an array of booleans" << std::endl;
+        return;
+    }
+
+    // Index 0 is the full quality layer
+    uint8_t mask = 0;
+    for (Json::ArrayIndex i = 0; i < layers.size() && i < 8; i++)
+    {
+        if (layers[i].asBool())
+        {
+            mask |= (1 << i);
+        }
+    }
+
+    fish_handle_mtx.lock();
+    handle->next_simulcast_mask = mask;
+    fish_handle_mtx.unlock();
+}
+
+static void copyReplaySaveToHandle(fish_handle_t *handle, Json::Value root)
+{
+    if (!root.get("saveReplay", false).asBool())
+    {
+        return;
+    }
+
+    fish_handle_mtx.lock();
+    handle->next_replay_save = true;
+    fish_handle_mtx.unlock();
+}
+
 /* Reads the JSON received from websocket and calls handler to copy to thread-shared buffer */
 fish_error_t parseSocketJson(std::string json_string, fish_handle_t *handle)
 {
@@ -127,6 +181,18 @@ fish_error_t parseSocketJson(std::string json_string, fish_handle_t *handle)
     {
         copyTurnToHandle(handle, root);
     }
+    else if (root.isMember("videoProfile"))
+    {
+        copyVideoProfileToHandle(handle, root);
+    }
+    else if (root.isMember("simulcastLayers"))
+    {
+        copySimulcastLayersToHandle(handle, root);
+    }
+    else if (root.isMember("saveReplay"))
+    {
+        copyReplaySaveToHandle(handle, root);
+    }
     else
     {
         std::cout << "Unparsed message: " << message << std::endl;
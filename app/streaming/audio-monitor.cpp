@@ -0,0 +1,134 @@
+#include "audio-monitor.hpp"
+
+#include <stdio.h>
+#include <time.h>
+
+#define AUDIO_REPORT_US (5 * G_USEC_PER_SEC)
+
+static GstPadProbeReturn audioCpuProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_audio_monitor_t *monitor = (fish_audio_monitor_t *)user_data;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    monitor->thread_cpu_ns.store((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Packets keep the PTS of the captured samples, which live sources set to the running
+ * time of capture, so the difference to now covers capture, queueing and encoding. */
+static GstPadProbeReturn audioLatencyProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_audio_monitor_t *monitor = (fish_audio_monitor_t *)user_data;
+    GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    GstClock *clock = gst_element_get_clock(monitor->pipeline);
+    if (clock == NULL)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(monitor->pipeline);
+    gst_object_unref(clock);
+
+    if (!GST_CLOCK_TIME_IS_VALID(pts) || now < pts)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    uint64_t latency_us = (now - pts) / GST_USECOND;
+    monitor->packets++;
+    monitor->total_latency_us += latency_us;
+    if (latency_us > monitor->max_latency_us.load())
+    {
+        monitor->max_latency_us.store(latency_us);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPad *getElementPad(GstElement *pipeline, const char *element_name, const char *pad_name)
+{
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), element_name);
+    if (element == NULL)
+    {
+        return NULL;
+    }
+
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    gst_object_unref(element);
+    return pad;
+}
+
+fish_error_t setupAudioMonitor(fish_audio_monitor_t *monitor, GstElement *pipeline)
+{
+    monitor->pipeline = pipeline;
+    monitor->queue_src = getElementPad(pipeline, "audio_queue", "src");
+    monitor->pay_src = getElementPad(pipeline, "audio_pay", "src");
+    monitor->cpu_probe = 0;
+    monitor->latency_probe = 0;
+
+    if (monitor->queue_src == NULL || monitor->pay_src == NULL)
+    {
+        teardownAudioMonitor(monitor);
+        return FISH_EPERM;
+    }
+
+    monitor->thread_cpu_ns = 0;
+    monitor->packets = 0;
+    monitor->total_latency_us = 0;
+    monitor->max_latency_us = 0;
+    monitor->report_cpu_ns = 0;
+    monitor->report_us = g_get_monotonic_time();
+
+    monitor->cpu_probe = gst_pad_add_probe(monitor->queue_src, GST_PAD_PROBE_TYPE_BUFFER,
+                                           audioCpuProbe, monitor, NULL);
+    monitor->latency_probe = gst_pad_add_probe(monitor->pay_src, GST_PAD_PROBE_TYPE_BUFFER,
+                                               audioLatencyProbe, monitor, NULL);
+
+    printf(">> Streaming Opus audio (ssrc %d)\n", FISH_AUDIO_SSRC);
+    return FISH_EOK;
+}
+
+void updateAudioMonitor(fish_audio_monitor_t *monitor)
+{
+    gint64 now_us = g_get_monotonic_time();
+    gint64 wall_us = now_us - monitor->report_us;
+    if (wall_us < AUDIO_REPORT_US)
+    {
+        return;
+    }
+    monitor->report_us = now_us;
+
+    uint64_t packets = monitor->packets.exchange(0);
+    uint64_t total_us = monitor->total_latency_us.exchange(0);
+    uint64_t max_us = monitor->max_latency_us.exchange(0);
+
+    int64_t cpu_ns = monitor->thread_cpu_ns.load();
+    double cpu_percent = (monitor->report_cpu_ns == 0) ? 0.0 : (cpu_ns - monitor->report_cpu_ns) / (10.0 * wall_us);
+    monitor->report_cpu_ns = cpu_ns;
+
+    printf(">> Audio: %llu packets, capture to send avg %.1fms max %.1fms, encode thread CPU %.1f%%\n",
+           (unsigned long long)packets, packets ? total_us / 1000.0 / packets : 0.0, max_us / 1000.0, cpu_percent);
+}
+
+void teardownAudioMonitor(fish_audio_monitor_t *monitor)
+{
+    if (monitor->queue_src != NULL)
+    {
+        if (monitor->cpu_probe != 0)
+        {
+            gst_pad_remove_probe(monitor->queue_src, monitor->cpu_probe);
+        }
+        gst_object_unref(monitor->queue_src);
+        monitor->queue_src = NULL;
+    }
+
+    if (monitor->pay_src != NULL)
+    {
+        if (monitor->latency_probe != 0)
+        {
+            gst_pad_remove_probe(monitor->pay_src, monitor->latency_probe);
+        }
+        gst_object_unref(monitor->pay_src);
+        monitor->pay_src = NULL;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __AUDIO_MONITOR_HPP__
+#define __AUDIO_MONITOR_HPP__
+
+#include <gst/gst.h>
+#include <atomic>
+
+#include "../common/fish_types.h"
+
+typedef struct
+{
+    GstElement *pipeline;
+    GstPad *queue_src; // audio_queue:src, first pad on the encode thread
+    GstPad *pay_src;   // audio_pay:src, where packets leave for rtpbin
+    gulong cpu_probe;
+    gulong latency_probe;
+
+    std::atomic<int64_t> thread_cpu_ns; // CPU time of the encode thread at its last buffer
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> total_latency_us;
+    std::atomic<uint64_t> max_latency_us;
+
+    int64_t report_cpu_ns;
+    gint64 report_us;
+} fish_audio_monitor_t;
+
+/* Description: Adds probes that measure capture-to-send latency and encode-thread CPU time
+ *              of the Opus chain built by audioSendDesc(). Returns FISH_EPERM if the pipeline
+ *              has no audio.
+ */
+fish_error_t setupAudioMonitor(fish_audio_monitor_t *monitor, GstElement *pipeline);
+
+/* Description: Prints latency and CPU usage every few seconds. Call periodically from the
+ *              thread that owns the pipeline.
+ */
+void updateAudioMonitor(fish_audio_monitor_t *monitor);
+
+/* Description: Removes the probes and drops pad references. */
+void teardownAudioMonitor(fish_audio_monitor_t *monitor);
+
+#endif /* __AUDIO_MONITOR_HPP__ */
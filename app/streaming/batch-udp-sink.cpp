@@ -0,0 +1,478 @@
+#include "batch-udp-sink.hpp"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // Linux 4.18, missing from older headers
+#endif
+
+#define BATCH_MAX_PACKETS 64 // Also the kernel's limit on segments per GSO write
+#define BATCH_MAX_MEMS 4     // Payloaders put header and payload in separate memories
+#define GSO_MAX_BYTES 65000  // One GSO write must fit in a single IP datagram before it is split
+
+enum
+{
+    PROP_0,
+    PROP_HOST,
+    PROP_PORT,
+    PROP_GSO,
+    PROP_PACKETS,
+    PROP_SEND_CALLS,
+    PROP_GSO_SENDS
+};
+
+/* One packet mapped for scatter/gather, without merging its memories */
+typedef struct
+{
+    GstBuffer *buf;
+    GstMemory *mems[BATCH_MAX_MEMS];
+    GstMapInfo maps[BATCH_MAX_MEMS];
+    struct iovec iov[BATCH_MAX_MEMS];
+    int n_iov;
+    bool merged; // More memories than BATCH_MAX_MEMS, mapped as one copy in maps[0]
+    size_t size;
+} batch_packet_t;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE(FishBatchUdpSink, fish_batch_udp_sink, GST_TYPE_BASE_SINK);
+
+static bool mapPacket(GstBuffer *buf, batch_packet_t *pkt)
+{
+    guint n_mems = gst_buffer_n_memory(buf);
+
+    pkt->buf = buf;
+    pkt->n_iov = 0;
+    pkt->size = 0;
+    pkt->merged = (n_mems > BATCH_MAX_MEMS);
+    if (pkt->merged)
+    {
+        if (!gst_buffer_map(buf, &pkt->maps[0], GST_MAP_READ))
+        {
+            return false;
+        }
+        pkt->iov[0].iov_base = pkt->maps[0].data;
+        pkt->iov[0].iov_len = pkt->maps[0].size;
+        pkt->n_iov = 1;
+        pkt->size = pkt->maps[0].size;
+        return true;
+    }
+
+    for (guint i = 0; i < n_mems; i++)
+    {
+        pkt->mems[i] = gst_buffer_peek_memory(buf, i);
+        if (!gst_memory_map(pkt->mems[i], &pkt->maps[i], GST_MAP_READ))
+        {
+            for (int j = 0; j < pkt->n_iov; j++)
+            {
+                gst_memory_unmap(pkt->mems[j], &pkt->maps[j]);
+            }
+            return false;
+        }
+        pkt->iov[i].iov_base = pkt->maps[i].data;
+        pkt->iov[i].iov_len = pkt->maps[i].size;
+        pkt->n_iov++;
+        pkt->size += pkt->maps[i].size;
+    }
+    return true;
+}
+
+static void unmapPacket(batch_packet_t *pkt)
+{
+    if (pkt->merged)
+    {
+        gst_buffer_unmap(pkt->buf, &pkt->maps[0]);
+        return;
+    }
+    for (int i = 0; i < pkt->n_iov; i++)
+    {
+        gst_memory_unmap(pkt->mems[i], &pkt->maps[i]);
+    }
+}
+
+static void fillHeader(FishBatchUdpSink *sink, struct msghdr *hdr, struct iovec *iov, size_t n_iov)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->msg_name = &sink->addr;
+    hdr->msg_namelen = sink->addr_len;
+    hdr->msg_iov = iov;
+    hdr->msg_iovlen = n_iov;
+}
+
+/* Send errors are logged and the packets dropped, like udpsink does, so a
+ * transient ICMP error or full buffer never stops the pipeline */
+static void sendOne(FishBatchUdpSink *sink, batch_packet_t *pkt)
+{
+    struct msghdr hdr;
+    fillHeader(sink, &hdr, pkt->iov, pkt->n_iov);
+    if (sendmsg(sink->fd, &hdr, 0) < 0)
+    {
+        GST_WARNING_OBJECT(sink, "sendmsg failed: %s", strerror(errno));
+    }
+    sink->packets++;
+    sink->send_calls++;
+}
+
+static void sendBatch(FishBatchUdpSink *sink, batch_packet_t *pkts, int count)
+{
+    if (!sink->have_sendmmsg || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            sendOne(sink, &pkts[i]);
+        }
+        return;
+    }
+
+    struct mmsghdr msgs[BATCH_MAX_PACKETS];
+    for (int i = 0; i < count; i++)
+    {
+        fillHeader(sink, &msgs[i].msg_hdr, pkts[i].iov, pkts[i].n_iov);
+        msgs[i].msg_len = 0;
+    }
+
+    int sent = 0;
+    while (sent < count)
+    {
+        int ret = sendmmsg(sink->fd, &msgs[sent], count - sent, 0);
+        sink->send_calls++;
+        if (ret < 0)
+        {
+            if (errno == ENOSYS)
+            {
+                GST_INFO_OBJECT(sink, "no sendmmsg, sending one packet per call");
+                sink->have_sendmmsg = false;
+                sink->send_calls--;
+                for (int i = sent; i < count; i++)
+                {
+                    sendOne(sink, &pkts[i]);
+                }
+                return;
+            }
+            // Skip the packet the kernel refused and carry on with the rest
+            GST_WARNING_OBJECT(sink, "sendmmsg failed: %s", strerror(errno));
+            ret = 1;
+        }
+        sent += ret;
+        sink->packets += ret;
+    }
+}
+
+/* Sends count equal-sized packets, except for a shorter last one, as one GSO write */
+static bool sendGso(FishBatchUdpSink *sink, batch_packet_t *pkts, int count)
+{
+    struct iovec iov[BATCH_MAX_PACKETS * BATCH_MAX_MEMS];
+    size_t n_iov = 0;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(&iov[n_iov], pkts[i].iov, pkts[i].n_iov * sizeof(struct iovec));
+        n_iov += pkts[i].n_iov;
+    }
+
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct msghdr hdr;
+    fillHeader(sink, &hdr, iov, n_iov);
+    memset(control, 0, sizeof(control));
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t segment = (uint16_t)pkts[0].size;
+    memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+
+    if (sendmsg(sink->fd, &hdr, 0) < 0)
+    {
+        // EIO: the route's device cannot segment; the others: the kernel has no GSO
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+        {
+            GST_INFO_OBJECT(sink, "UDP GSO unavailable (%s), using sendmmsg only", strerror(errno));
+            sink->gso_active = false;
+            return false;
+        }
+        GST_WARNING_OBJECT(sink, "GSO sendmsg failed: %s", strerror(errno));
+    }
+    sink->packets += count;
+    sink->send_calls++;
+    sink->gso_sends++;
+    return true;
+}
+
+/* Length of the GSO run starting at pkts[0]: equal sizes, optionally ending shorter */
+static int gsoRunLength(batch_packet_t *pkts, int count)
+{
+    size_t segment = pkts[0].size;
+    size_t total = 0;
+    int run = 0;
+
+    while (run < count && total + pkts[run].size <= GSO_MAX_BYTES)
+    {
+        if (pkts[run].size > segment)
+        {
+            break;
+        }
+        total += pkts[run].size;
+        run++;
+        if (pkts[run - 1].size < segment)
+        {
+            break;
+        }
+    }
+    return run;
+}
+
+static void sendPackets(FishBatchUdpSink *sink, batch_packet_t *pkts, int count)
+{
+    int batch_start = 0;
+    int i = 0;
+
+    while (sink->gso_active && i < count)
+    {
+        int run = gsoRunLength(&pkts[i], count - i);
+        if (run < 2)
+        {
+            i++;
+            continue;
+        }
+
+        // Flush the odd-sized packets before the run so order is kept
+        if (i > batch_start)
+        {
+            sendBatch(sink, &pkts[batch_start], i - batch_start);
+        }
+        if (!sendGso(sink, &pkts[i], run))
+        {
+            batch_start = i;
+            break;
+        }
+        i += run;
+        batch_start = i;
+    }
+
+    if (batch_start < count)
+    {
+        sendBatch(sink, &pkts[batch_start], count - batch_start);
+    }
+}
+
+static GstFlowReturn renderList(GstBaseSink *base, GstBufferList *list)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)base;
+    batch_packet_t pkts[BATCH_MAX_PACKETS];
+    guint length = gst_buffer_list_length(list);
+    guint done = 0;
+
+    while (done < length)
+    {
+        int count = 0;
+        while (done + count < length && count < BATCH_MAX_PACKETS)
+        {
+            if (!mapPacket(gst_buffer_list_get(list, done + count), &pkts[count]))
+            {
+                break;
+            }
+            count++;
+        }
+        if (count == 0)
+        {
+            GST_WARNING_OBJECT(sink, "could not map buffer, dropping it");
+            done++;
+            continue;
+        }
+
+        sendPackets(sink, pkts, count);
+        for (int i = 0; i < count; i++)
+        {
+            unmapPacket(&pkts[i]);
+        }
+        done += count;
+    }
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn render(GstBaseSink *base, GstBuffer *buf)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)base;
+    batch_packet_t pkt;
+
+    if (!mapPacket(buf, &pkt))
+    {
+        GST_WARNING_OBJECT(sink, "could not map buffer, dropping it");
+        return GST_FLOW_OK;
+    }
+    sendOne(sink, &pkt);
+    unmapPacket(&pkt);
+    return GST_FLOW_OK;
+}
+
+static gboolean start(GstBaseSink *base)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)base;
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    char port[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(port, sizeof(port), "%d", sink->port);
+    int err = getaddrinfo(sink->host, port, &hints, &res);
+    if (err != 0 || res == NULL)
+    {
+        GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, (NULL), ("cannot resolve %s: %s", sink->host, gai_strerror(err)));
+        return FALSE;
+    }
+
+    sink->fd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    memcpy(&sink->addr, res->ai_addr, res->ai_addrlen);
+    sink->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    if (sink->fd < 0)
+    {
+        GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, (NULL), ("socket: %s", strerror(errno)));
+        return FALSE;
+    }
+
+    // Kernels before 4.18 reject the option outright
+    int segment = 0;
+    socklen_t len = sizeof(segment);
+    sink->gso_active = sink->gso && getsockopt(sink->fd, SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+    sink->have_sendmmsg = true;
+    sink->packets = 0;
+    sink->send_calls = 0;
+    sink->gso_sends = 0;
+    return TRUE;
+}
+
+static gboolean stop(GstBaseSink *base)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)base;
+    if (sink->fd >= 0)
+    {
+        close(sink->fd);
+        sink->fd = -1;
+    }
+    return TRUE;
+}
+
+static void setProperty(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)object;
+    switch (prop_id)
+    {
+    case PROP_HOST:
+        g_free(sink->host);
+        sink->host = g_value_dup_string(value);
+        break;
+    case PROP_PORT:
+        sink->port = g_value_get_int(value);
+        break;
+    case PROP_GSO:
+        sink->gso = g_value_get_boolean(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void getProperty(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)object;
+    switch (prop_id)
+    {
+    case PROP_HOST:
+        g_value_set_string(value, sink->host);
+        break;
+    case PROP_PORT:
+        g_value_set_int(value, sink->port);
+        break;
+    case PROP_GSO:
+        g_value_set_boolean(value, sink->gso);
+        break;
+    case PROP_PACKETS:
+        g_value_set_uint64(value, sink->packets);
+        break;
+    case PROP_SEND_CALLS:
+        g_value_set_uint64(value, sink->send_calls);
+        break;
+    case PROP_GSO_SENDS:
+        g_value_set_uint64(value, sink->gso_sends);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void finalize(GObject *object)
+{
+    FishBatchUdpSink *sink = (FishBatchUdpSink *)object;
+    g_free(sink->host);
+    G_OBJECT_CLASS(fish_batch_udp_sink_parent_class)->finalize(object);
+}
+
+static void fish_batch_udp_sink_class_init(FishBatchUdpSinkClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSinkClass *base_class = GST_BASE_SINK_CLASS(klass);
+
+    gobject_class->set_property = setProperty;
+    gobject_class->get_property = getProperty;
+    gobject_class->finalize = finalize;
+
+    GParamFlags rw = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    GParamFlags ro = (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    g_object_class_install_property(gobject_class, PROP_HOST,
+                                    g_param_spec_string("host", "Host", "Destination address", "127.0.0.1", rw));
+    g_object_class_install_property(gobject_class, PROP_PORT,
+                                    g_param_spec_int("port", "Port", "Destination port", 0, 65535, 5004, rw));
+    g_object_class_install_property(gobject_class, PROP_GSO,
+                                    g_param_spec_boolean("gso", "GSO", "Use UDP GSO where the kernel supports it", TRUE, rw));
+    g_object_class_install_property(gobject_class, PROP_PACKETS,
+                                    g_param_spec_uint64("packets", "Packets", "Packets sent", 0, G_MAXUINT64, 0, ro));
+    g_object_class_install_property(gobject_class, PROP_SEND_CALLS,
+                                    g_param_spec_uint64("send-calls", "Send calls", "System calls used to send them", 0, G_MAXUINT64, 0, ro));
+    g_object_class_install_property(gobject_class, PROP_GSO_SENDS,
+                                    g_param_spec_uint64("gso-sends", "GSO sends", "Send calls that used GSO", 0, G_MAXUINT64, 0, ro));
+
+    gst_element_class_set_static_metadata(element_class, "Batched UDP sink", "Sink/Network",
+                                          "Sends buffer lists with sendmmsg and UDP GSO", "Nemo");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+    base_class->start = start;
+    base_class->stop = stop;
+    base_class->render = render;
+    base_class->render_list = renderList;
+}
+
+static void fish_batch_udp_sink_init(FishBatchUdpSink *sink)
+{
+    sink->host = g_strdup("127.0.0.1");
+    sink->port = 5004;
+    sink->gso = TRUE;
+    sink->fd = -1;
+    sink->addr_len = 0;
+    sink->have_sendmmsg = true;
+    sink->gso_active = false;
+    sink->packets = 0;
+    sink->send_calls = 0;
+    sink->gso_sends = 0;
+}
+
+gboolean registerBatchUdpSink()
+{
+    return gst_element_register(NULL, BATCH_UDP_SINK_NAME, GST_RANK_NONE, fish_batch_udp_sink_get_type());
+}
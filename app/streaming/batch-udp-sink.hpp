@@ -0,0 +1,44 @@
+#ifndef __BATCH_UDP_SINK_HPP__
+#define __BATCH_UDP_SINK_HPP__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <sys/socket.h>
+
+#define BATCH_UDP_SINK_NAME "fishudpsink"
+
+typedef struct
+{
+    GstBaseSink parent;
+
+    gchar *host;
+    gint port;
+    gboolean gso; // Try UDP GSO; cleared at start or on first failure if the kernel lacks it
+
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    bool have_sendmmsg;
+    bool gso_active;
+
+    guint64 packets;    // Datagrams handed to the kernel
+    guint64 send_calls; // System calls used for them
+    guint64 gso_sends;  // Of which were GSO super-packets
+} FishBatchUdpSink;
+
+typedef struct
+{
+    GstBaseSinkClass parent_class;
+} FishBatchUdpSinkClass;
+
+GType fish_batch_udp_sink_get_type(void);
+
+/* Description: Registers BATCH_UDP_SINK_NAME, a unicast UDP sink that sends each buffer
+ *              list with a single sendmmsg(), and runs of equal-sized packets (the
+ *              fragments of one NAL unit) as one UDP GSO write when the kernel supports
+ *              it. It falls back to sendmmsg() without GSO, then to one send per packet.
+ *              Call once after gst_init().
+ */
+gboolean registerBatchUdpSink();
+
+#endif /* __BATCH_UDP_SINK_HPP__ */
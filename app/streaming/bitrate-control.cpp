@@ -0,0 +1,233 @@
+#include "bitrate-control.hpp"
+
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+
+#define RTP_VIDEO_CLOCK_RATE 90000
+#define ABR_INCREASE_REPORTS 3    // Consecutive good reports needed before stepping up
+#define ABR_INCREASE_FACTOR 1.08  // Probe upwards slowly...
+#define ABR_MIN_DECREASE 0.10     // ...but always back off by at least this much
+
+bool readReceiverReport(GstElement *rtpbin, guint ssrc, fish_rtcp_report_t *report)
+{
+    GObject *session = NULL;
+    GValueArray *sources = NULL;
+    bool found = false;
+
+    g_signal_emit_by_name(rtpbin, "get-internal-session", 0, &session);
+    if (session == NULL)
+    {
+        return false;
+    }
+
+    g_object_get(session, "sources", &sources, NULL);
+    for (guint i = 0; sources != NULL && i < sources->n_values && !found; i++)
+    {
+        GObject *source = (GObject *)g_value_get_object(g_value_array_get_nth(sources, i));
+        GstStructure *stats = NULL;
+        gboolean have_rb = FALSE;
+        guint rb_ssrc = 0;
+
+        g_object_get(source, "stats", &stats, NULL);
+        if (stats == NULL)
+        {
+            continue;
+        }
+
+        // Report blocks about our stream name our SSRC, whichever source carried them
+        if (gst_structure_get_boolean(stats, "have-rb", &have_rb) && have_rb &&
+            gst_structure_get_uint(stats, "rb-ssrc", &rb_ssrc) && rb_ssrc == ssrc)
+        {
+            gst_structure_get_uint(stats, "rb-fractionlost", &report->fraction_lost);
+            gst_structure_get_uint(stats, "rb-jitter", &report->jitter);
+            gst_structure_get_uint(stats, "rb-exthighestseq", &report->ext_highest_seq);
+            gst_structure_get_uint(stats, "rb-round-trip", &report->round_trip);
+            found = true;
+        }
+        gst_structure_free(stats);
+    }
+
+    if (sources != NULL)
+    {
+        g_value_array_free(sources);
+    }
+    g_object_unref(session);
+
+    return found;
+}
+
+/* Drops frames ahead of the encoder so the remaining ones get more bits each */
+static GstPadProbeReturn frameSkipProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_bitrate_ctrl_t *ctrl = (fish_bitrate_ctrl_t *)user_data;
+    uint32_t skip = ctrl->frame_skip.load();
+
+    if (skip > 1 && (ctrl->frame_count++ % skip) != 0)
+    {
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void setBitrate(fish_bitrate_ctrl_t *ctrl, uint32_t bitrate_kbps)
+{
+    ctrl->bitrate_kbps = bitrate_kbps;
+    if (ctrl->hw_encoder)
+    {
+        g_object_set(ctrl->encoder, "bitrate", (guint)(bitrate_kbps * 1000), NULL);
+    }
+    else
+    {
+        g_object_set(ctrl->encoder, "bitrate", (guint)bitrate_kbps, NULL);
+    }
+}
+
+fish_error_t setupBitrateControl(fish_bitrate_ctrl_t *ctrl, GstElement *pipeline,
+                                 const fish_stream_config_t *config, guint ssrc)
+{
+    ctrl->rtpbin = NULL;
+    ctrl->encoder = NULL;
+    ctrl->encoder_sink = NULL;
+    ctrl->skip_probe = 0;
+
+    if (!config->abr_enabled)
+    {
+        return FISH_EPERM;
+    }
+    if (config->abr_min_kbps == 0 || config->abr_min_kbps > config->abr_max_kbps)
+    {
+        printf("Invalid ABR range %u-%u kbit/s\n", config->abr_min_kbps, config->abr_max_kbps);
+        return FISH_EINVAL;
+    }
+
+    ctrl->rtpbin = gst_bin_get_by_name(GST_BIN(pipeline), "rtpbin");
+    ctrl->encoder = gst_bin_get_by_name(GST_BIN(pipeline), "encoder");
+    if (ctrl->rtpbin == NULL || ctrl->encoder == NULL)
+    {
+        printf("ABR needs elements named rtpbin and encoder\n");
+        teardownBitrateControl(ctrl);
+        return FISH_EINVAL;
+    }
+
+    // Without an RTCP receive leg no receiver report ever arrives and ABR would do nothing
+    GstPad *rtcp_sink = gst_element_get_static_pad(ctrl->rtpbin, "recv_rtcp_sink_0");
+    bool receiving = (rtcp_sink != NULL && gst_pad_is_linked(rtcp_sink));
+    if (rtcp_sink != NULL)
+    {
+        gst_object_unref(rtcp_sink);
+    }
+    if (!receiving)
+    {
+        printf("ABR needs incoming RTCP, but nothing feeds rtpbin.recv_rtcp_sink_0\n");
+        teardownBitrateControl(ctrl);
+        return FISH_EINVAL;
+    }
+
+    GstElementFactory *factory = gst_element_get_factory(ctrl->encoder);
+    ctrl->hw_encoder = (strncmp(GST_OBJECT_NAME(factory), "nvv4l2", 6) == 0);
+    ctrl->ssrc = ssrc;
+    ctrl->config = config;
+    ctrl->frame_skip = 1;
+    ctrl->frame_count = 0;
+    ctrl->last_report_seq = 0;
+    ctrl->good_reports = 0;
+    ctrl->last_decrease_us = g_get_monotonic_time();
+
+    ctrl->encoder_sink = gst_element_get_static_pad(ctrl->encoder, "sink");
+    ctrl->skip_probe = gst_pad_add_probe(ctrl->encoder_sink, GST_PAD_PROBE_TYPE_BUFFER,
+                                         frameSkipProbe, ctrl, NULL);
+
+    setBitrate(ctrl, std::min(std::max(config->abr_start_kbps, config->abr_min_kbps), config->abr_max_kbps));
+    printf(">> ABR enabled, %u kbit/s (%u-%u)\n", ctrl->bitrate_kbps, config->abr_min_kbps, config->abr_max_kbps);
+
+    return FISH_EOK;
+}
+
+void updateBitrateControl(fish_bitrate_ctrl_t *ctrl)
+{
+    const fish_stream_config_t *config = ctrl->config;
+    fish_rtcp_report_t report;
+
+    if (!readReceiverReport(ctrl->rtpbin, ctrl->ssrc, &report) || report.ext_highest_seq == ctrl->last_report_seq)
+    {
+        return;
+    }
+    ctrl->last_report_seq = report.ext_highest_seq;
+
+    double loss = report.fraction_lost / 256.0;
+    double jitter_ms = 1000.0 * report.jitter / RTP_VIDEO_CLOCK_RATE;
+    gint64 now_us = g_get_monotonic_time();
+    uint32_t bitrate_kbps = ctrl->bitrate_kbps;
+    uint32_t frame_skip = ctrl->frame_skip.load();
+
+    if (loss * 100 >= config->abr_loss_high_pct || jitter_ms >= config->abr_jitter_high_ms)
+    {
+        // Congested: cut bitrate in proportion to the loss, then start skipping frames
+        ctrl->good_reports = 0;
+        ctrl->last_decrease_us = now_us;
+        if (bitrate_kbps > config->abr_min_kbps)
+        {
+            double factor = 1.0 - std::max(loss / 2, ABR_MIN_DECREASE);
+            bitrate_kbps = std::max((uint32_t)(bitrate_kbps * factor), config->abr_min_kbps);
+        }
+        else if (frame_skip < config->abr_max_frame_skip)
+        {
+            frame_skip = std::min(frame_skip * 2, config->abr_max_frame_skip);
+        }
+    }
+    else if (loss * 100 <= config->abr_loss_low_pct)
+    {
+        // Clean: after a few good reports and the hold time, undo frame skipping first
+        ctrl->good_reports++;
+        if (ctrl->good_reports >= ABR_INCREASE_REPORTS &&
+            now_us - ctrl->last_decrease_us >= (gint64)config->abr_hold_ms * 1000)
+        {
+            ctrl->good_reports = 0;
+            if (frame_skip > 1)
+            {
+                frame_skip /= 2;
+            }
+            else if (bitrate_kbps < config->abr_max_kbps)
+            {
+                bitrate_kbps = std::min((uint32_t)(bitrate_kbps * ABR_INCREASE_FACTOR) + 1, config->abr_max_kbps);
+            }
+        }
+    }
+    else
+    {
+        // Between the thresholds: hold steady
+        ctrl->good_reports = 0;
+    }
+
+    if (bitrate_kbps != ctrl->bitrate_kbps || frame_skip != ctrl->frame_skip.load())
+    {
+        setBitrate(ctrl, bitrate_kbps);
+        ctrl->frame_skip = frame_skip;
+        printf(">> ABR: loss %.1f%%, jitter %.1fms -> %u kbit/s, encoding 1/%u frames\n",
+               loss * 100, jitter_ms, bitrate_kbps, frame_skip);
+    }
+}
+
+void teardownBitrateControl(fish_bitrate_ctrl_t *ctrl)
+{
+    if (ctrl->encoder_sink != NULL)
+    {
+        if (ctrl->skip_probe != 0)
+        {
+            gst_pad_remove_probe(ctrl->encoder_sink, ctrl->skip_probe);
+        }
+        gst_object_unref(ctrl->encoder_sink);
+        ctrl->encoder_sink = NULL;
+    }
+    if (ctrl->encoder != NULL)
+    {
+        gst_object_unref(ctrl->encoder);
+        ctrl->encoder = NULL;
+    }
+    if (ctrl->rtpbin != NULL)
+    {
+        gst_object_unref(ctrl->rtpbin);
+        ctrl->rtpbin = NULL;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef __BITRATE_CONTROL_HPP__
+#define __BITRATE_CONTROL_HPP__
+
+#include <gst/gst.h>
+#include <atomic>
+
+#include "../common/fish_types.h"
+
+/* Loss and jitter the remote end reported for one of our SSRCs */
+typedef struct
+{
+    guint fraction_lost; // Fraction of packets lost since the last report, out of 256
+    guint jitter;        // Interarrival jitter in RTP clock units
+    guint ext_highest_seq;
+    guint round_trip; // Round trip time in 1/65536 s
+} fish_rtcp_report_t;
+
+typedef struct
+{
+    GstElement *rtpbin;
+    GstElement *encoder;
+    GstPad *encoder_sink;
+    gulong skip_probe;
+    bool hw_encoder; // nvv4l2h264enc takes bit/s, x264enc takes kbit/s
+    guint ssrc;
+    const fish_stream_config_t *config;
+
+    uint32_t bitrate_kbps;
+    std::atomic<uint32_t> frame_skip; // Encode 1 of every frame_skip frames
+    uint32_t frame_count;
+    guint last_report_seq;
+    uint32_t good_reports;
+    gint64 last_decrease_us;
+} fish_bitrate_ctrl_t;
+
+/* Description: Finds the rtpbin and encoder (named "rtpbin" and "encoder") in pipeline and
+ *              sets the starting bitrate. rtpbin must receive RTCP on session 0, see
+ *              connectRtcpFeedback(). Returns FISH_EPERM if ABR is disabled in config.
+ */
+fish_error_t setupBitrateControl(fish_bitrate_ctrl_t *ctrl, GstElement *pipeline,
+                                 const fish_stream_config_t *config, guint ssrc);
+
+/* Description: Checks rtpbin for a new RTCP receiver report and adjusts the encoder
+ *              bitrate, and the frame skip once the bitrate is at the floor. Call
+ *              periodically from the thread that owns the pipeline.
+ */
+void updateBitrateControl(fish_bitrate_ctrl_t *ctrl);
+
+/* Description: Finds the latest receiver report block rtpbin holds about ssrc. Returns
+ *              false if none has arrived yet.
+ */
+bool readReceiverReport(GstElement *rtpbin, guint ssrc, fish_rtcp_report_t *report);
+
+/* Description: Removes the frame skip probe and drops element references. */
+void teardownBitrateControl(fish_bitrate_ctrl_t *ctrl);
+
+#endif /* __BITRATE_CONTROL_HPP__ */
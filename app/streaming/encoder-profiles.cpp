@@ -0,0 +1,84 @@
+#include "encoder-profiles.hpp"
+
+#include <string.h>
+
+static const fish_encoder_profile_t encoder_profiles[] = {
+    // Original settings: constant quality, periodic IDRs, frame-threaded
+    {"legacy", "1", true, false, false, 0, 0},
+    // Frame-sliced threads, one-frame latency, short GOP and a tight VBV
+    {"sliced", "ultrafast", false, true, false, 60, 200},
+    // As sliced, but intra refresh replaces IDR frames so bitrate has no keyframe spikes
+    {"intra-refresh", "ultrafast", false, true, true, 30, 100},
+    // Better compression for links with headroom, at the cost of a longer VBV
+    {"balanced", "superfast", false, true, false, 120, 500},
+};
+
+#define NUM_ENCODER_PROFILES (int)(sizeof(encoder_profiles) / sizeof(encoder_profiles[0]))
+
+int findEncoderProfile(const char *name)
+{
+    for (int i = 0; name != NULL && i < NUM_ENCODER_PROFILES; i++)
+    {
+        if (strcmp(encoder_profiles[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const fish_encoder_profile_t *getEncoderProfile(int index)
+{
+    if (index < 0 || index >= NUM_ENCODER_PROFILES)
+    {
+        return NULL;
+    }
+    return &encoder_profiles[index];
+}
+
+std::string x264EncoderDesc(const fish_stream_config_t *config, int profile_index, const char *element_name)
+{
+    const fish_encoder_profile_t *profile = getEncoderProfile(profile_index);
+    if (profile == NULL)
+    {
+        profile = &encoder_profiles[0];
+    }
+
+    std::string desc = "x264enc name=";
+    desc += element_name;
+    desc += " tune=zerolatency speed-preset=";
+    desc += profile->speed_preset;
+    desc += " dct8x8=true";
+
+    if (profile->constant_quality)
+    {
+        desc += " quantizer=23 pass=qual";
+    }
+    else
+    {
+        desc += " pass=cbr bitrate=" + std::to_string(config->abr_start_kbps);
+    }
+
+    if (profile->sliced_threads)
+    {
+        desc += " sliced-threads=true";
+    }
+    if (profile->intra_refresh)
+    {
+        desc += " intra-refresh=true";
+    }
+    if (profile->key_int_max != 0)
+    {
+        desc += " key-int-max=" + std::to_string(profile->key_int_max);
+    }
+    if (profile->vbv_buf_ms != 0)
+    {
+        desc += " vbv-buf-capacity=" + std::to_string(profile->vbv_buf_ms);
+    }
+    if (config->encoder_threads != 0)
+    {
+        desc += " threads=" + std::to_string(config->encoder_threads);
+    }
+
+    return desc;
+}
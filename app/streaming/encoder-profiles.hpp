@@ -0,0 +1,32 @@
+#ifndef __ENCODER_PROFILES_HPP__
+#define __ENCODER_PROFILES_HPP__
+
+#include <string>
+
+#include "../common/fish_types.h"
+
+/* Rate control and threading settings for the x264enc software encoder */
+typedef struct
+{
+    const char *name;
+    const char *speed_preset;
+    bool constant_quality; // quantizer=23 pass=qual instead of CBR at the configured bitrate
+    bool sliced_threads;   // Split each frame across threads instead of pipelining frames
+    bool intra_refresh;    // Spread intra blocks over key_int_max frames instead of sending IDRs
+    uint32_t key_int_max;  // Frames between keyframes (or refresh waves), 0 for the x264 default
+    uint32_t vbv_buf_ms;   // VBV buffer in milliseconds, 0 for the x264 default
+} fish_encoder_profile_t;
+
+/* Description: Returns the index of the named profile, or -1 if there is none. */
+int findEncoderProfile(const char *name);
+
+/* Description: Returns the profile at index, or NULL if out of range. */
+const fish_encoder_profile_t *getEncoderProfile(int index);
+
+/* Description: Builds the launch-string x264enc element for the profile selected in
+ *              config, named element_name. CBR profiles start at config->abr_start_kbps
+ *              and are limited to config->encoder_threads threads when non-zero.
+ */
+std::string x264EncoderDesc(const fish_stream_config_t *config, int profile_index, const char *element_name);
+
+#endif /* __ENCODER_PROFILES_HPP__ */
@@ -0,0 +1,139 @@
+#include "fec-control.hpp"
+#include "bitrate-control.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+
+#define FEC_LOSS_FACTOR 3   // Overhead per percent of loss; bursts need well above 1:1
+#define FEC_DECAY_REPORTS 4 // Close 1/N of the gap per report when loss drops
+#define FEC_REPORT_US (5 * G_USEC_PER_SEC)
+
+static std::string fecEncoderName(int layer)
+{
+    return (layer == 0) ? "fec_enc" : "fec_enc_" + std::to_string(layer);
+}
+
+std::string fecEncoderDesc(const fish_stream_config_t *config, int layer)
+{
+    if (config->fec_pct == 0)
+    {
+        return "";
+    }
+
+    // multipacket protects every packet of a frame together, which is what video needs
+    std::string desc;
+    desc += " ! rtpulpfecenc name=" + fecEncoderName(layer) + " pt=" + std::to_string(FISH_ULPFEC_PT) +
+            " percentage=" + std::to_string(config->fec_pct) + " multipacket=true";
+    return desc;
+}
+
+std::string fecCodecsJson(const fish_stream_config_t *config)
+{
+    if (config->fec_pct == 0)
+    {
+        return "";
+    }
+
+    return ", {\"mimeType\": \"video/ulpfec\", \"payloadType\": " + std::to_string(FISH_ULPFEC_PT) +
+           ", \"clockRate\": 90000}";
+}
+
+fish_error_t setupFecControl(fish_fec_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    ctrl->num_encoders = 0;
+    ctrl->rtpbin = NULL;
+    ctrl->config = config;
+    ctrl->report_us = g_get_monotonic_time();
+    if (config->fec_pct == 0)
+    {
+        return FISH_EPERM;
+    }
+
+    for (int i = 0; i < MAX_FEC_ENCODERS; i++)
+    {
+        GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), fecEncoderName(i).c_str());
+        if (encoder == NULL)
+        {
+            continue;
+        }
+
+        int n = ctrl->num_encoders++;
+        ctrl->encoders[n] = encoder;
+        ctrl->ssrcs[n] = FISH_VIDEO_SSRC + i; // Same numbering as the simulcast layers
+        ctrl->last_report_seq[n] = 0;
+        ctrl->percentage[n] = config->fec_pct;
+        ctrl->loss_pct[n] = 0;
+    }
+
+    if (ctrl->num_encoders == 0)
+    {
+        return FISH_EPERM;
+    }
+
+    ctrl->rtpbin = gst_bin_get_by_name(GST_BIN(pipeline), "rtpbin");
+    printf(">> ULPFEC on %d stream(s), %u-%u%% overhead\n", ctrl->num_encoders, config->fec_pct,
+           std::max(config->fec_pct, config->fec_max_pct));
+    return FISH_EOK;
+}
+
+void updateFecControl(fish_fec_ctrl_t *ctrl)
+{
+    uint32_t min_pct = ctrl->config->fec_pct;
+    uint32_t max_pct = std::max(ctrl->config->fec_pct, ctrl->config->fec_max_pct);
+
+    for (int i = 0; i < ctrl->num_encoders && ctrl->rtpbin != NULL; i++)
+    {
+        fish_rtcp_report_t report;
+        if (!readReceiverReport(ctrl->rtpbin, ctrl->ssrcs[i], &report) ||
+            report.ext_highest_seq == ctrl->last_report_seq[i])
+        {
+            continue;
+        }
+        ctrl->last_report_seq[i] = report.ext_highest_seq;
+
+        // The report counts wire loss, before the SFU or the viewer repaired anything
+        ctrl->loss_pct[i] = report.fraction_lost * 100 / 256;
+        uint32_t target = std::min(std::max(min_pct, ctrl->loss_pct[i] * FEC_LOSS_FACTOR), max_pct);
+        uint32_t percentage = ctrl->percentage[i];
+        if (target > percentage)
+        {
+            percentage = target;
+        }
+        else if (target < percentage)
+        {
+            percentage -= std::max((percentage - target) / FEC_DECAY_REPORTS, (uint32_t)1);
+        }
+
+        if (percentage != ctrl->percentage[i])
+        {
+            ctrl->percentage[i] = percentage;
+            g_object_set(ctrl->encoders[i], "percentage", (guint)percentage, NULL);
+        }
+    }
+
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - ctrl->report_us < FEC_REPORT_US)
+    {
+        return;
+    }
+    ctrl->report_us = now_us;
+
+    for (int i = 0; i < ctrl->num_encoders; i++)
+    {
+        printf(">> FEC ssrc %u: %u%% overhead at %u%% loss\n", ctrl->ssrcs[i], ctrl->percentage[i], ctrl->loss_pct[i]);
+    }
+}
+
+void teardownFecControl(fish_fec_ctrl_t *ctrl)
+{
+    for (int i = 0; i < ctrl->num_encoders; i++)
+    {
+        gst_object_unref(ctrl->encoders[i]);
+    }
+    ctrl->num_encoders = 0;
+    if (ctrl->rtpbin != NULL)
+    {
+        gst_object_unref(ctrl->rtpbin);
+        ctrl->rtpbin = NULL;
+    }
+}
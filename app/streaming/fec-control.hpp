@@ -0,0 +1,53 @@
+#ifndef __FEC_CONTROL_HPP__
+#define __FEC_CONTROL_HPP__
+
+#include <gst/gst.h>
+#include <string>
+
+#include "../common/fish_types.h"
+
+#define FISH_ULPFEC_PT 117 // ULPFEC (RFC 5109) packets, next to H.264 on the same SSRC
+#define MAX_FEC_ENCODERS 3 // One per simulcast layer
+
+typedef struct
+{
+    GstElement *rtpbin;
+    GstElement *encoders[MAX_FEC_ENCODERS];
+    guint ssrcs[MAX_FEC_ENCODERS];
+    guint last_report_seq[MAX_FEC_ENCODERS];
+    uint32_t percentage[MAX_FEC_ENCODERS];
+    uint32_t loss_pct[MAX_FEC_ENCODERS]; // From the latest receiver report
+    int num_encoders;
+    const fish_stream_config_t *config;
+    gint64 report_us;
+} fish_fec_ctrl_t;
+
+/* Description: Builds the launch-string fragment that adds ULPFEC to one RTP stream. It
+ *              goes right after the payloader of the given layer. H.264 packets keep their
+ *              payload type and payload, so the SFU still sees keyframes; FEC packets are
+ *              interleaved with their own payload type. Returns an empty string when FEC is off.
+ */
+std::string fecEncoderDesc(const fish_stream_config_t *config, int layer);
+
+/* Description: Builds the ULPFEC entry appended to the producer's "codecs" array,
+ *              starting with a comma. Returns an empty string when FEC is off.
+ *              mediasoup refuses a producer with a codec its router does not have, so
+ *              --fec needs video/ulpfec (clockRate 90000) in the router's mediaCodecs.
+ */
+std::string fecCodecsJson(const fish_stream_config_t *config);
+
+/* Description: Finds the FEC encoders in pipeline. Returns FISH_EPERM if FEC is off or
+ *              there are none, e.g. in the load generator.
+ */
+fish_error_t setupFecControl(fish_fec_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Sets the FEC overhead of each layer from the loss in its latest receiver
+ *              report, between config->fec_pct and config->fec_max_pct, and prints it every
+ *              few seconds. Call periodically from the thread that owns the pipeline.
+ */
+void updateFecControl(fish_fec_ctrl_t *ctrl);
+
+/* Description: Drops element references. */
+void teardownFecControl(fish_fec_ctrl_t *ctrl);
+
+#endif /* __FEC_CONTROL_HPP__ */
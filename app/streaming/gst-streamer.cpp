@@ -1,10 +1,15 @@
 #include "gst-streamer.hpp"
 #include "../fishStream/fishGST.hpp"
+#include "simulcast.hpp"
+#include "fec-control.hpp"
+#include "video-source.hpp"
 
-// TODO: remove
-#if defined(__aarch64__)
-#define JETSON_TARGET
-#endif
+/* True when anything writes to frames, which needs them in system memory: a frame
+ * processor, the HUD or the latency stamp */
+static bool processingEnabled(const fish_stream_config_t *config)
+{
+    return config->underwater || config->stabilize || config->hud || config->latency_stamp;
+}
 
 void runVideoService(fish_handle_t *handle)
 {
@@ -23,6 +28,14 @@ void runVideoService(fish_handle_t *handle)
     const char *username = handle->username;
     const char *password = handle->password;
 
+    /* Fail before touching the server if the source cannot run on this machine */
+    int source = selectVideoSource(&handle->stream_config);
+    if (source < 0)
+    {
+        printf("Error: no usable video source\n");
+        return;
+    }
+
     err = checkRoom(server_url, room_id);
     if (err != FISH_EOK)
     {
@@ -91,7 +104,9 @@ void runVideoService(fish_handle_t *handle)
     }
 
     err = createMediasoupProducerVideo(server_url, room_id, handle->token, handle->broadcaster_id,
-                                       video_transport_id);
+                                       video_transport_id,
+                                       simulcastEncodingsJson(&handle->stream_config, handle->curr_video_profile),
+                                       fecCodecsJson(&handle->stream_config));
     if (err != FISH_EOK)
     {
         printf("Error: could not create MS video producer\n");
@@ -103,34 +118,34 @@ void runVideoService(fish_handle_t *handle)
         return;
     }
 
-// Only use csi2 function if running on Jetson, otherwise use regular webcam
-#if defined(JETSON_TARGET)
-
-    err = createCSI2Stream(video_transport_ip, video_transport_port, video_transport_rtcp_port);
-    if (err != FISH_EOK)
+    if (source == FISH_SOURCE_FILE && handle->stream_config.file_passthrough)
     {
-        printf("Error: could not create CSI2 gstream\n");
-        err = cleanupBroadcaster(server_url, room_id, handle->token, handle->broadcaster_id);
-        if (err != FISH_EOK)
+        if (processingEnabled(&handle->stream_config))
         {
-            printf("Failed to cleanup broadcaster\n");
+            printf("Pass-through frames are never decoded, ignoring options that draw on or process them\n");
         }
+        err = streamH264File(handle, video_transport_ip, video_transport_port, video_transport_rtcp_port,
+                             audio_transport_ip, audio_transport_port, audio_transport_rtcp_port, handle->stream_config.file);
+    }
+    else if (processingEnabled(&handle->stream_config))
+    {
+        err = createProcessedStream(handle, source, video_transport_ip, video_transport_port, video_transport_rtcp_port,
+                                    audio_transport_ip, audio_transport_port, audio_transport_rtcp_port);
+    }
+    else
+    {
+        err = createVideoStream(handle, source, video_transport_ip, video_transport_port, video_transport_rtcp_port,
+                                audio_transport_ip, audio_transport_port, audio_transport_rtcp_port);
     }
-
-#else
-    // TODO: remove
-    // This is just used for testing purposes
-    err = videoStreamFile(video_transport_ip, video_transport_port, video_transport_rtcp_port, "/media/test.mp4");
     if (err != FISH_EOK)
     {
-        printf("Error: could not create webcam gstream\n");
+        printf("Error: could not create video gstream\n");
         err = cleanupBroadcaster(server_url, room_id, handle->token, handle->broadcaster_id);
         if (err != FISH_EOK)
         {
             printf("Failed to cleanup broadcaster\n");
         }
     }
-#endif
 
     err = cleanupBroadcaster(server_url, room_id, handle->token, handle->broadcaster_id);
     if (err != FISH_EOK)
@@ -0,0 +1,161 @@
+#include "latency-guard.hpp"
+
+#include <stdio.h>
+
+#define LATENCY_REPORT_US (5 * G_USEC_PER_SEC)
+
+static const char *guarded_queue_names[MAX_GUARDED_QUEUES] = {
+    "encode_queue", "layer_queue_0", "layer_queue_1", "layer_queue_2", "send_queue"};
+
+static const char *guarded_encoder_names[MAX_GUARDED_ENCODERS] = {
+    "encoder", "encoder_1", "encoder_2"};
+
+static void queueOverrun(GstElement *queue, gpointer user_data)
+{
+    fish_guarded_queue_t *entry = (fish_guarded_queue_t *)user_data;
+    entry->overruns++;
+}
+
+/* Live sources stamp buffers with the running time they were captured at, so the
+ * age of a frame is the current running time minus its PTS. */
+static GstPadProbeReturn staleFrameProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_latency_guard_t *guard = (fish_latency_guard_t *)user_data;
+    GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    GstClock *clock = gst_element_get_clock(guard->pipeline);
+    if (clock == NULL || !GST_CLOCK_TIME_IS_VALID(pts))
+    {
+        if (clock != NULL)
+        {
+            gst_object_unref(clock);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(guard->pipeline);
+    gst_object_unref(clock);
+
+    if (now > pts && now - pts > guard->stale_ns)
+    {
+        guard->stale_drops++;
+        return GST_PAD_PROBE_DROP;
+    }
+
+    guard->fresh_frames++;
+    return GST_PAD_PROBE_OK;
+}
+
+std::string leakyQueueDesc(const std::string &name, uint32_t max_ms)
+{
+    return "queue name=" + name + " max-size-buffers=0 max-size-bytes=0 max-size-time=" +
+           std::to_string((guint64)max_ms * GST_MSECOND) + " leaky=downstream";
+}
+
+fish_error_t setupLatencyGuard(fish_latency_guard_t *guard, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    guard->pipeline = pipeline;
+    guard->num_queues = 0;
+    guard->num_encoders = 0;
+    guard->stale_ns = (GstClockTime)config->stale_frame_ms * GST_MSECOND;
+    guard->stale_drops = 0;
+    guard->fresh_frames = 0;
+    guard->report_us = g_get_monotonic_time();
+
+    for (int i = 0; i < MAX_GUARDED_QUEUES; i++)
+    {
+        GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), guarded_queue_names[i]);
+        if (queue == NULL)
+        {
+            continue;
+        }
+
+        fish_guarded_queue_t *entry = &guard->queues[guard->num_queues++];
+        entry->queue = queue;
+        entry->overruns = 0;
+        entry->max_depth = 0;
+        entry->overrun_handler = g_signal_connect(queue, "overrun", G_CALLBACK(queueOverrun), entry);
+    }
+
+    for (int i = 0; i < MAX_GUARDED_ENCODERS && guard->stale_ns > 0; i++)
+    {
+        GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), guarded_encoder_names[i]);
+        if (encoder == NULL)
+        {
+            continue;
+        }
+
+        GstPad *sink = gst_element_get_static_pad(encoder, "sink");
+        gst_object_unref(encoder);
+        if (sink == NULL)
+        {
+            continue;
+        }
+
+        guard->encoder_sinks[guard->num_encoders] = sink;
+        guard->stale_probes[guard->num_encoders] =
+            gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_BUFFER, staleFrameProbe, guard, NULL);
+        guard->num_encoders++;
+    }
+
+    printf(">> Latency guard: %d leaky queues, stale frame limit %ums on %d encoders\n",
+           guard->num_queues, config->stale_frame_ms, guard->num_encoders);
+    return FISH_EOK;
+}
+
+void updateLatencyGuard(fish_latency_guard_t *guard)
+{
+    for (int i = 0; i < guard->num_queues; i++)
+    {
+        guint depth = 0;
+        g_object_get(guard->queues[i].queue, "current-level-buffers", &depth, NULL);
+        if (depth > guard->queues[i].max_depth)
+        {
+            guard->queues[i].max_depth = depth;
+        }
+    }
+
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - guard->report_us < LATENCY_REPORT_US)
+    {
+        return;
+    }
+    guard->report_us = now_us;
+
+    for (int i = 0; i < guard->num_queues; i++)
+    {
+        fish_guarded_queue_t *entry = &guard->queues[i];
+        guint depth = 0;
+        guint64 level_ns = 0;
+        g_object_get(entry->queue, "current-level-buffers", &depth, "current-level-time", &level_ns, NULL);
+
+        printf(">> Queue %s: %u buffers (%.1fms), max %u, overruns %llu\n",
+               GST_ELEMENT_NAME(entry->queue), depth, (double)level_ns / GST_MSECOND, entry->max_depth,
+               (unsigned long long)entry->overruns.load());
+        entry->max_depth = 0;
+    }
+
+    if (guard->num_encoders > 0)
+    {
+        printf(">> Stale frames dropped before encoding: %llu of %llu\n",
+               (unsigned long long)guard->stale_drops.load(),
+               (unsigned long long)(guard->stale_drops.load() + guard->fresh_frames.load()));
+    }
+}
+
+void teardownLatencyGuard(fish_latency_guard_t *guard)
+{
+    for (int i = 0; i < guard->num_encoders; i++)
+    {
+        gst_pad_remove_probe(guard->encoder_sinks[i], guard->stale_probes[i]);
+        gst_object_unref(guard->encoder_sinks[i]);
+    }
+    guard->num_encoders = 0;
+
+    for (int i = 0; i < guard->num_queues; i++)
+    {
+        g_signal_handler_disconnect(guard->queues[i].queue, guard->queues[i].overrun_handler);
+        gst_object_unref(guard->queues[i].queue);
+    }
+    guard->num_queues = 0;
+}
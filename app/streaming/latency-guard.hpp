@@ -0,0 +1,55 @@
+#ifndef __LATENCY_GUARD_HPP__
+#define __LATENCY_GUARD_HPP__
+
+#include <gst/gst.h>
+#include <atomic>
+#include <string>
+
+#include "../common/fish_types.h"
+
+#define MAX_GUARDED_QUEUES 5   // encode_queue, layer_queue_0..2 and send_queue
+#define MAX_GUARDED_ENCODERS 3 // encoder, encoder_1 and encoder_2
+
+typedef struct
+{
+    GstElement *queue;
+    gulong overrun_handler;
+    std::atomic<uint64_t> overruns; // Times the queue was full and leaked its oldest buffers
+    uint32_t max_depth;             // Deepest level seen at a tick, in buffers
+} fish_guarded_queue_t;
+
+typedef struct
+{
+    GstElement *pipeline;
+    fish_guarded_queue_t queues[MAX_GUARDED_QUEUES];
+    int num_queues;
+
+    GstPad *encoder_sinks[MAX_GUARDED_ENCODERS];
+    gulong stale_probes[MAX_GUARDED_ENCODERS];
+    int num_encoders;
+    GstClockTime stale_ns;            // Drop frames older than this at the encoder, 0 to keep all
+    std::atomic<uint64_t> stale_drops;
+    std::atomic<uint64_t> fresh_frames;
+
+    gint64 report_us;
+} fish_latency_guard_t;
+
+/* Description: Launch-string queue that holds at most max_ms of data and drops the oldest
+ *              buffers when full, so upstream never blocks on it.
+ */
+std::string leakyQueueDesc(const std::string &name, uint32_t max_ms);
+
+/* Description: Watches the leaky queues built by videoSendDesc() and adds a probe in front
+ *              of every encoder that drops frames older than config->stale_frame_ms.
+ */
+fish_error_t setupLatencyGuard(fish_latency_guard_t *guard, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Samples queue depths and prints the counters every few seconds. Call
+ *              periodically from the thread that owns the pipeline.
+ */
+void updateLatencyGuard(fish_latency_guard_t *guard);
+
+/* Description: Removes the probes and signal handlers and drops element references. */
+void teardownLatencyGuard(fish_latency_guard_t *guard);
+
+#endif /* __LATENCY_GUARD_HPP__ */
@@ -0,0 +1,270 @@
+#include "load-gen.hpp"
+#include "../fishStream/fishGST.hpp"
+#include "encoder-profiles.hpp"
+#include "simulcast.hpp"
+#include "video-profiles.hpp"
+
+#include <gst/gst.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+#define LOADGEN_TICK_MS 100
+#define LOADGEN_REPORT_US (5 * G_USEC_PER_SEC)
+
+typedef struct
+{
+    std::string broadcaster_id;
+    std::string transport_ip;
+    std::string transport_port;
+    double signaling_ms[3]; // Broadcaster, transport and producer requests
+    guint64 report_packets;
+    guint64 report_bytes;
+} loadgen_broadcaster_t;
+
+static std::mutex loadgen_mtx;
+static std::vector<loadgen_broadcaster_t> broadcasters;
+static std::atomic<bool> loadgen_running(false);
+static std::atomic<bool> loadgen_stop(false); // Set from the SIGINT handler
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Runs the same signaling flow as runVideoService for one video-only broadcaster */
+static fish_error_t signalBroadcaster(fish_handle_t *handle, const std::string &encodings, loadgen_broadcaster_t *bc)
+{
+    std::string transport_id;
+    std::string transport_rtcp_port;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    fish_error_t err = createBroadcaster(handle->server_url, handle->room_id, handle->token, bc->broadcaster_id);
+    bc->signaling_ms[0] = elapsedMs(start);
+    if (err != FISH_EOK)
+    {
+        return err;
+    }
+
+    start = std::chrono::steady_clock::now();
+    err = createPlainTransportVideo(handle->server_url, handle->room_id, handle->token, bc->broadcaster_id,
+                                    transport_id, bc->transport_ip, bc->transport_port, transport_rtcp_port);
+    bc->signaling_ms[1] = elapsedMs(start);
+    if (err != FISH_EOK)
+    {
+        return err;
+    }
+
+    start = std::chrono::steady_clock::now();
+    err = createMediasoupProducerVideo(handle->server_url, handle->room_id, handle->token, bc->broadcaster_id,
+                                       transport_id, encodings, "");
+    bc->signaling_ms[2] = elapsedMs(start);
+    return err;
+}
+
+/* Encode (or demux) once, payload once, then send every packet to all broadcasters */
+static std::string loadGenDesc(fish_handle_t *handle, const std::string &clients)
+{
+    const fish_stream_config_t *config = &handle->stream_config;
+    std::string desc;
+
+    if (config->file_passthrough)
+    {
+        desc += "filesrc location=\"" + std::string(config->file) + "\" ! qtdemux name=demux demux.video_0 ! queue";
+        desc += " ! h264parse config-interval=-1";
+    }
+    else
+    {
+        const fish_video_profile_t *profile = getVideoProfile(handle->curr_video_profile);
+        desc += "videotestsrc is-live=true pattern=ball";
+        desc += " ! video/x-raw, format=(string)I420, width=(int)" + std::to_string(profile->width) +
+                ", height=(int)" + std::to_string(profile->height) +
+                ", framerate=(fraction)" + std::to_string(profile->fps) + "/1";
+        desc += " ! " + x264EncoderDesc(config, findEncoderProfile(config->encoder_profile), "encoder");
+        desc += " ! h264parse config-interval=-1";
+    }
+
+    desc += " ! rtph264pay ssrc=" + std::to_string(FISH_VIDEO_SSRC) + " pt=100";
+    desc += " ! multiudpsink name=fanout clients=" + clients + (config->file_passthrough ? " sync=true" : " sync=false");
+    return desc;
+}
+
+static void reportLoadGen(GstElement *fanout, double interval_s)
+{
+    guint64 total_packets = 0;
+
+    std::lock_guard<std::mutex> lock(loadgen_mtx);
+    for (size_t i = 0; i < broadcasters.size(); i++)
+    {
+        loadgen_broadcaster_t *bc = &broadcasters[i];
+        GstStructure *stats = NULL;
+        g_signal_emit_by_name(fanout, "get-stats", bc->transport_ip.c_str(), atoi(bc->transport_port.c_str()), &stats);
+        if (stats == NULL)
+        {
+            continue;
+        }
+
+        guint64 packets = 0;
+        guint64 bytes = 0;
+        gst_structure_get_uint64(stats, "packets-sent", &packets);
+        gst_structure_get_uint64(stats, "bytes-sent", &bytes);
+        gst_structure_free(stats);
+
+        printf(">> Broadcaster %zu: %.0f pkt/s, %.0f kbit/s\n", i,
+               (packets - bc->report_packets) / interval_s, (bytes - bc->report_bytes) * 8 / 1000.0 / interval_s);
+        total_packets += packets - bc->report_packets;
+        bc->report_packets = packets;
+        bc->report_bytes = bytes;
+    }
+    printf(">> Load generator total: %.0f pkt/s\n", total_packets / interval_s);
+}
+
+static void runLoadGen(fish_handle_t *handle)
+{
+    fish_stream_config_t config = handle->stream_config;
+    uint32_t count = config.loadgen_broadcasters;
+
+    // One layer per broadcaster, the fan-out carries a single stream
+    config.simulcast_layers = 1;
+    std::string encodings = simulcastEncodingsJson(&config, handle->curr_video_profile);
+
+    if (checkRoom(handle->server_url, handle->room_id) != FISH_EOK ||
+        login(handle->server_url, handle->username, handle->password, handle->token) != FISH_EOK)
+    {
+        printf("Error: load generator could not join ROOM_ID:%s\n", handle->room_id);
+        return;
+    }
+
+    std::string clients;
+    double total_ms = 0.0;
+    double max_ms = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (loadgen_stop)
+        {
+            cleanupLoadGen(handle);
+            return;
+        }
+
+        loadgen_broadcaster_t bc = {};
+        fish_error_t err = signalBroadcaster(handle, encodings, &bc);
+        if (!bc.broadcaster_id.empty())
+        {
+            std::lock_guard<std::mutex> lock(loadgen_mtx);
+            broadcasters.push_back(bc);
+        }
+        if (err != FISH_EOK)
+        {
+            printf("Error: could not signal broadcaster %u\n", i);
+            cleanupLoadGen(handle);
+            return;
+        }
+
+        double signaling_ms = bc.signaling_ms[0] + bc.signaling_ms[1] + bc.signaling_ms[2];
+        total_ms += signaling_ms;
+        if (signaling_ms > max_ms)
+        {
+            max_ms = signaling_ms;
+        }
+        printf(">> Broadcaster %u signaled in %.1fms (broadcaster %.1fms, transport %.1fms, producer %.1fms)\n",
+               i, signaling_ms, bc.signaling_ms[0], bc.signaling_ms[1], bc.signaling_ms[2]);
+
+        clients += (i == 0) ? "\"" : ",";
+        clients += bc.transport_ip + ":" + bc.transport_port;
+    }
+    clients += "\"";
+    printf(">> Signaled %u broadcasters, avg %.1fms, max %.1fms\n", count, count ? total_ms / count : 0.0, max_ms);
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(loadGenDesc(handle, clients).c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Failed to build load generator pipeline: %s\n", error->message);
+        g_error_free(error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        cleanupLoadGen(handle);
+        return;
+    }
+
+    GstElement *fanout = gst_bin_get_by_name(GST_BIN(pipeline), "fanout");
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+    if (config.file_passthrough && config.file_loop)
+    {
+        gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT),
+                         GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    printf(">> Load generator streaming to %u broadcasters\n", count);
+
+    gint64 start_us = g_get_monotonic_time();
+    gint64 report_us = start_us;
+    GstBus *bus = gst_element_get_bus(pipeline);
+    while (!loadgen_stop &&
+           (config.loadgen_seconds == 0 || g_get_monotonic_time() - start_us < (gint64)config.loadgen_seconds * G_USEC_PER_SEC))
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, LOADGEN_TICK_MS * GST_MSECOND,
+                                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS |
+                                                                      GST_MESSAGE_SEGMENT_DONE));
+        if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_SEGMENT_DONE)
+        {
+            gst_message_unref(msg);
+            gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_SEGMENT,
+                             GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+        }
+        else if (msg != NULL)
+        {
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+            {
+                gst_message_parse_error(msg, &error, NULL);
+                printf("Load generator error: %s\n", error->message);
+                g_error_free(error);
+            }
+            gst_message_unref(msg);
+            break;
+        }
+
+        gint64 now_us = g_get_monotonic_time();
+        if (now_us - report_us >= LOADGEN_REPORT_US)
+        {
+            reportLoadGen(fanout, (now_us - report_us) / (double)G_USEC_PER_SEC);
+            report_us = now_us;
+        }
+    }
+
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(fanout);
+    gst_object_unref(pipeline);
+
+    cleanupLoadGen(handle);
+}
+
+void runLoadGenService(fish_handle_t *handle)
+{
+    loadgen_stop = false;
+    loadgen_running = true;
+    runLoadGen(handle);
+    loadgen_running = false;
+}
+
+bool stopLoadGen(void)
+{
+    return loadgen_running && !loadgen_stop.exchange(true);
+}
+
+void cleanupLoadGen(fish_handle_t *handle)
+{
+    std::lock_guard<std::mutex> lock(loadgen_mtx);
+    for (size_t i = 0; i < broadcasters.size(); i++)
+    {
+        cleanupBroadcaster(handle->server_url, handle->room_id, handle->token, broadcasters[i].broadcaster_id);
+    }
+    broadcasters.clear();
+}
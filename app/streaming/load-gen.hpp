@@ -0,0 +1,25 @@
+#ifndef __LOAD_GEN_HPP__
+#define __LOAD_GEN_HPP__
+
+#include "../common/fish_types.h"
+
+/* Description: Signals stream_config.loadgen_broadcasters broadcasters into the room, each
+ *              with its own transport and video producer, and feeds all of them from one
+ *              encoded (or file pass-through) stream fanned out by a multiudpsink. Reports
+ *              signaling latency per broadcaster and packet rates while streaming.
+ */
+void runLoadGenService(fish_handle_t *handle);
+
+/* Description: Asks a running load generator to stop. It deletes its broadcasters and
+ *              returns from runLoadGenService() within a tick. Only sets a flag, so it is
+ *              safe to call from a signal handler. Returns false if no load generator is
+ *              running or it was already asked to stop.
+ */
+bool stopLoadGen(void);
+
+/* Description: Deletes every broadcaster the load generator created. Safe to call more
+ *              than once, but not from a signal handler, as it locks and makes requests.
+ */
+void cleanupLoadGen(fish_handle_t *handle);
+
+#endif /* __LOAD_GEN_HPP__ */
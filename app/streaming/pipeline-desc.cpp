@@ -0,0 +1,225 @@
+#include "pipeline-desc.hpp"
+#include <string.h>
+
+#include "simulcast.hpp"
+#include "video-profiles.hpp"
+#include "latency-guard.hpp"
+#include "recorder.hpp"
+#include "replay-buffer.hpp"
+#include "rtcp-feedback.hpp"
+#include "fec-control.hpp"
+#include "batch-udp-sink.hpp"
+#include "encoder-profiles.hpp"
+#include "../processing/analytics.hpp"
+
+/* True on Jetsons, where scaling and encoding run on nvvidconv and nvv4l2h264enc. Other
+ * machines scale with videoscale and encode with x264. */
+static bool hardwareVideoAvailable()
+{
+    GstElementFactory *factory = gst_element_factory_find("nvv4l2h264enc");
+    if (factory == NULL)
+    {
+        return false;
+    }
+    gst_object_unref(factory);
+    return true;
+}
+
+/* Encoder for one layer. The hardware bitrate is left at the encoder default
+ * unless ABR or simulcast needs to control it. */
+static std::string encoderDesc(const fish_stream_config_t *config, bool hardware, int layer, uint32_t bitrate_kbps)
+{
+    std::string name = (layer == 0) ? "encoder" : "encoder_" + std::to_string(layer);
+    if (!hardware)
+    {
+        // x264 takes kbit/s, and a later bitrate property overrides the profile's start rate
+        std::string desc = x264EncoderDesc(config, findEncoderProfile(config->encoder_profile), name.c_str());
+        if (layer > 0)
+        {
+            desc += " bitrate=" + std::to_string(bitrate_kbps);
+        }
+        return desc;
+    }
+
+    std::string desc = "nvv4l2h264enc name=" + name;
+    desc += " insert-sps-pps=true";
+    if (config->abr_enabled || config->simulcast_layers > 1)
+    {
+        desc += " bitrate=" + std::to_string(bitrate_kbps * 1000);
+    }
+    return desc;
+}
+
+/* RTCP for session 0 in both directions. The receive socket is handed to the sink by
+ * connectRtcpFeedback() once the pipeline is built. */
+static std::string rtcpDesc(std::string video_transport_ip, std::string video_transport_rtcp_port)
+{
+    std::string desc;
+    desc += " rtpbin.send_rtcp_src_0 ! udpsink name=" RTCP_SINK_NAME " host=" + video_transport_ip +
+            " port=" + video_transport_rtcp_port + " sync=false async=false";
+    desc += " udpsrc name=" RTCP_SRC_NAME " port=0 caps=\"application/x-rtcp\" ! rtpbin.recv_rtcp_sink_0";
+    return desc;
+}
+
+/* Sink for the video RTP packets, the only ones sent in large enough bursts to batch */
+static std::string rtpSinkDesc(const fish_stream_config_t *config, std::string video_transport_ip,
+                               std::string video_transport_port)
+{
+    std::string sink = config->udp_batch ? BATCH_UDP_SINK_NAME : "udpsink";
+    return sink + " host=" + video_transport_ip + " port=" + video_transport_port;
+}
+
+std::string h264FileSendDesc(fish_handle_t *handle,
+                             std::string file_name,
+                             std::string video_transport_ip,
+                             std::string video_transport_port,
+                             std::string video_transport_rtcp_port)
+{
+    const fish_stream_config_t *config = &handle->stream_config;
+    std::string desc;
+
+    // No leaky queues here: the file is not live, so back-pressure from the synced
+    // udpsink is what paces it to real time
+    desc += "filesrc location=\"" + file_name + "\" ! qtdemux name=demux demux.video_0 ! queue";
+    desc += " ! h264parse name=file_parse config-interval=-1";
+    desc += " ! rtph264pay ssrc=" + std::to_string(FISH_VIDEO_SSRC) + " pt=100" + fecEncoderDesc(config, 0);
+    desc += " ! rtprtxqueue max-size-time=2000 max-size-packets=0 ! rtpbin.send_rtp_sink_0";
+
+    desc += " rtpbin name=rtpbin rtp-profile=avpf";
+    desc += " rtpbin.send_rtp_src_0 ! " + rtpSinkDesc(config, video_transport_ip, video_transport_port) + " sync=true";
+    desc += rtcpDesc(video_transport_ip, video_transport_rtcp_port);
+
+    return desc;
+}
+
+std::string h264LiveSendDesc(fish_handle_t *handle,
+                             std::string video_transport_ip,
+                             std::string video_transport_port,
+                             std::string video_transport_rtcp_port)
+{
+    const fish_stream_config_t *config = &handle->stream_config;
+    std::string desc;
+
+    // Same tail as a single-layer videoSendDesc(), minus the encoder, so replay,
+    // recording, FEC and pacing all still apply
+    desc += " ! h264parse name=" REPLAY_PARSE_NAME " config-interval=-1" + recordTeeDesc(config);
+    desc += " ! rtph264pay ssrc=" + std::to_string(FISH_VIDEO_SSRC) + " pt=100" + fecEncoderDesc(config, 0);
+    desc += " ! rtprtxqueue max-size-time=2000 max-size-packets=0 ! rtpbin.send_rtp_sink_0";
+    desc += recordBranchDesc(config);
+
+    desc += " rtpbin name=rtpbin rtp-profile=avpf";
+    desc += " rtpbin.send_rtp_src_0 ! " + leakyQueueDesc("send_queue", config->queue_max_ms);
+    desc += " ! " + rtpSinkDesc(config, video_transport_ip, video_transport_port);
+    desc += rtcpDesc(video_transport_ip, video_transport_rtcp_port);
+
+    return desc;
+}
+
+std::string audioSendDesc(fish_handle_t *handle,
+                          std::string audio_transport_ip,
+                          std::string audio_transport_port,
+                          std::string audio_transport_rtcp_port)
+{
+    const fish_stream_config_t *config = &handle->stream_config;
+    std::string desc;
+
+    // Capture in 10 ms periods so a whole Opus frame is ready as soon as it is captured
+    if (strcmp(config->audio_source, "test") == 0)
+    {
+        desc += " audiotestsrc is-live=true wave=sine freq=440 volume=0.1 samplesperbuffer=480";
+    }
+    else if (strcmp(config->audio_source, "alsa") == 0)
+    {
+        desc += " alsasrc device=" + std::string(config->audio_device) + " buffer-time=20000 latency-time=10000";
+    }
+    else
+    {
+        return desc;
+    }
+
+    desc += " ! audioconvert ! audioresample ! audio/x-raw, rate=(int)48000, channels=(int)2";
+    desc += " ! " + leakyQueueDesc("audio_queue", config->queue_max_ms);
+    desc += " ! opusenc name=audio_encoder frame-size=10 bitrate-type=constrained-vbr bitrate=" +
+            std::to_string(config->audio_kbps * 1000);
+    desc += " ! rtpopuspay name=audio_pay ssrc=" + std::to_string(FISH_AUDIO_SSRC) + " pt=100";
+    desc += " ! rtpbin.send_rtp_sink_1";
+
+    // Lip-sync comes from the shared RTCP sender reports, so audio need not wait on the clock
+    desc += " rtpbin.send_rtp_src_1 ! udpsink host=" + audio_transport_ip + " port=" + audio_transport_port +
+            " sync=false async=false";
+    desc += " rtpbin.send_rtcp_src_1 ! udpsink host=" + audio_transport_ip + " port=" + audio_transport_rtcp_port +
+            " sync=false async=false";
+
+    return desc;
+}
+
+std::string videoSendDesc(fish_handle_t *handle,
+                          std::string video_transport_ip,
+                          std::string video_transport_port,
+                          std::string video_transport_rtcp_port)
+{
+    const fish_stream_config_t *config = &handle->stream_config;
+    fish_simulcast_layer_t layers[MAX_SIMULCAST_LAYERS];
+    int num_layers = getSimulcastLayers(config, handle->curr_video_profile, layers);
+    bool hardware = hardwareVideoAvailable();
+    std::string desc = analyticsTeeDesc(config);
+
+    // Scale and drop frames in one stage so profile switches only touch this capsfilter
+    if (hardware)
+    {
+        // nvvidconv also takes system memory frames from non-CSI sources into NVMM
+        desc += " ! nvvidconv ! videorate drop-only=true";
+    }
+    else
+    {
+        // Drop before scaling so skipped frames cost nothing
+        desc += " ! videorate drop-only=true ! videoscale ! videoconvert";
+    }
+    desc += " ! capsfilter name=" PROFILE_CAPS_NAME " caps=\"" + videoProfileCaps(handle->curr_video_profile, hardware) + "\"";
+
+    if (num_layers == 1)
+    {
+        desc += " ! " + leakyQueueDesc("encode_queue", config->queue_max_ms);
+        desc += " ! " + encoderDesc(config, hardware, 0, config->abr_start_kbps);
+        desc += " ! h264parse name=" REPLAY_PARSE_NAME + recordTeeDesc(config);
+        desc += " ! rtph264pay ssrc=" + std::to_string(layers[0].ssrc) + " pt=100" + fecEncoderDesc(config, 0);
+        desc += " ! rtprtxqueue max-size-time=2000 max-size-packets=0 ! rtpbin.send_rtp_sink_0";
+    }
+    else
+    {
+        // Every layer leaves through one rtpbin session and one socket, since the
+        // comedia plain transport only accepts packets from the first source address
+        desc += " ! tee name=layer_tee";
+        for (int i = 0; i < num_layers; i++)
+        {
+            desc += " layer_tee. ! valve name=layer_valve_" + std::to_string(i);
+            desc += " ! " + leakyQueueDesc("layer_queue_" + std::to_string(i), config->queue_max_ms);
+            if (i > 0)
+            {
+                // Named so applyVideoProfile() can resize the layer along with the profile
+                desc += hardware ? " ! nvvidconv" : " ! videoscale";
+                desc += " ! capsfilter name=" SIMULCAST_LAYER_CAPS_PREFIX + std::to_string(i) + " caps=\"video/x-raw";
+                desc += hardware ? "(memory:NVMM)" : "";
+                desc += ", width=(int)" + std::to_string(layers[i].width) + ", height=(int)" + std::to_string(layers[i].height) + "\"";
+            }
+            desc += " ! " + encoderDesc(config, hardware, i, layers[i].bitrate_kbps) + " ! h264parse";
+            if (i == 0)
+            {
+                desc += " name=" REPLAY_PARSE_NAME + recordTeeDesc(config);
+            }
+            desc += " ! rtph264pay ssrc=" + std::to_string(layers[i].ssrc) + " pt=100" + fecEncoderDesc(config, i) + " ! funnel.";
+        }
+        desc += " rtpfunnel name=funnel";
+        desc += " ! rtprtxqueue max-size-time=2000 max-size-packets=0 ! rtpbin.send_rtp_sink_0";
+    }
+    desc += recordBranchDesc(config);
+    desc += analyticsBranchDesc(config, hardware);
+
+    desc += " rtpbin name=rtpbin rtp-profile=avpf";
+    // Keeps a slow socket, or the pacer holding back a keyframe, from backing up into the encoders
+    desc += " rtpbin.send_rtp_src_0 ! " + leakyQueueDesc("send_queue", config->queue_max_ms);
+    desc += " ! " + rtpSinkDesc(config, video_transport_ip, video_transport_port);
+    desc += rtcpDesc(video_transport_ip, video_transport_rtcp_port);
+
+    return desc;
+}
@@ -0,0 +1,51 @@
+#ifndef __PIPELINE_DESC_HPP__
+#define __PIPELINE_DESC_HPP__
+
+#include <string>
+
+#include "../common/fish_types.h"
+
+/* Description: Builds the gst_parse_launch tail shared by the streaming pipelines. It
+ *              continues a chain that ends in raw video with the profile scale/rate stage,
+ *              one encoder per simulcast layer, RTP payloading, rtpbin (named "rtpbin")
+ *              and the UDP sinks towards the mediasoup plain transport. RTCP from the SFU
+ *              comes back on the udpsrc set up by connectRtcpFeedback(). Scaling and
+ *              encoding use the Jetson hardware when nvv4l2h264enc is installed and
+ *              videoscale/x264 otherwise.
+ */
+std::string videoSendDesc(fish_handle_t *handle,
+                          std::string video_transport_ip,
+                          std::string video_transport_port,
+                          std::string video_transport_rtcp_port);
+
+/* Description: Builds a complete pipeline that replays the H.264 track of an MP4 file without
+ *              decoding it. The video is demuxed, parsed and payloaded as is, and udpsink
+ *              paces packets to the file's timestamps. The parser is named "file_parse".
+ */
+std::string h264FileSendDesc(fish_handle_t *handle,
+                             std::string file_name,
+                             std::string video_transport_ip,
+                             std::string video_transport_port,
+                             std::string video_transport_rtcp_port);
+
+/* Description: Builds the launch-string tail for a live source that is already H.264, e.g.
+ *              a UVC camera's own encoder. It continues a byte-stream chain with parsing,
+ *              payloading and the same rtpbin and sinks as videoSendDesc(). There is no
+ *              encoder, so ABR, simulcast and forced keyframes do not apply.
+ */
+std::string h264LiveSendDesc(fish_handle_t *handle,
+                             std::string video_transport_ip,
+                             std::string video_transport_port,
+                             std::string video_transport_rtcp_port);
+
+/* Description: Builds a separate launch-string chain that captures audio, encodes it with
+ *              10 ms Opus frames and sends it through session 1 of the video's rtpbin, so
+ *              both streams share one clock and one RTCP timebase for lip-sync. Must be
+ *              appended after videoSendDesc(). Returns an empty string when audio is off.
+ */
+std::string audioSendDesc(fish_handle_t *handle,
+                          std::string audio_transport_ip,
+                          std::string audio_transport_port,
+                          std::string audio_transport_rtcp_port);
+
+#endif /* __PIPELINE_DESC_HPP__ */
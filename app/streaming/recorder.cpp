@@ -0,0 +1,196 @@
+#include "recorder.hpp"
+#include "latency-guard.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECORD_FILE_PREFIX "nemo-"
+
+typedef struct
+{
+    std::string path;
+    uint64_t bytes;
+    time_t mtime;
+} segment_file_t;
+
+static bool recordingEnabled(const fish_stream_config_t *config)
+{
+    return config->record_dir != NULL && config->record_dir[0] != '\0';
+}
+
+/* Deletes the oldest segments until the directory is within the size and age limits.
+ * Names start with the session time, so name order is recording order. */
+static void pruneSegments(const fish_stream_config_t *config)
+{
+    if (config->record_max_mb == 0 && config->record_max_age_min == 0)
+    {
+        return;
+    }
+
+    DIR *dir = opendir(config->record_dir);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    std::vector<segment_file_t> files;
+    uint64_t total_bytes = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, RECORD_FILE_PREFIX, strlen(RECORD_FILE_PREFIX)) != 0)
+        {
+            continue;
+        }
+
+        segment_file_t file;
+        file.path = std::string(config->record_dir) + "/" + entry->d_name;
+        struct stat st;
+        if (stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        file.bytes = (uint64_t)st.st_size;
+        file.mtime = st.st_mtime;
+        total_bytes += file.bytes;
+        files.push_back(file);
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end(), [](const segment_file_t &a, const segment_file_t &b)
+              { return a.path < b.path; });
+
+    uint64_t max_bytes = (uint64_t)config->record_max_mb * 1024 * 1024;
+    time_t oldest_allowed = time(NULL) - (time_t)config->record_max_age_min * 60;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        bool too_big = (max_bytes != 0 && total_bytes > max_bytes);
+        bool too_old = (config->record_max_age_min != 0 && files[i].mtime < oldest_allowed);
+        if (!too_big && !too_old)
+        {
+            break;
+        }
+
+        if (unlink(files[i].path.c_str()) == 0)
+        {
+            total_bytes -= files[i].bytes;
+            printf(">> Deleted old recording %s\n", files[i].path.c_str());
+        }
+    }
+}
+
+/* splitmuxsink "format-location" handler, runs on the recording branch's thread */
+static gchar *segmentLocation(GstElement *splitmux, guint fragment_id, gpointer user_data)
+{
+    fish_recorder_t *recorder = (fish_recorder_t *)user_data;
+
+    pruneSegments(recorder->config);
+    recorder->segments++;
+
+    gchar *location = g_strdup_printf("%s-%05u.%s", recorder->prefix.c_str(), fragment_id,
+                                      recorder->config->record_format);
+    printf(">> Recording to %s\n", location);
+    return location;
+}
+
+std::string recordTeeDesc(const fish_stream_config_t *config)
+{
+    if (!recordingEnabled(config))
+    {
+        return "";
+    }
+
+    // Without the caps the tee could negotiate avc, which drops in-band SPS/PPS from RTP
+    return " ! video/x-h264, stream-format=(string)byte-stream ! tee name=record_tee";
+}
+
+std::string recordBranchDesc(const fish_stream_config_t *config)
+{
+    if (!recordingEnabled(config))
+    {
+        return "";
+    }
+
+    // The parser converts to avc for mp4mux, and keyframe requests keep segments near
+    // their target length even with intra refresh
+    std::string desc = " record_tee. ! " + leakyQueueDesc("record_queue", RECORD_QUEUE_MS);
+    desc += " ! h264parse ! splitmuxsink name=" RECORDER_NAME " send-keyframe-requests=true max-size-time=" +
+            std::to_string((guint64)config->record_segment_s * GST_SECOND);
+    return desc;
+}
+
+fish_error_t setupRecorder(fish_recorder_t *recorder, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    recorder->splitmux = NULL;
+    recorder->location_handler = 0;
+    recorder->config = config;
+    recorder->segments = 0;
+
+    if (!recordingEnabled(config))
+    {
+        return FISH_EPERM;
+    }
+
+    const char *muxer_name;
+    if (strcmp(config->record_format, "mp4") == 0)
+    {
+        muxer_name = "mp4mux";
+    }
+    else if (strcmp(config->record_format, "mkv") == 0)
+    {
+        muxer_name = "matroskamux";
+    }
+    else
+    {
+        printf("Unknown recording format %s\n", config->record_format);
+        return FISH_EINVAL;
+    }
+
+    recorder->splitmux = gst_bin_get_by_name(GST_BIN(pipeline), RECORDER_NAME);
+    GstElement *muxer = gst_element_factory_make(muxer_name, NULL);
+    if (recorder->splitmux == NULL || muxer == NULL)
+    {
+        printf("Cannot record, pipeline has no %s or %s is missing\n", RECORDER_NAME, muxer_name);
+        if (muxer != NULL)
+        {
+            gst_object_unref(muxer);
+        }
+        teardownRecorder(recorder);
+        return FISH_EINVAL;
+    }
+
+    // splitmuxsink takes ownership of the floating muxer
+    g_object_set(recorder->splitmux, "muxer", muxer, NULL);
+
+    char session[32];
+    time_t now = time(NULL);
+    strftime(session, sizeof(session), "%Y%m%d-%H%M%S", localtime(&now));
+    recorder->prefix = std::string(config->record_dir) + "/" RECORD_FILE_PREFIX + session;
+
+    recorder->location_handler = g_signal_connect(recorder->splitmux, "format-location",
+                                                  G_CALLBACK(segmentLocation), recorder);
+
+    printf(">> Recording %us %s segments to %s (limit %u MB, %u min)\n", config->record_segment_s,
+           config->record_format, config->record_dir, config->record_max_mb, config->record_max_age_min);
+    return FISH_EOK;
+}
+
+void teardownRecorder(fish_recorder_t *recorder)
+{
+    if (recorder->splitmux != NULL)
+    {
+        if (recorder->location_handler != 0)
+        {
+            g_signal_handler_disconnect(recorder->splitmux, recorder->location_handler);
+            recorder->location_handler = 0;
+        }
+        gst_object_unref(recorder->splitmux);
+        recorder->splitmux = NULL;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __RECORDER_HPP__
+#define __RECORDER_HPP__
+
+#include <gst/gst.h>
+#include <string>
+
+#include "../common/fish_types.h"
+
+#define RECORDER_NAME "recorder"
+#define RECORD_QUEUE_MS 2000 // Storage stalls shorter than this lose nothing
+
+typedef struct
+{
+    GstElement *splitmux;
+    gulong location_handler;
+    const fish_stream_config_t *config;
+    std::string prefix; // Directory and session timestamp shared by every segment
+    uint32_t segments;
+} fish_recorder_t;
+
+/* Description: Launch-string fragment that goes right after the full quality h264parse. It
+ *              pins the live branch to byte-stream and adds the tee named "record_tee".
+ *              Returns an empty string when recording is off.
+ */
+std::string recordTeeDesc(const fish_stream_config_t *config);
+
+/* Description: Launch-string branch from record_tee into a leaky queue and splitmuxsink. It
+ *              must be appended outside the main chain. Returns an empty string when
+ *              recording is off.
+ */
+std::string recordBranchDesc(const fish_stream_config_t *config);
+
+/* Description: Picks the muxer and names segments <dir>/nemo-<start time>-<n>.<format>,
+ *              pruning old segments to the size and age limits before each new one opens.
+ *              Must be called before the pipeline leaves GST_STATE_NULL. Returns FISH_EPERM
+ *              if recording is off.
+ */
+fish_error_t setupRecorder(fish_recorder_t *recorder, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Disconnects from splitmuxsink. Call after the pipeline is in GST_STATE_NULL. */
+void teardownRecorder(fish_recorder_t *recorder);
+
+#endif /* __RECORDER_HPP__ */
@@ -0,0 +1,283 @@
+#include "replay-buffer.hpp"
+
+#include <gst/app/gstappsrc.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#define REPLAY_EXPORT_TIMEOUT (30 * GST_SECOND)
+
+static GstClockTime bufferTime(GstBuffer *buf)
+{
+    return GST_BUFFER_DTS_IS_VALID(buf) ? GST_BUFFER_DTS(buf) : GST_BUFFER_PTS(buf);
+}
+
+static bool isKeyframe(GstBuffer *buf)
+{
+    return !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+/* Must hold replay->mtx */
+static void clearRing(fish_replay_buffer_t *replay)
+{
+    for (size_t i = 0; i < replay->access_units.size(); i++)
+    {
+        gst_buffer_unref(replay->access_units[i]);
+    }
+    replay->access_units.clear();
+    replay->bytes = 0;
+}
+
+/* Drops whole GOPs from the front while the rest still covers the window, or while
+ * over the memory limit. Must hold replay->mtx. */
+static void trimRing(fish_replay_buffer_t *replay)
+{
+    std::deque<GstBuffer *> &aus = replay->access_units;
+    GstClockTime newest = bufferTime(aus.back());
+
+    while (true)
+    {
+        size_t next_key = 1;
+        while (next_key < aus.size() && !isKeyframe(aus[next_key]))
+        {
+            next_key++;
+        }
+        if (next_key >= aus.size())
+        {
+            return;
+        }
+
+        bool covers_window = (newest - bufferTime(aus[next_key]) >= replay->window_ns);
+        bool over_memory = (replay->max_bytes != 0 && replay->bytes > replay->max_bytes);
+        if (!covers_window && !over_memory)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < next_key; i++)
+        {
+            replay->bytes -= gst_buffer_get_size(aus.front());
+            gst_buffer_unref(aus.front());
+            aus.pop_front();
+        }
+    }
+}
+
+static GstPadProbeReturn replayProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_replay_buffer_t *replay = (fish_replay_buffer_t *)user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+        {
+            GstCaps *caps;
+            gst_event_parse_caps(event, &caps);
+
+            // A profile switch changes the resolution, and one MP4 track cannot hold both
+            std::lock_guard<std::mutex> lock(replay->mtx);
+            if (replay->caps == NULL || !gst_caps_is_equal(replay->caps, caps))
+            {
+                clearRing(replay);
+                gst_caps_replace(&replay->caps, caps);
+            }
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_CLOCK_TIME_IS_VALID(bufferTime(buf)))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    std::lock_guard<std::mutex> lock(replay->mtx);
+    if (replay->access_units.empty() && !isKeyframe(buf))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    replay->access_units.push_back(gst_buffer_ref(buf));
+    replay->bytes += gst_buffer_get_size(buf);
+    trimRing(replay);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Muxes the snapshot with its own short-lived pipeline. Takes ownership of caps and aus. */
+static void exportThread(fish_replay_buffer_t *replay, std::string path, GstCaps *caps, std::vector<GstBuffer *> aus)
+{
+    std::string desc = "appsrc name=replay_src format=time ! h264parse ! mp4mux ! filesink location=\"" + path + "\"";
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), NULL);
+    GstElement *appsrc = (pipeline != NULL) ? gst_bin_get_by_name(GST_BIN(pipeline), "replay_src") : NULL;
+
+    if (appsrc != NULL)
+    {
+        g_object_set(appsrc, "caps", caps, NULL);
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+        // Rebase to zero on metadata copies, the memory stays shared with the live stream
+        GstClockTime base = bufferTime(aus[0]);
+        for (size_t i = 0; i < aus.size(); i++)
+        {
+            GstBuffer *buf = gst_buffer_copy(aus[i]);
+            if (GST_BUFFER_PTS_IS_VALID(buf))
+            {
+                GST_BUFFER_PTS(buf) -= base;
+            }
+            if (GST_BUFFER_DTS_IS_VALID(buf))
+            {
+                GST_BUFFER_DTS(buf) -= base;
+            }
+            gst_app_src_push_buffer(GST_APP_SRC(appsrc), buf);
+        }
+        gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+
+        GstBus *bus = gst_element_get_bus(pipeline);
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, REPLAY_EXPORT_TIMEOUT,
+                                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)
+        {
+            printf(">> Saved %.1fs replay to %s\n",
+                   (double)(bufferTime(aus.back()) - base) / GST_SECOND, path.c_str());
+        }
+        else
+        {
+            printf("Failed to save replay to %s\n", path.c_str());
+        }
+        if (msg != NULL)
+        {
+            gst_message_unref(msg);
+        }
+        gst_object_unref(bus);
+
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(appsrc);
+    }
+    else
+    {
+        printf("Failed to build replay export pipeline\n");
+    }
+
+    if (pipeline != NULL)
+    {
+        gst_object_unref(pipeline);
+    }
+    for (size_t i = 0; i < aus.size(); i++)
+    {
+        gst_buffer_unref(aus[i]);
+    }
+    gst_caps_unref(caps);
+    replay->exporting = false;
+}
+
+fish_error_t setupReplayBuffer(fish_replay_buffer_t *replay, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    replay->parse_src = NULL;
+    replay->probe = 0;
+    replay->caps = NULL;
+    replay->bytes = 0;
+    replay->exporting = false;
+    replay->config = config;
+
+    if (config->replay_seconds == 0)
+    {
+        return FISH_EPERM;
+    }
+
+    GstElement *parse = gst_bin_get_by_name(GST_BIN(pipeline), REPLAY_PARSE_NAME);
+    if (parse == NULL)
+    {
+        printf("Replay needs an h264parse named %s\n", REPLAY_PARSE_NAME);
+        return FISH_EINVAL;
+    }
+    replay->parse_src = gst_element_get_static_pad(parse, "src");
+    gst_object_unref(parse);
+
+    replay->window_ns = (GstClockTime)config->replay_seconds * GST_SECOND;
+    replay->max_bytes = (uint64_t)config->replay_max_mb * 1024 * 1024;
+    replay->probe = gst_pad_add_probe(replay->parse_src,
+                                      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                                      replayProbe, replay, NULL);
+
+    printf(">> Holding the last %us of video for replay (limit %u MB)\n", config->replay_seconds, config->replay_max_mb);
+    return FISH_EOK;
+}
+
+void updateReplayBuffer(fish_replay_buffer_t *replay, fish_handle_t *handle)
+{
+    fish_handle_mtx.lock();
+    bool save = handle->next_replay_save;
+    handle->next_replay_save = false;
+    fish_handle_mtx.unlock();
+
+    if (!save)
+    {
+        return;
+    }
+
+    char name[64];
+    time_t now = time(NULL);
+    strftime(name, sizeof(name), "replay-%Y%m%d-%H%M%S.mp4", localtime(&now));
+    exportReplay(replay, (std::string(replay->config->replay_dir) + "/" + name).c_str());
+}
+
+fish_error_t exportReplay(fish_replay_buffer_t *replay, const char *path)
+{
+    if (replay->exporting.exchange(true))
+    {
+        printf("Replay export already running\n");
+        return FISH_EPERM;
+    }
+
+    std::vector<GstBuffer *> aus;
+    GstCaps *caps = NULL;
+    {
+        std::lock_guard<std::mutex> lock(replay->mtx);
+        if (replay->caps != NULL)
+        {
+            caps = gst_caps_ref(replay->caps);
+        }
+        for (size_t i = 0; i < replay->access_units.size(); i++)
+        {
+            aus.push_back(gst_buffer_ref(replay->access_units[i]));
+        }
+    }
+
+    if (caps == NULL || aus.empty())
+    {
+        if (caps != NULL)
+        {
+            gst_caps_unref(caps);
+        }
+        replay->exporting = false;
+        printf("Nothing to replay yet\n");
+        return FISH_EINVAL;
+    }
+
+    if (replay->export_thread.joinable())
+    {
+        replay->export_thread.join();
+    }
+    replay->export_thread = std::thread(exportThread, replay, std::string(path), caps, aus);
+    return FISH_EOK;
+}
+
+void teardownReplayBuffer(fish_replay_buffer_t *replay)
+{
+    if (replay->export_thread.joinable())
+    {
+        replay->export_thread.join();
+    }
+
+    if (replay->parse_src != NULL)
+    {
+        gst_pad_remove_probe(replay->parse_src, replay->probe);
+        gst_object_unref(replay->parse_src);
+        replay->parse_src = NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(replay->mtx);
+    clearRing(replay);
+    gst_caps_replace(&replay->caps, NULL);
+}
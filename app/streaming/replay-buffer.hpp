@@ -0,0 +1,51 @@
+#ifndef __REPLAY_BUFFER_HPP__
+#define __REPLAY_BUFFER_HPP__
+
+#include <gst/gst.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../common/fish_types.h"
+
+#define REPLAY_PARSE_NAME "video_parse" // Full quality h264parse the ring taps
+
+typedef struct
+{
+    GstPad *parse_src;
+    gulong probe;
+    const fish_stream_config_t *config;
+    GstClockTime window_ns;
+    uint64_t max_bytes;
+
+    std::mutex mtx;
+    std::deque<GstBuffer *> access_units; // Always starts on a keyframe once one has arrived
+    GstCaps *caps;
+    uint64_t bytes;
+
+    std::thread export_thread;
+    std::atomic<bool> exporting;
+} fish_replay_buffer_t;
+
+/* Description: Starts holding references to the last config->replay_seconds of encoded access
+ *              units from the parser named REPLAY_PARSE_NAME. Buffers are shared with the live
+ *              stream, nothing is copied. Returns FISH_EPERM if replay is off.
+ */
+fish_error_t setupReplayBuffer(fish_replay_buffer_t *replay, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Starts an export if one was requested over the control channel. Call
+ *              periodically from the thread that owns the pipeline.
+ */
+void updateReplayBuffer(fish_replay_buffer_t *replay, fish_handle_t *handle);
+
+/* Description: Snapshots the ring and muxes it into an MP4 at path on a background thread,
+ *              leaving the live stream untouched. Returns FISH_EPERM if an export is still
+ *              running and FISH_EINVAL if the ring holds no keyframe yet.
+ */
+fish_error_t exportReplay(fish_replay_buffer_t *replay, const char *path);
+
+/* Description: Waits for a running export, removes the probe and drops every buffer. */
+void teardownReplayBuffer(fish_replay_buffer_t *replay);
+
+#endif /* __REPLAY_BUFFER_HPP__ */
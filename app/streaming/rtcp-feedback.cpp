@@ -0,0 +1,208 @@
+#include "rtcp-feedback.hpp"
+
+#include <gst/video/video.h>
+#include <gio/gio.h>
+#include <stdio.h>
+
+#define KEYFRAME_REPORT_US (5 * G_USEC_PER_SEC)
+
+static const char *keyframe_encoder_names[MAX_KEYFRAME_ENCODERS] = {
+    "encoder", "encoder_1", "encoder_2"};
+
+fish_error_t connectRtcpFeedback(GstElement *pipeline)
+{
+    GstElement *rtcp_src = gst_bin_get_by_name(GST_BIN(pipeline), RTCP_SRC_NAME);
+    GstElement *rtcp_sink = gst_bin_get_by_name(GST_BIN(pipeline), RTCP_SINK_NAME);
+    fish_error_t err = FISH_EOK;
+
+    if (rtcp_src == NULL || rtcp_sink == NULL)
+    {
+        printf("No %s/%s pair, RTCP feedback is off\n", RTCP_SRC_NAME, RTCP_SINK_NAME);
+        err = FISH_EINVAL;
+    }
+    else
+    {
+        // udpsrc binds its socket going to READY, udpsink only opens one when it starts
+        gst_element_set_state(pipeline, GST_STATE_READY);
+
+        GSocket *socket = NULL;
+        g_object_get(rtcp_src, "used-socket", &socket, NULL);
+        if (socket != NULL)
+        {
+            g_object_set(rtcp_sink, "socket", socket, "close-socket", FALSE, NULL);
+            g_object_unref(socket);
+        }
+        else
+        {
+            printf("RTCP receive socket was not opened\n");
+            err = FISH_EIO;
+        }
+    }
+
+    if (rtcp_src != NULL)
+    {
+        gst_object_unref(rtcp_src);
+    }
+    if (rtcp_sink != NULL)
+    {
+        gst_object_unref(rtcp_sink);
+    }
+    return err;
+}
+
+/* Upstream events reach the encoder through its src pad */
+static GstPadProbeReturn keyframeRequestProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_keyframe_encoder_t *encoder = (fish_keyframe_encoder_t *)user_data;
+    fish_keyframe_ctrl_t *ctrl = encoder->ctrl;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+    if (!gst_video_event_is_force_key_unit(event))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 now_us = g_get_monotonic_time();
+    std::lock_guard<std::mutex> lock(ctrl->mtx);
+    if (encoder->resending)
+    {
+        // Already counted when it was coalesced
+        encoder->resending = false;
+        encoder->last_forward_us = now_us;
+        encoder->pending = false;
+        ctrl->forwarded++;
+        return GST_PAD_PROBE_OK;
+    }
+
+    ctrl->requests++;
+    if (encoder->first_request_us == 0)
+    {
+        encoder->first_request_us = now_us;
+    }
+
+    if (now_us - encoder->last_forward_us < ctrl->min_interval_us)
+    {
+        encoder->pending = true;
+        ctrl->coalesced++;
+        return GST_PAD_PROBE_DROP;
+    }
+
+    encoder->last_forward_us = now_us;
+    encoder->pending = false;
+    ctrl->forwarded++;
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn keyframeOutputProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_keyframe_encoder_t *encoder = (fish_keyframe_encoder_t *)user_data;
+    fish_keyframe_ctrl_t *ctrl = encoder->ctrl;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    std::lock_guard<std::mutex> lock(ctrl->mtx);
+    if (encoder->first_request_us != 0)
+    {
+        gint64 response_us = g_get_monotonic_time() - encoder->first_request_us;
+        encoder->first_request_us = 0;
+        ctrl->answered++;
+        ctrl->total_response_us += response_us;
+        if (response_us > ctrl->max_response_us)
+        {
+            ctrl->max_response_us = response_us;
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+fish_error_t setupKeyframeControl(fish_keyframe_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    ctrl->num_encoders = 0;
+    ctrl->min_interval_us = (gint64)config->keyframe_min_ms * 1000;
+    ctrl->requests = 0;
+    ctrl->forwarded = 0;
+    ctrl->coalesced = 0;
+    ctrl->answered = 0;
+    ctrl->total_response_us = 0;
+    ctrl->max_response_us = 0;
+    ctrl->report_us = g_get_monotonic_time();
+
+    for (int i = 0; i < MAX_KEYFRAME_ENCODERS; i++)
+    {
+        GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), keyframe_encoder_names[i]);
+        if (element == NULL)
+        {
+            continue;
+        }
+
+        fish_keyframe_encoder_t *encoder = &ctrl->encoders[ctrl->num_encoders++];
+        encoder->ctrl = ctrl;
+        encoder->src = gst_element_get_static_pad(element, "src");
+        encoder->last_forward_us = 0;
+        encoder->first_request_us = 0;
+        encoder->pending = false;
+        encoder->resending = false;
+        encoder->event_probe = gst_pad_add_probe(encoder->src, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+                                                 keyframeRequestProbe, encoder, NULL);
+        encoder->buffer_probe = gst_pad_add_probe(encoder->src, GST_PAD_PROBE_TYPE_BUFFER,
+                                                  keyframeOutputProbe, encoder, NULL);
+        gst_object_unref(element);
+    }
+
+    if (ctrl->num_encoders == 0)
+    {
+        return FISH_EPERM;
+    }
+    return FISH_EOK;
+}
+
+void updateKeyframeControl(fish_keyframe_ctrl_t *ctrl)
+{
+    gint64 now_us = g_get_monotonic_time();
+
+    for (int i = 0; i < ctrl->num_encoders; i++)
+    {
+        fish_keyframe_encoder_t *encoder = &ctrl->encoders[i];
+        {
+            std::lock_guard<std::mutex> lock(ctrl->mtx);
+            if (!encoder->pending || now_us - encoder->last_forward_us < ctrl->min_interval_us)
+            {
+                continue;
+            }
+            encoder->resending = true;
+        }
+
+        gst_pad_send_event(encoder->src, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+    }
+
+    if (now_us - ctrl->report_us < KEYFRAME_REPORT_US)
+    {
+        return;
+    }
+    ctrl->report_us = now_us;
+
+    std::lock_guard<std::mutex> lock(ctrl->mtx);
+    if (ctrl->requests == 0)
+    {
+        return;
+    }
+    printf(">> Keyframe requests %llu (forwarded %llu, coalesced %llu), request to keyframe avg %.1fms max %.1fms\n",
+           (unsigned long long)ctrl->requests, (unsigned long long)ctrl->forwarded, (unsigned long long)ctrl->coalesced,
+           ctrl->answered ? ctrl->total_response_us / 1000.0 / ctrl->answered : 0.0, ctrl->max_response_us / 1000.0);
+    ctrl->max_response_us = 0;
+}
+
+void teardownKeyframeControl(fish_keyframe_ctrl_t *ctrl)
+{
+    for (int i = 0; i < ctrl->num_encoders; i++)
+    {
+        gst_pad_remove_probe(ctrl->encoders[i].src, ctrl->encoders[i].event_probe);
+        gst_pad_remove_probe(ctrl->encoders[i].src, ctrl->encoders[i].buffer_probe);
+        gst_object_unref(ctrl->encoders[i].src);
+    }
+    ctrl->num_encoders = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef __RTCP_FEEDBACK_HPP__
+#define __RTCP_FEEDBACK_HPP__
+
+#include <gst/gst.h>
+#include <mutex>
+
+#include "../common/fish_types.h"
+
+#define RTCP_SINK_NAME "rtcp_sink"
+#define RTCP_SRC_NAME "rtcp_src"
+#define MAX_KEYFRAME_ENCODERS 3 // encoder, encoder_1 and encoder_2
+
+typedef struct fish_keyframe_ctrl fish_keyframe_ctrl_t;
+
+typedef struct
+{
+    fish_keyframe_ctrl_t *ctrl;
+    GstPad *src;
+    gulong event_probe;
+    gulong buffer_probe;
+    gint64 last_forward_us;  // Last request let through to the encoder
+    gint64 first_request_us; // Oldest request not yet answered by a keyframe, 0 if none
+    bool pending;            // A request was held back and is still owed
+    bool resending;          // The owed request is being sent by updateKeyframeControl()
+} fish_keyframe_encoder_t;
+
+struct fish_keyframe_ctrl
+{
+    fish_keyframe_encoder_t encoders[MAX_KEYFRAME_ENCODERS];
+    int num_encoders;
+    gint64 min_interval_us;
+
+    std::mutex mtx;
+    uint64_t requests;  // Force-key-unit requests from PLI/FIR or layer switches
+    uint64_t forwarded; // Requests passed to an encoder
+    uint64_t coalesced; // Requests held back by the rate limit
+    uint64_t answered;  // Keyframes that answered a request
+    gint64 total_response_us;
+    gint64 max_response_us;
+    gint64 report_us;
+};
+
+/* Description: Lets RTCP from the SFU back into rtpbin. The udpsrc named RTCP_SRC_NAME
+ *              is given the socket of the udpsink named RTCP_SINK_NAME, so feedback arrives
+ *              on the address the comedia transport learned from our own RTCP. Without it
+ *              rtpbin never sees receiver reports, NACKs, PLIs or FIRs. Must be called
+ *              while the pipeline is in GST_STATE_NULL. It leaves the pipeline in
+ *              GST_STATE_READY.
+ */
+fish_error_t connectRtcpFeedback(GstElement *pipeline);
+
+/* Description: Rate-limits the force-key-unit events rtpbin sends upstream for PLI/FIR to
+ *              one per config->keyframe_min_ms per encoder. Requests inside the interval are
+ *              coalesced and replayed when it ends. It also times how long each request
+ *              takes to produce a keyframe.
+ */
+fish_error_t setupKeyframeControl(fish_keyframe_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Sends coalesced requests that are now due and prints the counters every
+ *              few seconds. Call periodically from the thread that owns the pipeline.
+ */
+void updateKeyframeControl(fish_keyframe_ctrl_t *ctrl);
+
+/* Description: Removes the probes and drops pad references. */
+void teardownKeyframeControl(fish_keyframe_ctrl_t *ctrl);
+
+#endif /* __RTCP_FEEDBACK_HPP__ */
@@ -0,0 +1,272 @@
+#include "rtp-pacer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+#define PACER_DEPTH_US 2000      // Bucket size in send time, so tiny bursts still go out at once
+#define PACER_MIN_DEPTH 1500     // ...but always at least one full packet
+#define PACER_RATE_WINDOW_US 500000
+#define PACER_RATE_WEIGHT 0.3    // Share of the newest window in the media rate average
+#define PACER_BURST_GAP_US 500   // Packets closer than this count as one burst
+#define PACER_REPORT_US (5 * G_USEC_PER_SEC)
+
+static void recordSend(fish_pacer_t *pacer, gint64 now_us, gint64 wait_us, bool overdrawn)
+{
+    std::lock_guard<std::mutex> lock(pacer->mtx);
+    pacer->packets++;
+    if (wait_us > 0)
+    {
+        pacer->paced++;
+        pacer->total_wait_us += wait_us;
+        pacer->max_wait_seen_us = std::max(pacer->max_wait_seen_us, wait_us);
+    }
+    if (overdrawn)
+    {
+        pacer->overdrawn++;
+    }
+
+    if (pacer->last_send_us != 0 && now_us - pacer->last_send_us < PACER_BURST_GAP_US)
+    {
+        pacer->burst_len++;
+    }
+    else
+    {
+        pacer->bursts++;
+        pacer->burst_len = 1;
+    }
+    pacer->max_burst = std::max(pacer->max_burst, pacer->burst_len);
+    pacer->last_send_us = now_us;
+}
+
+/* Measures the media rate upstream of the queue, so holding packets back cannot feed
+ * back into the rate they are paced at */
+static GstPadProbeReturn rateProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_pacer_t *pacer = (fish_pacer_t *)user_data;
+    gint64 now_us = g_get_monotonic_time();
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    {
+        pacer->rate_window_bytes += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+    }
+    else
+    {
+        pacer->rate_window_bytes += gst_buffer_list_calculate_size(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+    }
+
+    if (now_us - pacer->rate_window_us >= PACER_RATE_WINDOW_US)
+    {
+        double window_rate = pacer->rate_window_bytes * 1e6 / (now_us - pacer->rate_window_us);
+        pacer->rate_window_us = now_us;
+        pacer->rate_window_bytes = 0;
+
+        std::lock_guard<std::mutex> lock(pacer->mtx);
+        pacer->media_rate += PACER_RATE_WEIGHT * (window_rate - pacer->media_rate);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Takes size bytes from the bucket and returns how long the packet has to be held back */
+static gint64 chargeBuffer(fish_pacer_t *pacer, gsize size, bool *overdrawn)
+{
+    gint64 now_us = g_get_monotonic_time();
+    double rate;
+    {
+        std::lock_guard<std::mutex> lock(pacer->mtx);
+        rate = pacer->factor * pacer->media_rate;
+        pacer->pacing_rate = rate;
+    }
+
+    double depth = std::max(rate * PACER_DEPTH_US / 1e6, (double)PACER_MIN_DEPTH);
+    pacer->tokens = std::min(pacer->tokens + rate * (now_us - pacer->refill_us) / 1e6, depth);
+    pacer->refill_us = now_us;
+    pacer->tokens -= size;
+
+    gint64 wait_us = 0;
+    *overdrawn = false;
+    if (pacer->tokens < 0)
+    {
+        wait_us = (gint64)(-pacer->tokens * 1e6 / rate);
+        if (wait_us > pacer->max_wait_us)
+        {
+            // Holding packets any longer would only move the loss into the leaky queue
+            pacer->tokens = -rate * pacer->max_wait_us / 1e6;
+            wait_us = pacer->max_wait_us;
+            *overdrawn = true;
+        }
+    }
+    return wait_us;
+}
+
+/* Blocks the calling streaming thread for wait_us, then counts the packet as sent. The
+ * bucket refills over the wait the next time it is charged. */
+static void holdBuffer(fish_pacer_t *pacer, gint64 wait_us, bool overdrawn)
+{
+    if (wait_us > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+    recordSend(pacer, g_get_monotonic_time(), wait_us, overdrawn);
+}
+
+/* Chains packets [start, end) of list to the queue's peer as one list */
+static GstFlowReturn chainPackets(fish_pacer_t *pacer, GstBufferList *list, guint start, guint end)
+{
+    GstBufferList *batch = gst_buffer_list_new_sized(end - start);
+    for (guint i = start; i < end; i++)
+    {
+        gst_buffer_list_add(batch, gst_buffer_ref(gst_buffer_list_get(list, i)));
+    }
+    return gst_pad_chain_list(pacer->sink_pad, batch);
+}
+
+static GstPadProbeReturn pacerProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    fish_pacer_t *pacer = (fish_pacer_t *)user_data;
+    bool overdrawn;
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    {
+        gint64 wait_us = chargeBuffer(pacer, gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)), &overdrawn);
+        holdBuffer(pacer, wait_us, overdrawn);
+        return GST_PAD_PROBE_OK;
+    }
+
+    // Payloaders push fragmented NAL units as one list, which udpsink would send in one go.
+    // Split it only where a packet has to wait: the packets before it are paid for and go
+    // out together, so a batching sink still sends them with one syscall
+    GstBufferList *list = gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+    GST_PAD_PROBE_INFO_DATA(info) = list;
+    guint length = gst_buffer_list_length(list);
+    guint sent = 0;
+    for (guint i = 0; i < length; i++)
+    {
+        gint64 wait_us = chargeBuffer(pacer, gst_buffer_get_size(gst_buffer_list_get(list, i)), &overdrawn);
+        if (wait_us > 0 && i > sent)
+        {
+            if (chainPackets(pacer, list, sent, i) != GST_FLOW_OK)
+            {
+                break;
+            }
+            sent = i;
+        }
+        holdBuffer(pacer, wait_us, overdrawn);
+    }
+
+    // The queue pushes the last run itself, or what failed to go out, in which case it
+    // also gets the flushing or EOS result
+    gst_buffer_list_remove(list, 0, sent);
+    return GST_PAD_PROBE_OK;
+}
+
+fish_error_t setupPacer(fish_pacer_t *pacer, GstElement *pipeline, const char *queue_name,
+                        const fish_stream_config_t *config)
+{
+    pacer->queue_sink = NULL;
+    pacer->queue_src = NULL;
+    pacer->sink_pad = NULL;
+    if (config->pace_pct == 0)
+    {
+        return FISH_EPERM;
+    }
+
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), queue_name);
+    if (queue == NULL)
+    {
+        // File pass-through sends straight from rtpbin, without a queue to hold packets in
+        printf("Warning: no %s in this pipeline, sending unpaced\n", queue_name);
+        return FISH_EPERM;
+    }
+    pacer->queue_sink = gst_element_get_static_pad(queue, "sink");
+    pacer->queue_src = gst_element_get_static_pad(queue, "src");
+    pacer->sink_pad = gst_pad_get_peer(pacer->queue_src);
+    gst_object_unref(queue);
+    if (pacer->sink_pad == NULL)
+    {
+        gst_object_unref(pacer->queue_sink);
+        gst_object_unref(pacer->queue_src);
+        pacer->queue_sink = NULL;
+        pacer->queue_src = NULL;
+        return FISH_EINVAL;
+    }
+
+    gint64 now_us = g_get_monotonic_time();
+    pacer->factor = config->pace_pct / 100.0;
+    pacer->max_wait_us = (gint64)config->pace_max_ms * 1000;
+    pacer->tokens = 0;
+    pacer->media_rate = config->abr_start_kbps * 1000.0 / 8; // Until the first window is measured
+    pacer->refill_us = now_us;
+    pacer->rate_window_us = now_us;
+    pacer->rate_window_bytes = 0;
+    pacer->last_send_us = 0;
+    pacer->burst_len = 0;
+    pacer->packets = 0;
+    pacer->bursts = 0;
+    pacer->max_burst = 0;
+    pacer->paced = 0;
+    pacer->total_wait_us = 0;
+    pacer->max_wait_seen_us = 0;
+    pacer->overdrawn = 0;
+    pacer->pacing_rate = 0;
+    pacer->report_us = now_us;
+
+    pacer->rate_probe = gst_pad_add_probe(pacer->queue_sink,
+                                          (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                                          rateProbe, pacer, NULL);
+    pacer->probe = gst_pad_add_probe(pacer->queue_src,
+                                     (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                                     pacerProbe, pacer, NULL);
+    printf(">> Pacing RTP at %u%% of the media rate, at most %ums behind\n", config->pace_pct, config->pace_max_ms);
+    return FISH_EOK;
+}
+
+void updatePacer(fish_pacer_t *pacer)
+{
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - pacer->report_us < PACER_REPORT_US)
+    {
+        return;
+    }
+    pacer->report_us = now_us;
+
+    std::lock_guard<std::mutex> lock(pacer->mtx);
+    if (pacer->packets == 0)
+    {
+        return;
+    }
+    printf(">> Pacer: %.0fkbps, %llu packets in %llu bursts (max %u), %llu held avg %.2fms max %.2fms, %llu overdrawn\n",
+           pacer->pacing_rate * 8 / 1000, (unsigned long long)pacer->packets, (unsigned long long)pacer->bursts,
+           pacer->max_burst, (unsigned long long)pacer->paced,
+           pacer->paced ? pacer->total_wait_us / 1000.0 / pacer->paced : 0.0, pacer->max_wait_seen_us / 1000.0,
+           (unsigned long long)pacer->overdrawn);
+    pacer->packets = 0;
+    pacer->bursts = 0;
+    pacer->max_burst = 0;
+    pacer->paced = 0;
+    pacer->total_wait_us = 0;
+    pacer->max_wait_seen_us = 0;
+    pacer->overdrawn = 0;
+}
+
+void teardownPacer(fish_pacer_t *pacer)
+{
+    if (pacer->queue_sink != NULL)
+    {
+        gst_pad_remove_probe(pacer->queue_sink, pacer->rate_probe);
+        gst_object_unref(pacer->queue_sink);
+        pacer->queue_sink = NULL;
+    }
+    if (pacer->queue_src != NULL)
+    {
+        gst_pad_remove_probe(pacer->queue_src, pacer->probe);
+        gst_object_unref(pacer->queue_src);
+        pacer->queue_src = NULL;
+    }
+    if (pacer->sink_pad != NULL)
+    {
+        gst_object_unref(pacer->sink_pad);
+        pacer->sink_pad = NULL;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef __RTP_PACER_HPP__
+#define __RTP_PACER_HPP__
+
+#include <gst/gst.h>
+#include <mutex>
+
+#include "../common/fish_types.h"
+
+typedef struct
+{
+    GstPad *queue_sink; // The media rate is measured where packets enter the queue
+    GstPad *queue_src;  // Packets are held back on the queue's streaming thread
+    GstPad *sink_pad;   // Where paced packets from buffer lists are chained to
+    gulong rate_probe;
+    gulong probe;
+    double factor;      // Send rate as a multiple of the measured media rate
+    gint64 max_wait_us; // Most the pacer may fall behind before it sends unpaced
+
+    // Only touched on the queue's streaming thread
+    double tokens;       // Bytes that may go out now, negative while paying off a burst
+    gint64 refill_us;
+    gint64 last_send_us;
+    uint32_t burst_len;
+
+    // Only touched on the thread pushing into the queue
+    gint64 rate_window_us;
+    uint64_t rate_window_bytes;
+
+    std::mutex mtx;
+    double media_rate;    // Bytes/s leaving rtpbin, averaged
+    uint64_t packets;
+    uint64_t bursts;      // Runs of packets sent closer than PACER_BURST_GAP_US
+    uint32_t max_burst;
+    uint64_t paced;       // Packets that had to wait
+    gint64 total_wait_us;
+    gint64 max_wait_seen_us;
+    uint64_t overdrawn;   // Packets sent unpaced because the pacer was max_wait_us behind
+    double pacing_rate;
+    gint64 report_us;
+} fish_pacer_t;
+
+/* Description: Paces the packets leaving the named queue with a token bucket, filled at
+ *              config->pace_pct percent of the media rate measured going into the queue.
+ *              An IDR frame then goes out spread over about a frame interval instead of
+ *              back to back. Buffer lists are split only where a packet has to wait, and
+ *              each run of packets in between still goes out as one list. Returns
+ *              FISH_EPERM if pacing is off or the queue is missing.
+ */
+fish_error_t setupPacer(fish_pacer_t *pacer, GstElement *pipeline, const char *queue_name,
+                        const fish_stream_config_t *config);
+
+/* Description: Prints burst and pacing delay counters every few seconds. Call
+ *              periodically from the thread that owns the pipeline.
+ */
+void updatePacer(fish_pacer_t *pacer);
+
+/* Description: Removes the probe and drops pad references. */
+void teardownPacer(fish_pacer_t *pacer);
+
+#endif /* __RTP_PACER_HPP__ */
@@ -0,0 +1,281 @@
+#include "simulcast.hpp"
+#include "video-profiles.hpp"
+
+#include <gst/video/video.h>
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIN_LAYER_KBPS 100
+#define SIMULCAST_REPORT_US (5 * G_USEC_PER_SEC)
+
+/* Layer i halves the profile i times, kept even for 4:2:0 */
+static int layerDimension(int full, int layer)
+{
+    return (full >> layer) & ~1;
+}
+
+int getSimulcastLayers(const fish_stream_config_t *config, int profile_index,
+                       fish_simulcast_layer_t layers[MAX_SIMULCAST_LAYERS])
+{
+    const fish_video_profile_t *profile = getVideoProfile(profile_index);
+    int num_layers = std::min(std::max((int)config->simulcast_layers, 1), MAX_SIMULCAST_LAYERS);
+
+    for (int i = 0; i < num_layers; i++)
+    {
+        // Halving both dimensions quarters the pixels, so quarter the bitrate too
+        layers[i].width = layerDimension(profile->width, i);
+        layers[i].height = layerDimension(profile->height, i);
+        layers[i].bitrate_kbps = std::max(config->abr_start_kbps >> (2 * i), (uint32_t)MIN_LAYER_KBPS);
+        layers[i].ssrc = FISH_VIDEO_SSRC + i;
+    }
+    return num_layers;
+}
+
+void resizeSimulcastLayers(GstElement *pipeline, int profile_index)
+{
+    const fish_video_profile_t *profile = getVideoProfile(profile_index);
+    if (profile == NULL)
+    {
+        return;
+    }
+
+    for (int i = 1; i < MAX_SIMULCAST_LAYERS; i++)
+    {
+        std::string name = SIMULCAST_LAYER_CAPS_PREFIX + std::to_string(i);
+        GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), name.c_str());
+        if (capsfilter == NULL)
+        {
+            continue;
+        }
+
+        GstCaps *current = NULL;
+        g_object_get(capsfilter, "caps", &current, NULL);
+        GstCaps *caps = (current != NULL) ? gst_caps_copy(current) : gst_caps_new_empty_simple("video/x-raw");
+        gst_caps_set_simple(caps,
+                            "width", G_TYPE_INT, layerDimension(profile->width, i),
+                            "height", G_TYPE_INT, layerDimension(profile->height, i),
+                            NULL);
+        g_object_set(capsfilter, "caps", caps, NULL);
+
+        gst_caps_unref(caps);
+        if (current != NULL)
+        {
+            gst_caps_unref(current);
+        }
+        gst_object_unref(capsfilter);
+    }
+}
+
+std::string simulcastEncodingsJson(const fish_stream_config_t *config, int profile_index)
+{
+    fish_simulcast_layer_t layers[MAX_SIMULCAST_LAYERS];
+    int num_layers = getSimulcastLayers(config, profile_index, layers);
+
+    if (num_layers == 1)
+    {
+        return "[{\"ssrc\": " + std::to_string(layers[0].ssrc) + "}]";
+    }
+
+    std::string json = "[";
+    for (int i = num_layers - 1; i >= 0; i--)
+    {
+        json += "{\"ssrc\": " + std::to_string(layers[i].ssrc) +
+                ", \"scaleResolutionDownBy\": " + std::to_string(1 << i) +
+                ", \"maxBitrate\": " + std::to_string(layers[i].bitrate_kbps * 1000) + "}";
+        json += (i > 0) ? ", " : "]";
+    }
+    return json;
+}
+
+/* GStreamer names streaming threads after their pad, e.g. "layer_queue_1:src" cut to 15
+ * characters. A layer's queue thread scales, encodes and payloads it, and opens the
+ * encoder, so x264's worker threads inherit its name. A hardware encoder's output thread
+ * is named after the encoder. Returns the layer a thread works for, or -1. */
+static int threadLayer(const char *name, int num_layers)
+{
+    char prefix[32];
+
+    for (int i = 0; i < num_layers; i++)
+    {
+        snprintf(prefix, sizeof(prefix), "layer_queue_%d:", i);
+        if (strncmp(name, prefix, strlen(prefix)) == 0)
+        {
+            return i;
+        }
+        snprintf(prefix, sizeof(prefix), (i == 0) ? "encoder:" : "encoder_%d:", i);
+        if (strncmp(name, prefix, strlen(prefix)) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Sums the user and system CPU ticks of every thread working for each layer */
+static void readLayerTicks(int num_layers, uint64_t ticks[MAX_SIMULCAST_LAYERS])
+{
+    for (int i = 0; i < num_layers; i++)
+    {
+        ticks[i] = 0;
+    }
+
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        char path[64];
+        char stat[512];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name);
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            continue; // The thread exited meanwhile
+        }
+        size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+        fclose(file);
+        stat[len] = '\0';
+
+        // "tid (name) state ppid ...": the name may itself hold spaces or parentheses
+        char *open = strchr(stat, '(');
+        char *close = strrchr(stat, ')');
+        if (open == NULL || close == NULL || close < open)
+        {
+            continue;
+        }
+        *close = '\0';
+        int layer = threadLayer(open + 1, num_layers);
+
+        unsigned long long utime, stime;
+        if (layer >= 0 && sscanf(close + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                                 &utime, &stime) == 2)
+        {
+            ticks[layer] += utime + stime;
+        }
+    }
+    closedir(dir);
+}
+
+fish_error_t setupSimulcast(fish_simulcast_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config)
+{
+    char name[32];
+
+    ctrl->num_layers = 0;
+    if (config->simulcast_layers < 2)
+    {
+        return FISH_EPERM;
+    }
+
+    ctrl->num_layers = std::min((int)config->simulcast_layers, MAX_SIMULCAST_LAYERS);
+    ctrl->mask = (1 << ctrl->num_layers) - 1;
+    ctrl->report_us = g_get_monotonic_time();
+
+    for (int i = 0; i < ctrl->num_layers; i++)
+    {
+        snprintf(name, sizeof(name), "layer_valve_%d", i);
+        ctrl->valves[i] = gst_bin_get_by_name(GST_BIN(pipeline), name);
+
+        snprintf(name, sizeof(name), (i == 0) ? "encoder" : "encoder_%d", i);
+        ctrl->encoders[i] = gst_bin_get_by_name(GST_BIN(pipeline), name);
+    }
+    readLayerTicks(ctrl->num_layers, ctrl->report_ticks);
+
+    for (int i = 0; i < ctrl->num_layers; i++)
+    {
+        if (ctrl->valves[i] == NULL || ctrl->encoders[i] == NULL)
+        {
+            printf("Simulcast pipeline is missing layer %d\n", i);
+            teardownSimulcast(ctrl);
+            return FISH_EINVAL;
+        }
+    }
+
+    printf(">> Simulcast enabled with %d layers\n", ctrl->num_layers);
+    return FISH_EOK;
+}
+
+static void setLayerActive(fish_simulcast_ctrl_t *ctrl, int layer, bool active)
+{
+    g_object_set(ctrl->valves[layer], "drop", active ? FALSE : TRUE, NULL);
+
+    if (active)
+    {
+        // Viewers switching up need a keyframe rather than the next periodic IDR
+        GstPad *src = gst_element_get_static_pad(ctrl->encoders[layer], "src");
+        gst_pad_send_event(src, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        gst_object_unref(src);
+    }
+    printf(">> Simulcast layer %d %s\n", layer, active ? "on" : "off");
+}
+
+static void reportLayerCpu(fish_simulcast_ctrl_t *ctrl)
+{
+    gint64 now_us = g_get_monotonic_time();
+    gint64 wall_us = now_us - ctrl->report_us;
+    if (wall_us < SIMULCAST_REPORT_US)
+    {
+        return;
+    }
+    ctrl->report_us = now_us;
+
+    uint64_t ticks[MAX_SIMULCAST_LAYERS];
+    double ticks_per_us = sysconf(_SC_CLK_TCK) / 1e6;
+    readLayerTicks(ctrl->num_layers, ticks);
+
+    printf(">> Simulcast CPU:");
+    for (int i = 0; i < ctrl->num_layers; i++)
+    {
+        // Threads that exited take their ticks with them, e.g. when x264 reopens
+        uint64_t used = (ticks[i] > ctrl->report_ticks[i]) ? ticks[i] - ctrl->report_ticks[i] : 0;
+        ctrl->report_ticks[i] = ticks[i];
+        printf(" layer %d %.1f%%%s", i, 100.0 * used / (ticks_per_us * wall_us), (ctrl->mask & (1 << i)) ? "" : " (off)");
+    }
+    printf("\n");
+}
+
+void updateSimulcast(fish_simulcast_ctrl_t *ctrl, fish_handle_t *handle)
+{
+    fish_handle_mtx.lock();
+    uint8_t next_mask = handle->next_simulcast_mask & ((1 << ctrl->num_layers) - 1);
+    fish_handle_mtx.unlock();
+
+    for (int i = 0; i < ctrl->num_layers; i++)
+    {
+        bool active = (next_mask & (1 << i)) != 0;
+        if (active != ((ctrl->mask & (1 << i)) != 0))
+        {
+            setLayerActive(ctrl, i, active);
+        }
+    }
+    ctrl->mask = next_mask;
+
+    reportLayerCpu(ctrl);
+}
+
+void teardownSimulcast(fish_simulcast_ctrl_t *ctrl)
+{
+    for (int i = 0; i < ctrl->num_layers; i++)
+    {
+        if (ctrl->valves[i] != NULL)
+        {
+            gst_object_unref(ctrl->valves[i]);
+        }
+        if (ctrl->encoders[i] != NULL)
+        {
+            gst_object_unref(ctrl->encoders[i]);
+        }
+    }
+    ctrl->num_layers = 0;
+}
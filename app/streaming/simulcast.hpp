@@ -0,0 +1,66 @@
+#ifndef __SIMULCAST_HPP__
+#define __SIMULCAST_HPP__
+
+#include <gst/gst.h>
+#include <string>
+
+#include "../common/fish_types.h"
+
+#define MAX_SIMULCAST_LAYERS 3
+#define SIMULCAST_LAYER_CAPS_PREFIX "layer_caps_" // Capsfilter sizing layer N > 0 is layer_caps_N
+
+/* Layer 0 is full quality and follows the active video profile. Higher layer
+ * indices halve the resolution of the one before. */
+typedef struct
+{
+    int width;
+    int height;
+    uint32_t bitrate_kbps;
+    guint ssrc;
+} fish_simulcast_layer_t;
+
+typedef struct
+{
+    int num_layers;
+    uint8_t mask; // Bit i set means layer i is being encoded
+    GstElement *valves[MAX_SIMULCAST_LAYERS];
+    GstElement *encoders[MAX_SIMULCAST_LAYERS];
+
+    // CPU ticks of each layer's threads, including its encoder's, at the last report
+    uint64_t report_ticks[MAX_SIMULCAST_LAYERS];
+    gint64 report_us;
+} fish_simulcast_ctrl_t;
+
+/* Description: Fills layers for the configured layer count and starting profile.
+ *              Returns the number of layers, which is 1 when simulcast is off.
+ */
+int getSimulcastLayers(const fish_stream_config_t *config, int profile_index,
+                       fish_simulcast_layer_t layers[MAX_SIMULCAST_LAYERS]);
+
+/* Description: Resizes the capsfilters of layers above 0 to follow a new profile, so every
+ *              layer stays the size simulcastEncodingsJson() announced relative to layer 0.
+ *              Does nothing in pipelines without simulcast.
+ */
+void resizeSimulcastLayers(GstElement *pipeline, int profile_index);
+
+/* Description: Builds the mediasoup "encodings" JSON array for the producer, lowest
+ *              quality first as mediasoup expects.
+ */
+std::string simulcastEncodingsJson(const fish_stream_config_t *config, int profile_index);
+
+/* Description: Finds the per-layer valves of a simulcast pipeline and starts per-layer
+ *              CPU accounting. Returns FISH_EPERM if simulcast is off.
+ */
+fish_error_t setupSimulcast(fish_simulcast_ctrl_t *ctrl, GstElement *pipeline, const fish_stream_config_t *config);
+
+/* Description: Applies handle->next_simulcast_mask, closing the valve in front of any
+ *              layer nobody consumes so it is not encoded at all, and periodically logs
+ *              per-layer CPU use from /proc/self/task. Call periodically from the thread
+ *              that owns the pipeline.
+ */
+void updateSimulcast(fish_simulcast_ctrl_t *ctrl, fish_handle_t *handle);
+
+/* Description: Removes probes and drops element references. */
+void teardownSimulcast(fish_simulcast_ctrl_t *ctrl);
+
+#endif /* __SIMULCAST_HPP__ */
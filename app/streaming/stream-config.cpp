@@ -0,0 +1,217 @@
+#include "stream-config.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+typedef enum
+{
+    OPTION_FLAG,  // bool, set by "--key"
+    OPTION_UINT,  // uint32_t, set by "--key=123"
+    OPTION_STRING // const char *, set by "--key=text" and pointing into argv
+} option_type_t;
+
+typedef struct
+{
+    const char *key;
+    option_type_t type;
+    size_t offset;
+    const char *help;
+} stream_option_t;
+
+static const stream_option_t stream_options[] = {
+    {"abr", OPTION_FLAG, offsetof(fish_stream_config_t, abr_enabled), "Adapt encoder bitrate to RTCP receiver reports"},
+    {"abr-start", OPTION_UINT, offsetof(fish_stream_config_t, abr_start_kbps), "Starting bitrate in kbit/s"},
+    {"abr-min", OPTION_UINT, offsetof(fish_stream_config_t, abr_min_kbps), "Bitrate floor in kbit/s"},
+    {"abr-max", OPTION_UINT, offsetof(fish_stream_config_t, abr_max_kbps), "Bitrate ceiling in kbit/s"},
+    {"abr-loss-low", OPTION_UINT, offsetof(fish_stream_config_t, abr_loss_low_pct), "Loss percentage treated as a clean link"},
+    {"abr-loss-high", OPTION_UINT, offsetof(fish_stream_config_t, abr_loss_high_pct), "Loss percentage that triggers a back-off"},
+    {"abr-jitter-high", OPTION_UINT, offsetof(fish_stream_config_t, abr_jitter_high_ms), "Jitter in ms that triggers a back-off"},
+    {"abr-hold", OPTION_UINT, offsetof(fish_stream_config_t, abr_hold_ms), "Time in ms to wait after a back-off before increasing"},
+    {"abr-max-skip", OPTION_UINT, offsetof(fish_stream_config_t, abr_max_frame_skip), "Encode 1 of every N frames at most when at the floor"},
+    {"simulcast", OPTION_UINT, offsetof(fish_stream_config_t, simulcast_layers), "Number of simulcast layers to encode (1-3)"},
+    {"profile", OPTION_STRING, offsetof(fish_stream_config_t, video_profile), "Initial video profile, e.g. 720p30 (see video-profiles.cpp)"},
+    {"encoder-profile", OPTION_STRING, offsetof(fish_stream_config_t, encoder_profile), "x264 profile: legacy, sliced, intra-refresh or balanced"},
+    {"encoder-threads", OPTION_UINT, offsetof(fish_stream_config_t, encoder_threads), "Limit x264 to N threads (0 = one per core)"},
+    {"latency-stamp", OPTION_FLAG, offsetof(fish_stream_config_t, latency_stamp), "Stamp processed frames for glass-to-glass latency measurement"},
+    {"queue-ms", OPTION_UINT, offsetof(fish_stream_config_t, queue_max_ms), "Latency ceiling of each pipeline queue in ms"},
+    {"stale-ms", OPTION_UINT, offsetof(fish_stream_config_t, stale_frame_ms), "Drop frames older than this before encoding (0 = never)"},
+    {"audio", OPTION_STRING, offsetof(fish_stream_config_t, audio_source), "Audio source: none, test or alsa"},
+    {"audio-device", OPTION_STRING, offsetof(fish_stream_config_t, audio_device), "ALSA capture device, e.g. hw:1,0"},
+    {"audio-kbps", OPTION_UINT, offsetof(fish_stream_config_t, audio_kbps), "Opus bitrate in kbit/s"},
+    {"file", OPTION_STRING, offsetof(fish_stream_config_t, file), "Video file streamed by --source=file"},
+    {"file-passthrough", OPTION_FLAG, offsetof(fish_stream_config_t, file_passthrough), "Send the file's H.264 track without re-encoding"},
+    {"file-loop", OPTION_FLAG, offsetof(fish_stream_config_t, file_loop), "Loop the file (pass-through only)"},
+    {"loadgen", OPTION_UINT, offsetof(fish_stream_config_t, loadgen_broadcasters), "Act as N synthetic broadcasters sharing one encode"},
+    {"loadgen-seconds", OPTION_UINT, offsetof(fish_stream_config_t, loadgen_seconds), "Stop the load generator after N seconds (0 = never)"},
+    {"record-dir", OPTION_STRING, offsetof(fish_stream_config_t, record_dir), "Record the encoded stream to segments in this directory"},
+    {"record-format", OPTION_STRING, offsetof(fish_stream_config_t, record_format), "Segment container: mkv or mp4"},
+    {"record-segment", OPTION_UINT, offsetof(fish_stream_config_t, record_segment_s), "Segment length in seconds"},
+    {"record-max-mb", OPTION_UINT, offsetof(fish_stream_config_t, record_max_mb), "Delete oldest segments above this total size (0 = no limit)"},
+    {"record-max-age", OPTION_UINT, offsetof(fish_stream_config_t, record_max_age_min), "Delete segments older than N minutes (0 = no limit)"},
+    {"replay", OPTION_UINT, offsetof(fish_stream_config_t, replay_seconds), "Keep the last N seconds of video for instant replay"},
+    {"replay-max-mb", OPTION_UINT, offsetof(fish_stream_config_t, replay_max_mb), "Memory cap for the replay buffer (0 = no cap)"},
+    {"replay-dir", OPTION_STRING, offsetof(fish_stream_config_t, replay_dir), "Directory for exported replay clips"},
+    {"keyframe-min-ms", OPTION_UINT, offsetof(fish_stream_config_t, keyframe_min_ms), "Coalesce PLI/FIR keyframe requests closer than N ms"},
+    {"fec", OPTION_UINT, offsetof(fish_stream_config_t, fec_pct), "ULPFEC overhead in percent at no loss (0 = off)"},
+    {"fec-max", OPTION_UINT, offsetof(fish_stream_config_t, fec_max_pct), "Highest ULPFEC overhead in percent under loss"},
+    {"pace", OPTION_UINT, offsetof(fish_stream_config_t, pace_pct), "Pace RTP at N percent of the media rate, e.g. 250 (0 = off)"},
+    {"pace-max-ms", OPTION_UINT, offsetof(fish_stream_config_t, pace_max_ms), "Most the pacer may delay a packet in ms"},
+    {"udp-batch", OPTION_FLAG, offsetof(fish_stream_config_t, udp_batch), "Send video RTP in batches with sendmmsg and UDP GSO"},
+    {"source", OPTION_STRING, offsetof(fish_stream_config_t, video_source), "Video source: auto, csi, v4l2, v4l2-direct, file, test or shm"},
+    {"source-device", OPTION_STRING, offsetof(fish_stream_config_t, source_device), "V4L2 device, e.g. /dev/video1"},
+    {"source-caps", OPTION_STRING, offsetof(fish_stream_config_t, source_caps), "Caps to capture with, e.g. \"video/x-raw, width=640, height=480\""},
+    {"shm-socket", OPTION_STRING, offsetof(fish_stream_config_t, shm_socket), "Socket path written by shmsink for --source=shm"},
+    {"v4l2-format", OPTION_STRING, offsetof(fish_stream_config_t, v4l2_format), "Camera output for --source=v4l2-direct: auto, raw, mjpeg or h264"},
+    {"v4l2-io", OPTION_STRING, offsetof(fish_stream_config_t, v4l2_io), "Hand frames downstream as mmap or dmabuf memory"},
+    {"v4l2-buffers", OPTION_UINT, offsetof(fish_stream_config_t, v4l2_buffers), "Driver buffers for --source=v4l2-direct"},
+    {"underwater", OPTION_FLAG, offsetof(fish_stream_config_t, underwater), "White-balance and dehaze underwater footage (processed stream)"},
+    {"underwater-strength", OPTION_UINT, offsetof(fish_stream_config_t, underwater_strength_pct), "Percentage of the underwater correction to apply"},
+    {"stabilize", OPTION_FLAG, offsetof(fish_stream_config_t, stabilize), "Remove camera shake (processed stream)"},
+    {"stabilize-crop", OPTION_UINT, offsetof(fish_stream_config_t, stabilize_crop_pct), "Percentage of each edge cropped as stabilization margin"},
+    {"analytics", OPTION_FLAG, offsetof(fish_stream_config_t, analytics), "Run a detector on a decimated copy of the video"},
+    {"analytics-fps", OPTION_UINT, offsetof(fish_stream_config_t, analytics_fps), "Most frames per second the detector sees"},
+    {"analytics-width", OPTION_UINT, offsetof(fish_stream_config_t, analytics_width), "Width of the frames the detector sees"},
+    {"analytics-height", OPTION_UINT, offsetof(fish_stream_config_t, analytics_height), "Height of the frames the detector sees"},
+    {"analytics-model", OPTION_STRING, offsetof(fish_stream_config_t, analytics_model), "OpenCV DNN detector with SSD-style output, motion detection if unset"},
+    {"analytics-publish", OPTION_STRING, offsetof(fish_stream_config_t, analytics_publish), "host:port to send detections to as JSON over UDP"},
+    {"hud", OPTION_FLAG, offsetof(fish_stream_config_t, hud), "Overlay speed, fin angles and link stats on the video (processed stream)"},
+};
+
+void initStreamConfig(fish_stream_config_t *config)
+{
+    config->abr_enabled = false;
+    config->abr_start_kbps = 1000; // Matches x-google-start-bitrate sent to mediasoup
+    config->abr_min_kbps = 300;
+    config->abr_max_kbps = 4000;
+    config->abr_loss_low_pct = 2;
+    config->abr_loss_high_pct = 10;
+    config->abr_jitter_high_ms = 30;
+    config->abr_hold_ms = 2000;
+    config->abr_max_frame_skip = 4;
+    config->video_profile = "480p30";
+    config->simulcast_layers = 1;
+    config->encoder_profile = "legacy";
+    config->encoder_threads = 0;
+    config->latency_stamp = false;
+    config->queue_max_ms = 100;
+    config->stale_frame_ms = 200;
+    config->audio_source = "none";
+    config->audio_device = "default";
+    config->audio_kbps = 64;
+    config->file = "/media/test.mp4";
+    config->file_passthrough = false;
+    config->file_loop = false;
+    config->loadgen_broadcasters = 0;
+    config->loadgen_seconds = 0;
+    config->record_dir = "";
+    config->record_format = "mkv"; // Stays playable if power is cut mid-segment, unlike mp4
+    config->record_segment_s = 60;
+    config->record_max_mb = 0;
+    config->record_max_age_min = 0;
+    config->replay_seconds = 0;
+    config->replay_max_mb = 64;
+    config->replay_dir = "/media";
+    config->keyframe_min_ms = 500;
+    config->fec_pct = 0;
+    config->fec_max_pct = 50;
+    config->pace_pct = 0;
+    config->pace_max_ms = 40;
+    config->udp_batch = false;
+    config->video_source = "auto"; // CSI camera when there is one, the file otherwise
+    config->source_device = "/dev/video0";
+    config->source_caps = "";
+    config->shm_socket = "/tmp/fish-video";
+    config->v4l2_format = "auto";
+    config->v4l2_io = "mmap";
+    config->v4l2_buffers = 6; // Enough for the encoder to hold a few frames without starving the driver
+    config->underwater = false;
+    config->underwater_strength_pct = 80; // Full grey world also neutralises genuinely blue scenes
+    config->stabilize = false;
+    config->stabilize_crop_pct = 5;
+    config->analytics = false;
+    config->analytics_fps = 5;
+    config->analytics_width = 320;
+    config->analytics_height = 180;
+    config->analytics_model = "";
+    config->analytics_publish = "";
+    config->hud = false;
+}
+
+fish_error_t parseStreamOption(const char *arg, fish_stream_config_t *config)
+{
+    if (strncmp(arg, "--", 2) != 0)
+    {
+        printf("Options must start with --: %s\n", arg);
+        return FISH_EINVAL;
+    }
+    arg += 2;
+
+    const char *value = strchr(arg, '=');
+    size_t key_len = (value != NULL) ? (size_t)(value - arg) : strlen(arg);
+
+    for (size_t i = 0; i < sizeof(stream_options) / sizeof(stream_options[0]); i++)
+    {
+        const stream_option_t *option = &stream_options[i];
+        if (strlen(option->key) != key_len || strncmp(option->key, arg, key_len) != 0)
+        {
+            continue;
+        }
+
+        char *field = (char *)config + option->offset;
+        if (option->type == OPTION_FLAG)
+        {
+            if (value != NULL)
+            {
+                printf("Option --%s does not take a value\n", option->key);
+                return FISH_EINVAL;
+            }
+            *(bool *)field = true;
+            return FISH_EOK;
+        }
+
+        char *end = NULL;
+        if (value == NULL || value[1] == '\0')
+        {
+            printf("Option --%s needs a value\n", option->key);
+            return FISH_EINVAL;
+        }
+        if (option->type == OPTION_STRING)
+        {
+            *(const char **)field = value + 1;
+            return FISH_EOK;
+        }
+
+        unsigned long number = strtoul(value + 1, &end, 10);
+        if (*end != '\0')
+        {
+            printf("Option --%s expects a number: %s\n", option->key, value + 1);
+            return FISH_EINVAL;
+        }
+        *(uint32_t *)field = (uint32_t)number;
+        return FISH_EOK;
+    }
+
+    printf("Unknown option: --%.*s\n", (int)key_len, arg);
+    return FISH_EINVAL;
+}
+
+void printStreamOptions()
+{
+    size_t count = sizeof(stream_options) / sizeof(stream_options[0]);
+    for (size_t i = 0; i < count; i++)
+    {
+        const stream_option_t *option = &stream_options[i];
+        const char *value = "";
+        if (option->type == OPTION_UINT)
+        {
+            value = "=<n>";
+        }
+        else if (option->type == OPTION_STRING)
+        {
+            value = "=<text>";
+        }
+        printf("  --%s%s\t%s\n", option->key, value, option->help);
+    }
+}
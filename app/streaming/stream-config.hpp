@@ -0,0 +1,17 @@
+#ifndef __STREAM_CONFIG_HPP__
+#define __STREAM_CONFIG_HPP__
+
+#include "../common/fish_types.h"
+
+/* Description: Fills config with the defaults used when no option is given. */
+void initStreamConfig(fish_stream_config_t *config);
+
+/* Description: Applies a single "--key=value" (or "--flag") command line argument
+ *              to config. Returns FISH_EINVAL for unknown keys or bad values.
+ */
+fish_error_t parseStreamOption(const char *arg, fish_stream_config_t *config);
+
+/* Description: Prints every supported option with its help text. */
+void printStreamOptions();
+
+#endif /* __STREAM_CONFIG_HPP__ */
@@ -0,0 +1,702 @@
+#include "v4l2-capture.hpp"
+#include "video-source.hpp"
+
+#include <gst/app/gstappsrc.h>
+#include <gst/allocators/gstdmabuf.h>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define V4L2_DEFAULT_WIDTH 1280
+#define V4L2_DEFAULT_HEIGHT 720
+#define V4L2_DEFAULT_FPS 30
+#define V4L2_POLL_MS 200 // How quickly the capture thread notices a stop
+#define V4L2_REPORT_US (5 * G_USEC_PER_SEC)
+
+/* Raw formats in order of preference. NV12 and I420 go into the encoders without conversion. */
+static const struct
+{
+    uint32_t pixelformat;
+    GstVideoFormat format;
+} raw_formats[] = {
+    {V4L2_PIX_FMT_NV12, GST_VIDEO_FORMAT_NV12},
+    {V4L2_PIX_FMT_YUV420, GST_VIDEO_FORMAT_I420},
+    {V4L2_PIX_FMT_YUYV, GST_VIDEO_FORMAT_YUY2},
+    {V4L2_PIX_FMT_UYVY, GST_VIDEO_FORMAT_UYVY},
+};
+
+#define NUM_RAW_FORMATS (int)(sizeof(raw_formats) / sizeof(raw_formats[0]))
+
+static int xioctl(int fd, unsigned long request, void *arg)
+{
+    int ret;
+    do
+    {
+        ret = ioctl(fd, request, arg);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static GstClockTime monotonicNowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (GstClockTime)ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+static bool formatSupported(int fd, uint32_t pixelformat)
+{
+    struct v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (desc.index = 0; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++)
+    {
+        if (desc.pixelformat == pixelformat)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Applies format, size and rate, then reads back what the driver actually chose */
+static fish_error_t setFormat(fish_v4l2_capture_t *capture, uint32_t pixelformat,
+                              uint32_t width, uint32_t height, uint32_t fps)
+{
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.pixelformat = pixelformat;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(capture->fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != pixelformat)
+    {
+        return FISH_EINVAL;
+    }
+
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = fps;
+    // Not every driver lets the rate be set, in which case it runs at its default
+    xioctl(capture->fd, VIDIOC_S_PARM, &parm);
+    if (xioctl(capture->fd, VIDIOC_G_PARM, &parm) < 0 || parm.parm.capture.timeperframe.numerator == 0)
+    {
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = fps;
+    }
+
+    capture->pixelformat = pixelformat;
+    capture->width = fmt.fmt.pix.width;
+    capture->height = fmt.fmt.pix.height;
+    capture->bytesperline = fmt.fmt.pix.bytesperline;
+    capture->fps_n = parm.parm.capture.timeperframe.denominator;
+    capture->fps_d = parm.parm.capture.timeperframe.numerator;
+    return FISH_EOK;
+}
+
+/* True if the last setFormat() reached the requested size and rate, allowing for 29.97 fps and the like */
+static bool formatMeetsRequest(const fish_v4l2_capture_t *capture, uint32_t width, uint32_t height, uint32_t fps)
+{
+    return capture->width >= width && capture->height >= height &&
+           (uint64_t)capture->fps_n * 100 >= (uint64_t)fps * capture->fps_d * 95;
+}
+
+static int findRawFormat(int fd)
+{
+    for (int i = 0; i < NUM_RAW_FORMATS; i++)
+    {
+        if (formatSupported(fd, raw_formats[i].pixelformat))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t findMjpegFormat(int fd)
+{
+    if (formatSupported(fd, V4L2_PIX_FMT_MJPEG))
+    {
+        return V4L2_PIX_FMT_MJPEG;
+    }
+    if (formatSupported(fd, V4L2_PIX_FMT_JPEG))
+    {
+        return V4L2_PIX_FMT_JPEG;
+    }
+    return 0;
+}
+
+/* Picks the capture format from config->v4l2_format and what the camera offers */
+static fish_error_t chooseFormat(fish_v4l2_capture_t *capture, const fish_stream_config_t *config,
+                                 uint32_t width, uint32_t height, uint32_t fps)
+{
+    const char *wanted = config->v4l2_format;
+    int raw = findRawFormat(capture->fd);
+    uint32_t mjpeg = findMjpegFormat(capture->fd);
+
+    if (strcmp(wanted, "h264") == 0)
+    {
+        if (!formatSupported(capture->fd, V4L2_PIX_FMT_H264) ||
+            setFormat(capture, V4L2_PIX_FMT_H264, width, height, fps) != FISH_EOK)
+        {
+            printf("%s has no H.264 output\n", config->source_device);
+            return FISH_EINVAL;
+        }
+        capture->format = FISH_V4L2_H264;
+        return FISH_EOK;
+    }
+
+    if (strcmp(wanted, "mjpeg") == 0)
+    {
+        if (mjpeg == 0 || setFormat(capture, mjpeg, width, height, fps) != FISH_EOK)
+        {
+            printf("%s has no MJPEG output\n", config->source_device);
+            return FISH_EINVAL;
+        }
+        capture->format = FISH_V4L2_MJPEG;
+        return FISH_EOK;
+    }
+
+    if (strcmp(wanted, "raw") != 0 && strcmp(wanted, "auto") != 0)
+    {
+        printf("Unknown V4L2 format: %s\n", wanted);
+        return FISH_EINVAL;
+    }
+
+    // USB 2.0 cameras usually only manage low rates or sizes uncompressed, so "auto"
+    // falls back to MJPEG rather than stream less than was asked for
+    bool raw_ok = (raw >= 0 && setFormat(capture, raw_formats[raw].pixelformat, width, height, fps) == FISH_EOK);
+    if (raw_ok && (strcmp(wanted, "raw") == 0 || mjpeg == 0 || formatMeetsRequest(capture, width, height, fps)))
+    {
+        capture->format = FISH_V4L2_RAW;
+        return FISH_EOK;
+    }
+    if (strcmp(wanted, "auto") == 0 && mjpeg != 0 && setFormat(capture, mjpeg, width, height, fps) == FISH_EOK)
+    {
+        capture->format = FISH_V4L2_MJPEG;
+        return FISH_EOK;
+    }
+    if (raw_ok && setFormat(capture, raw_formats[raw].pixelformat, width, height, fps) == FISH_EOK)
+    {
+        // MJPEG was refused, so settle for the slower raw mode
+        capture->format = FISH_V4L2_RAW;
+        return FISH_EOK;
+    }
+
+    printf("%s has no usable %s output\n", config->source_device, wanted);
+    return FISH_EINVAL;
+}
+
+static fish_error_t buildCaps(fish_v4l2_capture_t *capture)
+{
+    if (capture->format == FISH_V4L2_RAW)
+    {
+        GstVideoFormat format = GST_VIDEO_FORMAT_UNKNOWN;
+        for (int i = 0; i < NUM_RAW_FORMATS; i++)
+        {
+            if (raw_formats[i].pixelformat == capture->pixelformat)
+            {
+                format = raw_formats[i].format;
+            }
+        }
+        gst_video_info_set_format(&capture->info, format, capture->width, capture->height);
+        GST_VIDEO_INFO_FPS_N(&capture->info) = capture->fps_n;
+        GST_VIDEO_INFO_FPS_D(&capture->info) = capture->fps_d;
+        capture->caps = gst_video_info_to_caps(&capture->info);
+    }
+    else if (capture->format == FISH_V4L2_MJPEG)
+    {
+        capture->caps = gst_caps_new_simple("image/jpeg",
+                                            "width", G_TYPE_INT, (int)capture->width,
+                                            "height", G_TYPE_INT, (int)capture->height,
+                                            "framerate", GST_TYPE_FRACTION, (int)capture->fps_n, (int)capture->fps_d,
+                                            NULL);
+    }
+    else
+    {
+        // UVC cameras deliver one access unit per buffer
+        capture->caps = gst_caps_new_simple("video/x-h264",
+                                            "stream-format", G_TYPE_STRING, "byte-stream",
+                                            "alignment", G_TYPE_STRING, "au",
+                                            "width", G_TYPE_INT, (int)capture->width,
+                                            "height", G_TYPE_INT, (int)capture->height,
+                                            "framerate", GST_TYPE_FRACTION, (int)capture->fps_n, (int)capture->fps_d,
+                                            NULL);
+    }
+    return (capture->caps != NULL) ? FISH_EOK : FISH_EINVAL;
+}
+
+static fish_error_t mapBuffers(fish_v4l2_capture_t *capture, const fish_stream_config_t *config)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = CLAMP(config->v4l2_buffers, 2, MAX_V4L2_BUFFERS);
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(capture->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+    {
+        printf("%s: could not allocate capture buffers: %s\n", config->source_device, strerror(errno));
+        return FISH_EIO;
+    }
+    capture->num_buffers = MIN(req.count, (uint32_t)MAX_V4L2_BUFFERS);
+
+    bool export_dmabuf = (strcmp(config->v4l2_io, "dmabuf") == 0);
+    for (uint32_t i = 0; i < capture->num_buffers; i++)
+    {
+        fish_v4l2_buffer_t *buffer = &capture->buffers[i];
+        struct v4l2_buffer vbuf;
+        memset(&vbuf, 0, sizeof(vbuf));
+        vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        vbuf.memory = V4L2_MEMORY_MMAP;
+        vbuf.index = i;
+        if (xioctl(capture->fd, VIDIOC_QUERYBUF, &vbuf) < 0)
+        {
+            return FISH_EIO;
+        }
+
+        buffer->capture = capture;
+        buffer->index = i;
+        buffer->length = vbuf.length;
+        buffer->start = mmap(NULL, vbuf.length, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, vbuf.m.offset);
+        if (buffer->start == MAP_FAILED)
+        {
+            buffer->start = NULL;
+            printf("%s: mmap failed: %s\n", config->source_device, strerror(errno));
+            return FISH_EIO;
+        }
+
+        if (export_dmabuf)
+        {
+            struct v4l2_exportbuffer expbuf;
+            memset(&expbuf, 0, sizeof(expbuf));
+            expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            expbuf.index = i;
+            expbuf.flags = O_RDONLY | O_CLOEXEC;
+            if (xioctl(capture->fd, VIDIOC_EXPBUF, &expbuf) == 0)
+            {
+                buffer->dmabuf_fd = expbuf.fd;
+            }
+            else
+            {
+                // Older UVC drivers cannot export, the mmapped memory works the same
+                printf("%s cannot export DMABUF, using mmap\n", config->source_device);
+                export_dmabuf = false;
+            }
+        }
+    }
+
+    if (export_dmabuf)
+    {
+        capture->dmabuf_allocator = gst_dmabuf_allocator_new();
+    }
+    return FISH_EOK;
+}
+
+static bool queueBuffer(fish_v4l2_capture_t *capture, uint32_t index)
+{
+    struct v4l2_buffer vbuf;
+    memset(&vbuf, 0, sizeof(vbuf));
+    vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    vbuf.memory = V4L2_MEMORY_MMAP;
+    vbuf.index = index;
+    if (xioctl(capture->fd, VIDIOC_QBUF, &vbuf) < 0)
+    {
+        return false;
+    }
+    capture->queued++;
+    return true;
+}
+
+/* Memory destroy notify: the pipeline is done with the frame, so the driver may refill it */
+static void requeueBuffer(gpointer data)
+{
+    fish_v4l2_buffer_t *buffer = (fish_v4l2_buffer_t *)data;
+    if (buffer->capture->running)
+    {
+        queueBuffer(buffer->capture, buffer->index);
+    }
+}
+
+/* Raw rows are often padded, which the caps alone cannot describe */
+static void addVideoMeta(fish_v4l2_capture_t *capture, GstBuffer *buf)
+{
+    const GstVideoInfo *info = &capture->info;
+    if (capture->bytesperline == 0 || (gint)capture->bytesperline == GST_VIDEO_INFO_PLANE_STRIDE(info, 0))
+    {
+        return;
+    }
+
+    gsize offset[GST_VIDEO_MAX_PLANES] = {0};
+    gint stride[GST_VIDEO_MAX_PLANES] = {0};
+    gint bpl = (gint)capture->bytesperline;
+    stride[0] = bpl;
+    if (GST_VIDEO_INFO_FORMAT(info) == GST_VIDEO_FORMAT_NV12)
+    {
+        stride[1] = bpl;
+        offset[1] = (gsize)bpl * capture->height;
+    }
+    else if (GST_VIDEO_INFO_FORMAT(info) == GST_VIDEO_FORMAT_I420)
+    {
+        stride[1] = bpl / 2;
+        stride[2] = bpl / 2;
+        offset[1] = (gsize)bpl * capture->height;
+        offset[2] = offset[1] + (gsize)(bpl / 2) * ((capture->height + 1) / 2);
+    }
+    gst_buffer_add_video_meta_full(buf, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_INFO_FORMAT(info),
+                                   capture->width, capture->height, GST_VIDEO_INFO_N_PLANES(info), offset, stride);
+}
+
+/* Wraps a dequeued driver buffer, or copies it if it is the last one the driver would have */
+static GstBuffer *wrapFrame(fish_v4l2_capture_t *capture, const struct v4l2_buffer *vbuf, bool *copied)
+{
+    fish_v4l2_buffer_t *buffer = &capture->buffers[vbuf->index];
+    GstBuffer *buf;
+
+    *copied = (capture->queued == 0);
+    if (*copied)
+    {
+        buf = gst_buffer_new_allocate(NULL, vbuf->bytesused, NULL);
+        gst_buffer_fill(buf, 0, buffer->start, vbuf->bytesused);
+        queueBuffer(capture, vbuf->index);
+    }
+    else if (capture->dmabuf_allocator != NULL)
+    {
+        GstMemory *mem = gst_dmabuf_allocator_alloc_with_flags(capture->dmabuf_allocator, buffer->dmabuf_fd,
+                                                               buffer->length, GST_FD_MEMORY_FLAG_DONT_CLOSE);
+        gst_memory_resize(mem, 0, vbuf->bytesused);
+        // Tied to the memory rather than the buffer, since copies of the buffer share it
+        gst_mini_object_set_qdata(GST_MINI_OBJECT(mem), g_quark_from_static_string("fish-v4l2-buffer"),
+                                  buffer, requeueBuffer);
+        buf = gst_buffer_new();
+        gst_buffer_append_memory(buf, mem);
+    }
+    else
+    {
+        buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, buffer->start, buffer->length,
+                                          0, vbuf->bytesused, buffer, requeueBuffer);
+    }
+
+    if (capture->format == FISH_V4L2_RAW)
+    {
+        addVideoMeta(capture, buf);
+    }
+    return buf;
+}
+
+static void reportCapture(fish_v4l2_capture_t *capture)
+{
+    gint64 now_us = g_get_monotonic_time();
+    if (now_us - capture->report_us < V4L2_REPORT_US)
+    {
+        return;
+    }
+    capture->report_us = now_us;
+
+    std::lock_guard<std::mutex> lock(capture->stats_mtx);
+    capture->stats.avg_delay_ms = capture->delay_count ? capture->delay_sum_ms / capture->delay_count : 0.0;
+    printf(">> V4L2: %llu frames, %llu dropped by the driver, %llu copied, capture to push avg %.1fms max %.1fms\n",
+           (unsigned long long)capture->stats.frames, (unsigned long long)capture->stats.dropped,
+           (unsigned long long)capture->stats.copies, capture->stats.avg_delay_ms, capture->stats.max_delay_ms);
+    capture->delay_sum_ms = 0.0;
+    capture->delay_count = 0;
+    capture->stats.max_delay_ms = 0.0;
+}
+
+/* Handles one dequeued frame. Returns false when the pipeline is shutting down. */
+static bool pushFrame(fish_v4l2_capture_t *capture, const struct v4l2_buffer *vbuf, GstCaps *ref_caps)
+{
+    GstClock *clock = gst_element_get_clock(capture->appsrc);
+    if (clock == NULL)
+    {
+        queueBuffer(capture, vbuf->index);
+        std::lock_guard<std::mutex> lock(capture->stats_mtx);
+        capture->stats.not_playing++;
+        return true;
+    }
+
+    // The driver stamps frames on CLOCK_MONOTONIC when they are captured. The pipeline
+    // clock may be another clock (e.g. the audio device's), so carry over the age instead.
+    GstClockTime now_ns = monotonicNowNs();
+    GstClockTime capture_ns = now_ns;
+    if ((vbuf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        capture_ns = (GstClockTime)vbuf->timestamp.tv_sec * GST_SECOND + (GstClockTime)vbuf->timestamp.tv_usec * GST_USECOND;
+    }
+    GstClockTime delay_ns = (now_ns > capture_ns) ? now_ns - capture_ns : 0;
+    GstClockTime running_ns = gst_clock_get_time(clock) - gst_element_get_base_time(capture->appsrc);
+    gst_object_unref(clock);
+
+    bool copied;
+    GstBuffer *buf = wrapFrame(capture, vbuf, &copied);
+    GST_BUFFER_PTS(buf) = (running_ns > delay_ns) ? running_ns - delay_ns : 0;
+    GST_BUFFER_DURATION(buf) = gst_util_uint64_scale_int(GST_SECOND, capture->fps_d, capture->fps_n);
+    GST_BUFFER_OFFSET(buf) = vbuf->sequence;
+    gst_buffer_add_reference_timestamp_meta(buf, ref_caps, capture_ns, GST_CLOCK_TIME_NONE);
+
+    {
+        std::lock_guard<std::mutex> lock(capture->stats_mtx);
+        if (capture->have_sequence && vbuf->sequence != capture->last_sequence + 1)
+        {
+            capture->stats.dropped += vbuf->sequence - capture->last_sequence - 1;
+            GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DISCONT);
+        }
+        capture->have_sequence = true;
+        capture->last_sequence = vbuf->sequence;
+
+        double delay_ms = delay_ns / (double)GST_MSECOND;
+        capture->stats.frames++;
+        capture->stats.copies += copied ? 1 : 0;
+        capture->stats.max_delay_ms = MAX(capture->stats.max_delay_ms, delay_ms);
+        capture->delay_sum_ms += delay_ms;
+        capture->delay_count++;
+    }
+
+    return gst_app_src_push_buffer(GST_APP_SRC(capture->appsrc), buf) == GST_FLOW_OK;
+}
+
+static void captureLoop(fish_v4l2_capture_t *capture)
+{
+    GstCaps *ref_caps = gst_caps_new_empty_simple(FISH_V4L2_TIMESTAMP_CAPS);
+    struct pollfd pfd;
+    pfd.fd = capture->fd;
+    pfd.events = POLLIN;
+
+    while (capture->running)
+    {
+        int ret = poll(&pfd, 1, V4L2_POLL_MS);
+        if (ret <= 0)
+        {
+            continue;
+        }
+
+        struct v4l2_buffer vbuf;
+        memset(&vbuf, 0, sizeof(vbuf));
+        vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        vbuf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(capture->fd, VIDIOC_DQBUF, &vbuf) < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                continue;
+            }
+            printf("V4L2 capture stopped: %s\n", strerror(errno));
+            gst_app_src_end_of_stream(GST_APP_SRC(capture->appsrc));
+            break;
+        }
+        capture->queued--;
+
+        if (vbuf.flags & V4L2_BUF_FLAG_ERROR)
+        {
+            queueBuffer(capture, vbuf.index);
+            continue;
+        }
+        if (!pushFrame(capture, &vbuf, ref_caps))
+        {
+            break;
+        }
+        reportCapture(capture);
+    }
+
+    gst_caps_unref(ref_caps);
+}
+
+fish_error_t openV4l2Capture(fish_v4l2_capture_t *capture, const fish_stream_config_t *config)
+{
+    capture->fd = -1;
+    capture->caps = NULL;
+    capture->num_buffers = 0;
+    capture->dmabuf_allocator = NULL;
+    capture->appsrc = NULL;
+    capture->running = false;
+    capture->queued = 0;
+    capture->stats = fish_v4l2_stats_t();
+    capture->have_sequence = false;
+    capture->last_sequence = 0;
+    capture->delay_sum_ms = 0.0;
+    capture->delay_count = 0;
+    capture->report_us = g_get_monotonic_time();
+    for (int i = 0; i < MAX_V4L2_BUFFERS; i++)
+    {
+        capture->buffers[i].start = NULL;
+        capture->buffers[i].dmabuf_fd = -1;
+    }
+
+    capture->fd = open(config->source_device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (capture->fd < 0)
+    {
+        printf("Could not open %s: %s\n", config->source_device, strerror(errno));
+        return FISH_EIO;
+    }
+
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(capture->fd, VIDIOC_QUERYCAP, &cap) < 0)
+    {
+        printf("%s is not a V4L2 device\n", config->source_device);
+        teardownV4l2Capture(capture);
+        return FISH_EINVAL;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+    {
+        printf("%s cannot stream video capture\n", config->source_device);
+        teardownV4l2Capture(capture);
+        return FISH_EINVAL;
+    }
+
+    // Size and rate come from --source-caps, like the other sources
+    int width = V4L2_DEFAULT_WIDTH;
+    int height = V4L2_DEFAULT_HEIGHT;
+    int fps_n = V4L2_DEFAULT_FPS;
+    int fps_d = 1;
+    if (config->source_caps[0] != '\0')
+    {
+        GstCaps *wanted = gst_caps_from_string(config->source_caps);
+        if (wanted != NULL && gst_caps_get_size(wanted) > 0)
+        {
+            GstStructure *s = gst_caps_get_structure(wanted, 0);
+            gst_structure_get_int(s, "width", &width);
+            gst_structure_get_int(s, "height", &height);
+            gst_structure_get_fraction(s, "framerate", &fps_n, &fps_d);
+        }
+        if (wanted != NULL)
+        {
+            gst_caps_unref(wanted);
+        }
+    }
+    uint32_t fps = (fps_d > 0) ? (uint32_t)MAX(1, fps_n / fps_d) : V4L2_DEFAULT_FPS;
+
+    if (chooseFormat(capture, config, width, height, fps) != FISH_EOK ||
+        buildCaps(capture) != FISH_EOK ||
+        mapBuffers(capture, config) != FISH_EOK)
+    {
+        teardownV4l2Capture(capture);
+        return FISH_EINVAL;
+    }
+
+    const char *names[] = {"raw", "MJPEG", "H.264"};
+    printf(">> V4L2 %s: %s %ux%u at %u/%u fps, %u %s buffers\n", config->source_device,
+           names[capture->format], capture->width, capture->height, capture->fps_n, capture->fps_d,
+           capture->num_buffers, capture->dmabuf_allocator ? "DMABUF" : "mmap");
+    return FISH_EOK;
+}
+
+std::string v4l2CaptureDesc(const fish_v4l2_capture_t *capture)
+{
+    gchar *caps = gst_caps_to_string(capture->caps);
+    std::string desc = "appsrc name=" VIDEO_SOURCE_NAME " is-live=true format=time do-timestamp=false caps=\"";
+    desc += caps;
+    desc += "\"";
+    g_free(caps);
+
+    if (capture->format == FISH_V4L2_MJPEG)
+    {
+        // The Jetson decoder leaves the CPU free for the encoder
+        GstElementFactory *factory = gst_element_factory_find("nvjpegdec");
+        desc += (factory != NULL) ? " ! nvjpegdec" : " ! jpegdec";
+        if (factory != NULL)
+        {
+            gst_object_unref(factory);
+        }
+    }
+    return desc;
+}
+
+fish_error_t startV4l2Capture(fish_v4l2_capture_t *capture, GstElement *pipeline)
+{
+    capture->appsrc = gst_bin_get_by_name(GST_BIN(pipeline), VIDEO_SOURCE_NAME);
+    if (capture->appsrc == NULL)
+    {
+        printf("Pipeline has no %s to capture into\n", VIDEO_SOURCE_NAME);
+        return FISH_EINVAL;
+    }
+
+    capture->running = true;
+    for (uint32_t i = 0; i < capture->num_buffers; i++)
+    {
+        queueBuffer(capture, i);
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(capture->fd, VIDIOC_STREAMON, &type) < 0)
+    {
+        printf("Could not start V4L2 streaming: %s\n", strerror(errno));
+        capture->running = false;
+        return FISH_EIO;
+    }
+
+    capture->thread = std::thread(captureLoop, capture);
+    return FISH_EOK;
+}
+
+void getV4l2CaptureStats(fish_v4l2_capture_t *capture, fish_v4l2_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(capture->stats_mtx);
+    *stats = capture->stats;
+    if (capture->delay_count != 0)
+    {
+        stats->avg_delay_ms = capture->delay_sum_ms / capture->delay_count;
+    }
+}
+
+void teardownV4l2Capture(fish_v4l2_capture_t *capture)
+{
+    capture->running = false;
+    if (capture->thread.joinable())
+    {
+        capture->thread.join();
+    }
+
+    if (capture->fd >= 0)
+    {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(capture->fd, VIDIOC_STREAMOFF, &type);
+    }
+
+    for (uint32_t i = 0; i < capture->num_buffers; i++)
+    {
+        fish_v4l2_buffer_t *buffer = &capture->buffers[i];
+        if (buffer->dmabuf_fd >= 0)
+        {
+            close(buffer->dmabuf_fd);
+            buffer->dmabuf_fd = -1;
+        }
+        if (buffer->start != NULL)
+        {
+            munmap(buffer->start, buffer->length);
+            buffer->start = NULL;
+        }
+    }
+    capture->num_buffers = 0;
+
+    if (capture->dmabuf_allocator != NULL)
+    {
+        gst_object_unref(capture->dmabuf_allocator);
+        capture->dmabuf_allocator = NULL;
+    }
+    if (capture->caps != NULL)
+    {
+        gst_caps_unref(capture->caps);
+        capture->caps = NULL;
+    }
+    if (capture->appsrc != NULL)
+    {
+        gst_object_unref(capture->appsrc);
+        capture->appsrc = NULL;
+    }
+    if (capture->fd >= 0)
+    {
+        close(capture->fd);
+        capture->fd = -1;
+    }
+}
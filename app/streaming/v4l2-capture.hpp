@@ -0,0 +1,106 @@
+#ifndef __V4L2_CAPTURE_HPP__
+#define __V4L2_CAPTURE_HPP__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../common/fish_types.h"
+
+#define MAX_V4L2_BUFFERS 16
+#define FISH_V4L2_TIMESTAMP_CAPS "timestamp/x-v4l2-monotonic" // Reference timestamp meta holding the driver's capture time
+
+/* What the camera sends, which decides what follows the appsrc */
+typedef enum
+{
+    FISH_V4L2_RAW,   /* Uncompressed frames go straight to the scale/encode stage */
+    FISH_V4L2_MJPEG, /* Decoded once, then encoded like raw frames */
+    FISH_V4L2_H264   /* Sent as is, without decoding or re-encoding */
+} fish_v4l2_format_t;
+
+typedef struct fish_v4l2_capture fish_v4l2_capture_t;
+
+/* One driver buffer, mapped once for the lifetime of the capture */
+typedef struct
+{
+    fish_v4l2_capture_t *capture;
+    uint32_t index;
+    void *start;
+    size_t length;
+    int dmabuf_fd; // -1 unless exported for --v4l2-io=dmabuf
+} fish_v4l2_buffer_t;
+
+typedef struct
+{
+    uint64_t frames;      // Frames pushed into the pipeline
+    uint64_t dropped;     // Gaps in the driver's frame sequence
+    uint64_t copies;      // Frames copied because downstream held every other driver buffer
+    uint64_t not_playing; // Frames handed back before the pipeline had a clock
+    double avg_delay_ms;  // Capture timestamp to push, over the last report interval
+    double max_delay_ms;
+} fish_v4l2_stats_t;
+
+struct fish_v4l2_capture
+{
+    int fd;
+    fish_v4l2_format_t format;
+    uint32_t pixelformat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesperline;
+    uint32_t fps_n;
+    uint32_t fps_d;
+    GstVideoInfo info; // Raw formats only
+    GstCaps *caps;
+
+    fish_v4l2_buffer_t buffers[MAX_V4L2_BUFFERS];
+    uint32_t num_buffers;
+    GstAllocator *dmabuf_allocator; // NULL when buffers are wrapped as plain memory
+
+    GstElement *appsrc;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<int> queued; // Buffers currently owned by the driver
+
+    std::mutex stats_mtx;
+    fish_v4l2_stats_t stats;
+    uint32_t last_sequence;
+    bool have_sequence;
+    double delay_sum_ms;
+    uint64_t delay_count;
+    gint64 report_us;
+};
+
+/* Description: Opens config->source_device and picks a format: raw when the camera can
+ *              deliver the requested size and rate uncompressed, MJPEG when it cannot, or
+ *              whatever config->v4l2_format forces. The size and rate come from
+ *              config->source_caps, 1280x720 at 30 fps by default. Driver buffers are
+ *              mmapped, and exported as DMABUF when config->v4l2_io asks for it.
+ */
+fish_error_t openV4l2Capture(fish_v4l2_capture_t *capture, const fish_stream_config_t *config);
+
+/* Description: Builds the head of a launch string for an opened capture: an appsrc named
+ *              VIDEO_SOURCE_NAME with the negotiated caps, plus a JPEG decoder for MJPEG.
+ *              Raw and MJPEG continue into videoSendDesc(), H.264 into h264LiveSendDesc().
+ */
+std::string v4l2CaptureDesc(const fish_v4l2_capture_t *capture);
+
+/* Description: Starts streaming into the appsrc of pipeline. Frames are pushed without
+ *              copying and go back to the driver when the pipeline frees them. Each buffer's
+ *              PTS is its capture time in pipeline running time, and the raw driver
+ *              timestamp is attached as a reference timestamp meta.
+ */
+fish_error_t startV4l2Capture(fish_v4l2_capture_t *capture, GstElement *pipeline);
+
+/* Description: Copies out the current counters. Safe to call from any thread. */
+void getV4l2CaptureStats(fish_v4l2_capture_t *capture, fish_v4l2_stats_t *stats);
+
+/* Description: Stops the capture thread and releases the device. Call after the pipeline
+ *              has been set to GST_STATE_NULL, so no frame is still in use.
+ */
+void teardownV4l2Capture(fish_v4l2_capture_t *capture);
+
+#endif /* __V4L2_CAPTURE_HPP__ */
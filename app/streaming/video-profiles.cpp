@@ -0,0 +1,155 @@
+#include "video-profiles.hpp"
+#include "simulcast.hpp"
+
+#include <string.h>
+#include <stdio.h>
+
+/* Capture runs at 1280x720, so profiles only ever scale down */
+static const fish_video_profile_t video_profiles[] = {
+    {"720p60", 1280, 720, 60},
+    {"720p30", 1280, 720, 30},
+    {"480p30", 852, 480, 30},
+    {"480p15", 852, 480, 15},
+    {"360p30", 640, 360, 30},
+    {"240p15", 426, 240, 15},
+};
+
+#define NUM_VIDEO_PROFILES (int)(sizeof(video_profiles) / sizeof(video_profiles[0]))
+
+int findVideoProfile(const char *name)
+{
+    for (int i = 0; name != NULL && i < NUM_VIDEO_PROFILES; i++)
+    {
+        if (strcmp(video_profiles[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const fish_video_profile_t *getVideoProfile(int index)
+{
+    if (index < 0 || index >= NUM_VIDEO_PROFILES)
+    {
+        return NULL;
+    }
+    return &video_profiles[index];
+}
+
+std::string videoProfileCaps(int index, bool nvmm)
+{
+    const fish_video_profile_t *profile = getVideoProfile(index);
+    if (profile == NULL)
+    {
+        profile = &video_profiles[findVideoProfile("480p30")];
+    }
+
+    // videorate drop-only can never raise the rate, so sources slower than the profile (or
+    // variable rate files, 0/1) pass at their own rate instead of failing to negotiate
+    char caps[160];
+    snprintf(caps, sizeof(caps), "video/x-raw%s, width=(int)%d, height=(int)%d, framerate=(fraction)[ 0/1, %d/1 ]",
+             nvmm ? "(memory:NVMM)" : "", profile->width, profile->height, profile->fps);
+    return caps;
+}
+
+fish_error_t applyVideoProfile(GstElement *pipeline, int index)
+{
+    const fish_video_profile_t *profile = getVideoProfile(index);
+    if (profile == NULL)
+    {
+        printf("Unknown video profile %d\n", index);
+        return FISH_EINVAL;
+    }
+
+    GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), PROFILE_CAPS_NAME);
+    if (capsfilter == NULL)
+    {
+        printf("Pipeline has no %s stage, cannot switch profile\n", PROFILE_CAPS_NAME);
+        return FISH_EPERM;
+    }
+
+    GstCaps *current = NULL;
+    g_object_get(capsfilter, "caps", &current, NULL);
+
+    // nvv4l2h264enc does not reliably take a new resolution mid-stream, so NVMM pipelines,
+    // which are the ones encoding in hardware, only switch framerate
+    int width = 0;
+    int height = 0;
+    GstCapsFeatures *features = (current != NULL) ? gst_caps_get_features(current, 0) : NULL;
+    if (features != NULL && gst_caps_features_contains(features, "memory:NVMM") &&
+        gst_structure_get_int(gst_caps_get_structure(current, 0), "width", &width) &&
+        gst_structure_get_int(gst_caps_get_structure(current, 0), "height", &height) &&
+        (width != profile->width || height != profile->height))
+    {
+        printf("Hardware encoder cannot switch to %dx%d mid-stream, keeping the current profile\n",
+               profile->width, profile->height);
+        gst_caps_unref(current);
+        gst_object_unref(capsfilter);
+        return FISH_EINVAL;
+    }
+
+    // Keep the memory features and format of the current caps, only swap the geometry
+    GstCaps *caps = (current != NULL) ? gst_caps_copy(current) : gst_caps_new_empty_simple("video/x-raw");
+    gst_caps_set_simple(caps,
+                        "width", G_TYPE_INT, profile->width,
+                        "height", G_TYPE_INT, profile->height,
+                        "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, profile->fps, 1,
+                        NULL);
+
+    // Caps upstream cannot produce would end the stream with not-negotiated
+    GstPad *sink = gst_element_get_static_pad(capsfilter, "sink");
+    GstCaps *possible = gst_pad_peer_query_caps(sink, caps);
+    bool deliverable = (possible != NULL && !gst_caps_is_empty(possible));
+    if (possible != NULL)
+    {
+        gst_caps_unref(possible);
+    }
+    gst_object_unref(sink);
+
+    fish_error_t err = FISH_EOK;
+    if (deliverable)
+    {
+        g_object_set(capsfilter, "caps", caps, NULL);
+        resizeSimulcastLayers(pipeline, index);
+        printf(">> Switched video profile to %s\n", profile->name);
+    }
+    else
+    {
+        printf("Source cannot deliver video profile %s, keeping the current one\n", profile->name);
+        err = FISH_EINVAL;
+    }
+
+    gst_caps_unref(caps);
+    if (current != NULL)
+    {
+        gst_caps_unref(current);
+    }
+    gst_object_unref(capsfilter);
+
+    return err;
+}
+
+void updateVideoProfile(GstElement *pipeline, fish_handle_t *handle)
+{
+    fish_handle_mtx.lock();
+    int next_profile = handle->next_video_profile;
+    fish_handle_mtx.unlock();
+
+    if (next_profile == handle->curr_video_profile)
+    {
+        return;
+    }
+
+    if (applyVideoProfile(pipeline, next_profile) == FISH_EOK)
+    {
+        handle->curr_video_profile = next_profile;
+    }
+    else
+    {
+        // Don't retry a bad request every tick
+        fish_handle_mtx.lock();
+        handle->next_video_profile = handle->curr_video_profile;
+        fish_handle_mtx.unlock();
+    }
+}
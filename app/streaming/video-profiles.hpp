@@ -0,0 +1,47 @@
+#ifndef __VIDEO_PROFILES_HPP__
+#define __VIDEO_PROFILES_HPP__
+
+#include <gst/gst.h>
+#include <string>
+
+#include "../common/fish_types.h"
+
+/* Name of the capsfilter every streaming pipeline places after its scale/rate stage */
+#define PROFILE_CAPS_NAME "profile_caps"
+
+typedef struct
+{
+    const char *name;
+    int width;
+    int height;
+    int fps;
+} fish_video_profile_t;
+
+/* Description: Returns the index of the named profile, or -1 if there is none. */
+int findVideoProfile(const char *name);
+
+/* Description: Returns the profile at index, or NULL if out of range. */
+const fish_video_profile_t *getVideoProfile(int index);
+
+/* Description: Builds the launch-string caps for a profile, e.g. for the initial
+ *              value of the profile capsfilter. The profile framerate is an upper
+ *              bound, slower sources keep their own rate. Set nvmm for Jetson NVMM
+ *              buffers.
+ */
+std::string videoProfileCaps(int index, bool nvmm);
+
+/* Description: Switches the running pipeline to a new profile by changing the caps on
+ *              its profile capsfilter. Upstream scale/rate elements renegotiate in place
+ *              and the software encoder restarts on a keyframe; nothing is torn down. The
+ *              hardware encoder path only switches between profiles of the same size.
+ *              Returns FISH_EINVAL, leaving the pipeline as it is, if upstream cannot
+ *              produce the profile or the hardware encoder would have to resize.
+ */
+fish_error_t applyVideoProfile(GstElement *pipeline, int index);
+
+/* Description: Applies handle->next_video_profile if the control socket changed it.
+ *              Call periodically from the thread that owns the pipeline.
+ */
+void updateVideoProfile(GstElement *pipeline, fish_handle_t *handle);
+
+#endif /* __VIDEO_PROFILES_HPP__ */
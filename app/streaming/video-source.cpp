@@ -0,0 +1,121 @@
+#include "video-source.hpp"
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+
+// shmsrc carries no caps of its own and the others fall back to these when --source-caps is empty
+static const fish_video_source_t video_sources[] = {
+    {"csi", "nvarguscamerasrc", true, true,
+     "video/x-raw(memory:NVMM), format=(string)NV12, width=(int)1280, height=(int)720, framerate=(fraction)60/1"},
+    {"v4l2", "v4l2src", true, false, "video/x-raw"},
+    {"file", "filesrc", false, false, NULL},
+    {"test", "videotestsrc", true, false, "video/x-raw, width=(int)1280, height=(int)720, framerate=(fraction)30/1"},
+    {"shm", "shmsrc", true, false, "video/x-raw, format=(string)I420, width=(int)1280, height=(int)720, framerate=(fraction)30/1"},
+    {"v4l2-direct", "appsrc", true, false, NULL},
+};
+
+#define NUM_VIDEO_SOURCES (int)(sizeof(video_sources) / sizeof(video_sources[0]))
+
+static bool elementInstalled(const char *name)
+{
+    GstElementFactory *factory = gst_element_factory_find(name);
+    if (factory == NULL)
+    {
+        return false;
+    }
+    gst_object_unref(factory);
+    return true;
+}
+
+int findVideoSource(const char *name)
+{
+    for (int i = 0; i < NUM_VIDEO_SOURCES; i++)
+    {
+        if (strcmp(video_sources[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const fish_video_source_t *getVideoSource(int type)
+{
+    if (type < 0 || type >= NUM_VIDEO_SOURCES)
+    {
+        return NULL;
+    }
+    return &video_sources[type];
+}
+
+int selectVideoSource(const fish_stream_config_t *config)
+{
+    int type;
+    if (strcmp(config->video_source, "auto") == 0)
+    {
+        type = elementInstalled(video_sources[FISH_SOURCE_CSI].element) ? FISH_SOURCE_CSI : FISH_SOURCE_FILE;
+    }
+    else
+    {
+        type = findVideoSource(config->video_source);
+        if (type < 0)
+        {
+            printf("Unknown video source: %s\n", config->video_source);
+            return -1;
+        }
+    }
+
+    const fish_video_source_t *source = &video_sources[type];
+    if (!elementInstalled(source->element))
+    {
+        printf("Video source %s needs the %s element, which is not installed\n", source->name, source->element);
+        return -1;
+    }
+
+    printf(">> Video source: %s\n", source->name);
+    return type;
+}
+
+std::string videoSourceDesc(const fish_stream_config_t *config, int type)
+{
+    const fish_video_source_t *source = getVideoSource(type);
+    if (source == NULL || type == FISH_SOURCE_V4L2_DIRECT)
+    {
+        return "";
+    }
+
+    std::string desc = std::string(source->element) + " name=" VIDEO_SOURCE_NAME;
+    switch (type)
+    {
+    case FISH_SOURCE_V4L2:
+        desc += " device=" + std::string(config->source_device);
+        break;
+    case FISH_SOURCE_FILE:
+        // decodebin picks the hardware decoder where there is one. Nothing downstream
+        // pushes back through the leaky queues, so hold every frame until its running
+        // time here; otherwise the file decodes as fast as it can and the queues drop it
+        desc += " location=\"" + std::string(config->file) + "\" ! decodebin ! identity sync=true";
+        break;
+    case FISH_SOURCE_TEST:
+        desc += " is-live=true pattern=smpte";
+        break;
+    case FISH_SOURCE_SHM:
+        // The writer's timestamps mean nothing in this process, so restamp on arrival
+        desc += " socket-path=" + std::string(config->shm_socket) + " is-live=true do-timestamp=true";
+        break;
+    default:
+        break;
+    }
+
+    if (config->source_caps[0] != '\0')
+    {
+        desc += " ! " + std::string(config->source_caps);
+    }
+    else if (source->default_caps != NULL)
+    {
+        desc += " ! " + std::string(source->default_caps);
+    }
+
+    return desc;
+}
@@ -0,0 +1,51 @@
+#ifndef __VIDEO_SOURCE_HPP__
+#define __VIDEO_SOURCE_HPP__
+
+#include <string>
+
+#include "../common/fish_types.h"
+
+#define VIDEO_SOURCE_NAME "video_src" // Name of the capture element in every source chain
+
+/* Where video frames come from. Values index the source table. */
+typedef enum
+{
+    FISH_SOURCE_CSI,        /* Jetson CSI2 camera through nvarguscamerasrc, NVMM buffers */
+    FISH_SOURCE_V4L2,       /* USB or other V4L2 camera through v4l2src */
+    FISH_SOURCE_FILE,       /* Decoded video file, paced to real time at the source */
+    FISH_SOURCE_TEST,       /* videotestsrc pattern, needs no hardware */
+    FISH_SOURCE_SHM,        /* Raw frames written to a shmsink socket by another process */
+    FISH_SOURCE_V4L2_DIRECT /* V4L2 camera read by v4l2-capture.cpp, see v4l2CaptureDesc() */
+} fish_source_type_t;
+
+typedef struct
+{
+    const char *name;         // Value of --source
+    const char *element;      // Factory that has to be installed for the source to work
+    bool live;                // Buffers are stamped at capture instead of read from a file
+    bool nvmm;                // Buffers are in Jetson NVMM memory
+    const char *default_caps; // Used when --source-caps is empty, NULL to negotiate freely
+} fish_video_source_t;
+
+/* Description: Returns the source with the given --source name, or -1 if there is none.
+ *              "auto" is not resolved here.
+ */
+int findVideoSource(const char *name);
+
+/* Description: Returns the source of the given type, or NULL if out of range. */
+const fish_video_source_t *getVideoSource(int type);
+
+/* Description: Resolves config->video_source to a source type. "auto" picks the CSI
+ *              camera when nvarguscamerasrc is installed and the file otherwise. Returns
+ *              -1 if the name is unknown or its element is not installed.
+ */
+int selectVideoSource(const fish_stream_config_t *config);
+
+/* Description: Builds the head of a launch string for the source, ending in raw video
+ *              (NVMM for the CSI camera) so it can be followed by videoSendDesc(). The
+ *              capture element is named VIDEO_SOURCE_NAME. FISH_SOURCE_V4L2_DIRECT has no
+ *              fixed head, since it depends on the format the camera was opened with.
+ */
+std::string videoSourceDesc(const fish_stream_config_t *config, int type);
+
+#endif /* __VIDEO_SOURCE_HPP__ */
@@ -0,0 +1,248 @@
+#include <gst/gst.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "processing/color-kernels.hpp"
+
+typedef struct
+{
+    const char *name;
+    int width;
+    int height;
+} bench_size_t;
+
+static const bench_size_t bench_sizes[] = {
+    {"480p", 640, 480},
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+};
+
+typedef struct
+{
+    gint64 entered_us;
+    gint64 total_us;
+    int frames;
+} element_stats_t;
+
+/* Points frame at the planes of a contiguous I420 or NV12 image, the layout cvtColor expects */
+static void wrapFrame(cv::Mat &yuv, int width, int height, GstVideoFormat format, fish_frame_t *frame)
+{
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    frame->pts = 0;
+    frame->y = cv::Mat(height, width, CV_8UC1, yuv.ptr(0));
+    if (format == GST_VIDEO_FORMAT_NV12)
+    {
+        frame->uv = cv::Mat(height / 2, width / 2, CV_8UC2, yuv.ptr(height));
+        frame->v = cv::Mat();
+    }
+    else
+    {
+        frame->uv = cv::Mat(height / 2, width / 2, CV_8UC1, yuv.ptr(height));
+        frame->v = cv::Mat(height / 2, width / 2, CV_8UC1, yuv.ptr(height) + width * height / 4);
+    }
+}
+
+static GstPadProbeReturn elementSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    element_stats_t *stats = (element_stats_t *)user_data;
+    stats->entered_us = g_get_monotonic_time();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn elementSrcProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    element_stats_t *stats = (element_stats_t *)user_data;
+    stats->total_us += g_get_monotonic_time() - stats->entered_us;
+    stats->frames++;
+    return GST_PAD_PROBE_OK;
+}
+
+/* Average time in ms that the element named "convert" spends on each frame, or -1 on error.
+ * Conversion runs in the streaming thread, so the time between its sink and src pads is
+ * the conversion itself. */
+static double timeElement(const std::string &in_caps, const std::string &convert, const std::string &out_caps,
+                          int frames)
+{
+    std::string desc = "videotestsrc num-buffers=" + std::to_string(frames) + " pattern=ball ! " + in_caps +
+                       " ! " + convert + " name=convert ! " + out_caps + " ! fakesink sync=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n", error->message);
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        return -1.0;
+    }
+
+    element_stats_t stats = {};
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), "convert");
+    GstPad *sink_pad = gst_element_get_static_pad(element, "sink");
+    GstPad *src_pad = gst_element_get_static_pad(element, "src");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, elementSinkProbe, &stats, NULL);
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, elementSrcProbe, &stats, NULL);
+    gst_object_unref(sink_pad);
+    gst_object_unref(src_pad);
+    gst_object_unref(element);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    bool ok = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (!ok)
+    {
+        gst_message_parse_error(msg, &error, NULL);
+        printf("%s failed: %s\n", convert.c_str(), error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    return (ok && stats.frames > 0) ? stats.total_us / 1000.0 / stats.frames : -1.0;
+}
+
+static std::string rawCaps(const char *format, int width, int height)
+{
+    return std::string("video/x-raw,format=") + format + ",width=" + std::to_string(width) +
+           ",height=" + std::to_string(height) + ",framerate=30/1";
+}
+
+/* Runs fn iterations times and returns the average in ms */
+template <typename F>
+static double timeMs(int iterations, F fn)
+{
+    fn(); // Warm up caches and allocate outputs
+    gint64 start_us = g_get_monotonic_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        fn();
+    }
+    return (g_get_monotonic_time() - start_us) / 1000.0 / iterations;
+}
+
+static void printRow(const char *size, const char *conversion, double fish_ms, double opencv_ms,
+                     double gst_ms, double max_diff)
+{
+    char gst[16] = "-";
+    if (gst_ms >= 0.0)
+    {
+        snprintf(gst, sizeof(gst), "%.3f", gst_ms);
+    }
+    printf("%-6s %-14s %9.3f %9.3f %12s %8.1fx %8.0f\n",
+           size, conversion, fish_ms, opencv_ms, gst, fish_ms > 0.0 ? opencv_ms / fish_ms : 0.0, max_diff);
+}
+
+static void runSize(const bench_size_t *size, int iterations)
+{
+    int width = size->width;
+    int height = size->height;
+
+    // Same random pixels in both layouts, so the outputs can be compared
+    cv::Mat i420(height * 3 / 2, width, CV_8UC1);
+    cv::randu(i420, cv::Scalar(16), cv::Scalar(236));
+    cv::Mat nv12 = i420.clone();
+    fish_frame_t i420_frame;
+    fish_frame_t nv12_frame;
+    wrapFrame(i420, width, height, GST_VIDEO_FORMAT_I420, &i420_frame);
+    wrapFrame(nv12, width, height, GST_VIDEO_FORMAT_NV12, &nv12_frame);
+    cv::Mat planes[2] = {i420_frame.uv, i420_frame.v};
+    cv::merge(planes, 2, nv12_frame.uv);
+
+    cv::Mat fish_bgr;
+    cv::Mat cv_bgr;
+    double fish_ms = timeMs(iterations, [&]() { frameToBgr(&nv12_frame, fish_bgr); });
+    double cv_ms = timeMs(iterations, [&]() { cv::cvtColor(nv12, cv_bgr, cv::COLOR_YUV2BGR_NV12); });
+    double gst_ms = timeElement(rawCaps("NV12", width, height), "videoconvert", "video/x-raw,format=BGR", iterations);
+    printRow(size->name, "NV12 -> BGR", fish_ms, cv_ms, gst_ms, cv::norm(fish_bgr, cv_bgr, cv::NORM_INF));
+
+    fish_ms = timeMs(iterations, [&]() { frameToBgr(&i420_frame, fish_bgr); });
+    cv_ms = timeMs(iterations, [&]() { cv::cvtColor(i420, cv_bgr, cv::COLOR_YUV2BGR_I420); });
+    gst_ms = timeElement(rawCaps("I420", width, height), "videoconvert", "video/x-raw,format=BGR", iterations);
+    printRow(size->name, "I420 -> BGR", fish_ms, cv_ms, gst_ms, cv::norm(fish_bgr, cv_bgr, cv::NORM_INF));
+
+    // Convert OpenCV's BGR back so both sides start from the same image
+    cv::Mat fish_i420(height * 3 / 2, width, CV_8UC1);
+    cv::Mat cv_i420;
+    fish_frame_t out_frame;
+    wrapFrame(fish_i420, width, height, GST_VIDEO_FORMAT_I420, &out_frame);
+    fish_ms = timeMs(iterations, [&]() { bgrToFrame(cv_bgr, &out_frame); });
+    cv_ms = timeMs(iterations, [&]() { cv::cvtColor(cv_bgr, cv_i420, cv::COLOR_BGR2YUV_I420); });
+    gst_ms = timeElement(rawCaps("BGR", width, height), "videoconvert", "video/x-raw,format=I420", iterations);
+    printRow(size->name, "BGR -> I420", fish_ms, cv_ms, gst_ms, cv::norm(fish_i420, cv_i420, cv::NORM_INF));
+
+    fish_frame_t half;
+    cv::Mat cv_y;
+    cv::Mat cv_uv;
+    fish_ms = timeMs(iterations, [&]() { downscaleFrame2x(&nv12_frame, &half); });
+    cv_ms = timeMs(iterations, [&]() {
+        cv::resize(nv12_frame.y, cv_y, cv::Size(width / 2, height / 2), 0, 0, cv::INTER_AREA);
+        cv::resize(nv12_frame.uv, cv_uv, cv::Size(width / 4, height / 4), 0, 0, cv::INTER_AREA);
+    });
+    gst_ms = timeElement(rawCaps("NV12", width, height), "videoscale",
+                         "video/x-raw,width=" + std::to_string(width / 2) + ",height=" + std::to_string(height / 2),
+                         iterations);
+    printRow(size->name, "NV12 / 2", fish_ms, cv_ms, gst_ms,
+             std::max(cv::norm(half.y, cv_y, cv::NORM_INF), cv::norm(half.uv, cv_uv, cv::NORM_INF)));
+
+    // Per-plane tables as used by the underwater correction, against cv::LUT on the same data
+    cv::Mat y_lut(1, 256, CV_8UC1);
+    cv::Mat uv_lut(1, 256, CV_8UC2);
+    cv::randu(y_lut, cv::Scalar(0), cv::Scalar(256));
+    cv::randu(uv_lut, cv::Scalar(0, 0), cv::Scalar(256, 256));
+    fish_plane_luts_t luts;
+    for (int i = 0; i < 256; i++)
+    {
+        luts.y[i] = y_lut.ptr(0)[i];
+        luts.u[i] = uv_lut.ptr(0)[2 * i];
+        luts.v[i] = uv_lut.ptr(0)[2 * i + 1];
+    }
+    cv::Mat fish_nv12(height * 3 / 2, width, CV_8UC1);
+    fish_frame_t lut_frame;
+    wrapFrame(fish_nv12, width, height, GST_VIDEO_FORMAT_NV12, &lut_frame);
+    fish_ms = timeMs(iterations, [&]() { applyFrameLuts(&nv12_frame, &lut_frame, &luts); });
+    cv_ms = timeMs(iterations, [&]() {
+        cv::LUT(nv12_frame.y, y_lut, cv_y);
+        cv::LUT(nv12_frame.uv, uv_lut, cv_uv);
+    });
+    printRow(size->name, "NV12 LUT", fish_ms, cv_ms, -1.0,
+             std::max(cv::norm(lut_frame.y, cv_y, cv::NORM_INF), cv::norm(lut_frame.uv, cv_uv, cv::NORM_INF)));
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    int threads = (argc > 2) ? atoi(argv[2]) : 1;
+    if (iterations <= 0)
+    {
+        printf("Usage: %s [iterations] [opencv threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    cv::setNumThreads(threads);
+
+    printf("Kernels: %s, %d iterations, %d OpenCV threads\n\n", colorKernelIsa(), iterations, threads);
+    printf("%-6s %-14s %9s %9s %12s %9s %8s\n",
+           "size", "conversion", "fish(ms)", "cv(ms)", "gst(ms)", "cv/fish", "maxdiff");
+    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    {
+        runSize(&bench_sizes[i], iterations);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include <gst/gst.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "streaming/encoder-profiles.hpp"
+
+#define BENCH_FPS 30
+
+typedef struct
+{
+    std::mutex mtx;
+    std::map<GstClockTime, gint64> pending; // Input PTS -> time it entered the encoder
+    std::vector<double> latency_ms;
+    std::vector<double> frame_bytes;
+} bench_stats_t;
+
+static GstPadProbeReturn encoderSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    bench_stats_t *stats = (bench_stats_t *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    std::lock_guard<std::mutex> lock(stats->mtx);
+    stats->pending[GST_BUFFER_PTS(buf)] = g_get_monotonic_time();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn encoderSrcProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    bench_stats_t *stats = (bench_stats_t *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now_us = g_get_monotonic_time();
+
+    std::lock_guard<std::mutex> lock(stats->mtx);
+    std::map<GstClockTime, gint64>::iterator it = stats->pending.find(GST_BUFFER_PTS(buf));
+    if (it != stats->pending.end())
+    {
+        stats->latency_ms.push_back((now_us - it->second) / 1000.0);
+        stats->pending.erase(it);
+    }
+    stats->frame_bytes.push_back((double)gst_buffer_get_size(buf));
+    return GST_PAD_PROBE_OK;
+}
+
+static gint64 processCpuUs()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1));
+    return values[index];
+}
+
+static void meanStddev(const std::vector<double> &values, double *mean, double *stddev)
+{
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        sum += values[i];
+        sum_sq += values[i] * values[i];
+    }
+
+    *mean = values.empty() ? 0.0 : sum / values.size();
+    *stddev = values.empty() ? 0.0 : sqrt(std::max(0.0, sum_sq / values.size() - *mean * *mean));
+}
+
+static bool runProfile(const fish_stream_config_t *config, int index, unsigned int seconds)
+{
+    const fish_encoder_profile_t *profile = getEncoderProfile(index);
+    std::string desc = "videotestsrc is-live=true pattern=ball num-buffers=" + std::to_string(seconds * BENCH_FPS) +
+                       " ! video/x-raw,format=I420,width=1280,height=720,framerate=" + std::to_string(BENCH_FPS) + "/1"
+                       " ! " + x264EncoderDesc(config, index, "encoder") +
+                       " ! fakesink sync=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline for %s: %s\n", profile->name, error->message);
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        return false;
+    }
+
+    bench_stats_t stats;
+    GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), "encoder");
+    GstPad *sink_pad = gst_element_get_static_pad(encoder, "sink");
+    GstPad *src_pad = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, encoderSinkProbe, &stats, NULL);
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, encoderSrcProbe, &stats, NULL);
+    gst_object_unref(sink_pad);
+    gst_object_unref(src_pad);
+    gst_object_unref(encoder);
+
+    gint64 start_cpu_us = processCpuUs();
+    gint64 start_wall_us = g_get_monotonic_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, (seconds + 10) * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    bool ok = (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        gst_message_parse_error(msg, &error, NULL);
+        printf("%s failed: %s\n", profile->name, error->message);
+        g_clear_error(&error);
+    }
+    if (msg != NULL)
+    {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    gint64 wall_us = g_get_monotonic_time() - start_wall_us;
+    gint64 cpu_us = processCpuUs() - start_cpu_us;
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    std::lock_guard<std::mutex> lock(stats.mtx);
+    double lat_mean, lat_stddev, size_mean, size_stddev;
+    meanStddev(stats.latency_ms, &lat_mean, &lat_stddev);
+    meanStddev(stats.frame_bytes, &size_mean, &size_stddev);
+    double size_max = stats.frame_bytes.empty() ? 0.0 : *std::max_element(stats.frame_bytes.begin(), stats.frame_bytes.end());
+
+    printf("%-14s %6zu %8.2f %8.2f %8.2f %9.0f %9.0f %7.1fx %6.0f%%\n",
+           profile->name, stats.frame_bytes.size(),
+           lat_mean, percentile(stats.latency_ms, 0.99), percentile(stats.latency_ms, 1.0),
+           size_mean, size_stddev, size_mean > 0.0 ? size_max / size_mean : 0.0,
+           wall_us > 0 ? 100.0 * cpu_us / wall_us : 0.0);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    unsigned int seconds = (argc > 1) ? (unsigned int)atoi(argv[1]) : 10;
+    fish_stream_config_t config = {};
+    config.abr_start_kbps = (argc > 2) ? (uint32_t)atoi(argv[2]) : 1000;
+    config.encoder_threads = (argc > 3) ? (uint32_t)atoi(argv[3]) : 0;
+
+    printf("%u s per profile, %u kbps, %u threads (0 = auto)\n\n", seconds, config.abr_start_kbps, config.encoder_threads);
+    printf("%-14s %6s %8s %8s %8s %9s %9s %8s %7s\n",
+           "profile", "frames", "lat(ms)", "p99(ms)", "max(ms)", "bytes", "stddev", "max/avg", "cpu");
+
+    int failures = 0;
+    for (int i = 0; getEncoderProfile(i) != NULL; i++)
+    {
+        if (!runProfile(&config, i, seconds))
+        {
+            failures++;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+#include <gst/gst.h>
+#include <gst/rtp/rtp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "streaming/encoder-profiles.hpp"
+#include "streaming/fec-control.hpp"
+
+#define MEDIA_PT 100
+
+/* H.264 packets of one frame, keyed by RTP timestamp */
+typedef struct
+{
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t received; // Including packets rebuilt from FEC
+} test_frame_t;
+
+typedef struct
+{
+    std::mutex mtx;
+    std::map<uint32_t, test_frame_t> frames;
+    double loss;          // Probability a burst starts on any packet
+    uint32_t burst;       // Packets lost per burst
+    uint32_t burst_left;  // Packets still to drop in the current burst
+    uint64_t media_sent;
+    uint64_t fec_sent;
+    uint64_t dropped;
+} test_state_t;
+
+static GstPadProbeReturn senderProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    test_state_t *state = (test_state_t *)user_data;
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+    if (!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtp))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    guint8 pt = gst_rtp_buffer_get_payload_type(&rtp);
+    uint32_t timestamp = gst_rtp_buffer_get_timestamp(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+
+    std::lock_guard<std::mutex> lock(state->mtx);
+    bool drop = false;
+    if (state->burst_left > 0)
+    {
+        state->burst_left--;
+        drop = true;
+    }
+    else if (g_random_double() < state->loss)
+    {
+        state->burst_left = state->burst - 1;
+        drop = true;
+    }
+
+    if (pt == MEDIA_PT)
+    {
+        state->media_sent++;
+        state->frames[timestamp].sent++;
+        if (drop)
+        {
+            state->frames[timestamp].dropped++;
+        }
+    }
+    else
+    {
+        state->fec_sent++;
+    }
+
+    if (drop)
+    {
+        state->dropped++;
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn receiverProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    test_state_t *state = (test_state_t *)user_data;
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+    if (!gst_rtp_buffer_map(GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ, &rtp))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    guint8 pt = gst_rtp_buffer_get_payload_type(&rtp);
+    uint32_t timestamp = gst_rtp_buffer_get_timestamp(&rtp);
+    gst_rtp_buffer_unmap(&rtp);
+
+    if (pt == MEDIA_PT)
+    {
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->frames[timestamp].received++;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* The jitterbuffer looks up the clock rate of every payload type it sees */
+static GstCaps *requestPtMap(GstElement *jitterbuffer, guint pt, gpointer user_data)
+{
+    return gst_caps_new_simple("application/x-rtp", "media", G_TYPE_STRING, "video",
+                               "clock-rate", G_TYPE_INT, 90000, "payload", G_TYPE_INT, (gint)pt, NULL);
+}
+
+static GstElement *launch(const std::string &desc)
+{
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n%s\n", error->message, desc.c_str());
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        return NULL;
+    }
+    return pipeline;
+}
+
+static bool checkBus(GstElement *pipeline, const char *name, GstClockTime timeout)
+{
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gst_object_unref(bus);
+    if (msg == NULL)
+    {
+        return true;
+    }
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        printf("%s error: %s\n", name, error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    return false;
+}
+
+static void addProbe(GstElement *pipeline, const char *element_name, const char *pad_name,
+                     GstPadProbeCallback callback, test_state_t *state)
+{
+    GstElement *element = gst_bin_get_by_name(GST_BIN(pipeline), element_name);
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, state, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(element);
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    unsigned int seconds = (argc > 1) ? (unsigned int)atoi(argv[1]) : 20;
+    double loss_pct = (argc > 2) ? atof(argv[2]) : 5.0;
+    uint32_t burst = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+    fish_stream_config_t config = {};
+    config.fec_pct = (argc > 4) ? (uint32_t)atoi(argv[4]) : 20;
+    config.abr_start_kbps = (argc > 5) ? (uint32_t)atoi(argv[5]) : 1000;
+    std::string port = (argc > 6) ? argv[6] : "5006";
+    std::string send_port = (argc > 7) ? argv[7] : port; // Differs when a proxy sits in between
+
+    test_state_t state;
+    state.burst = (burst > 0) ? burst : 1;
+    state.loss = loss_pct / 100.0 / state.burst; // Same average loss whatever the burst length
+    state.burst_left = 0;
+    state.media_sent = 0;
+    state.fec_sent = 0;
+    state.dropped = 0;
+
+    // Same FEC stage as the robot's send path
+    std::string sender_desc = "videotestsrc is-live=true pattern=smpte num-buffers=" + std::to_string(seconds * 30) +
+                              " ! video/x-raw,format=I420,width=1280,height=720,framerate=30/1"
+                              " ! " + x264EncoderDesc(&config, findEncoderProfile("sliced"), "encoder") +
+                              " ! h264parse ! rtph264pay name=pay pt=" + std::to_string(MEDIA_PT) +
+                              " ssrc=" + std::to_string(FISH_VIDEO_SSRC) + " config-interval=-1" +
+                              fecEncoderDesc(&config, 0) +
+                              " ! udpsink name=sink host=127.0.0.1 port=" + send_port + " sync=false async=false";
+
+    // Arranged the way rtpbin arranges them: storage before the jitterbuffer, and the
+    // FEC decoder after it, where it rebuilds the packets the jitterbuffer reports lost
+    std::string receiver_desc = "udpsrc port=" + port + " caps=\"application/x-rtp,media=video,clock-rate=90000\""
+                                " ! rtpstorage name=storage size-time=500000000"
+                                " ! rtpjitterbuffer name=jitterbuffer latency=200 do-lost=true"
+                                " ! rtpulpfecdec name=fec_dec pt=" + std::to_string(FISH_ULPFEC_PT) +
+                                " ! fakesink name=check sync=false";
+
+    GstElement *receiver = launch(receiver_desc);
+    GstElement *sender = launch(sender_desc);
+    if (receiver == NULL || sender == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    GstElement *storage = gst_bin_get_by_name(GST_BIN(receiver), "storage");
+    GstElement *fec_dec = gst_bin_get_by_name(GST_BIN(receiver), "fec_dec");
+    GstElement *jitterbuffer = gst_bin_get_by_name(GST_BIN(receiver), "jitterbuffer");
+    GObject *internal_storage = NULL;
+    g_object_get(storage, "internal-storage", &internal_storage, NULL);
+    g_object_set(fec_dec, "storage", internal_storage, NULL);
+    g_object_unref(internal_storage);
+    g_signal_connect(jitterbuffer, "request-pt-map", G_CALLBACK(requestPtMap), NULL);
+    gst_object_unref(jitterbuffer);
+    gst_object_unref(storage);
+
+    // Loss is injected on the wire side, after FEC
+    addProbe(sender, "sink", "sink", senderProbe, &state);
+    addProbe(receiver, "check", "sink", receiverProbe, &state);
+
+    printf(">> %.1f%% loss in bursts of %u, %u%% FEC\n", loss_pct, state.burst, config.fec_pct);
+    gst_element_set_state(receiver, GST_STATE_PLAYING);
+    gst_element_set_state(sender, GST_STATE_PLAYING);
+
+    while (checkBus(sender, "Sender", GST_SECOND) && checkBus(receiver, "Receiver", 0))
+    {
+    }
+
+    // Let the jitterbuffer give up on the last packets
+    checkBus(receiver, "Receiver", GST_SECOND);
+    guint recovered = 0;
+    guint unrecovered = 0;
+    g_object_get(fec_dec, "recovered", &recovered, "unrecovered", &unrecovered, NULL);
+    gst_object_unref(fec_dec);
+
+    gst_element_set_state(sender, GST_STATE_NULL);
+    gst_element_set_state(receiver, GST_STATE_NULL);
+    gst_object_unref(sender);
+    gst_object_unref(receiver);
+
+    std::lock_guard<std::mutex> lock(state.mtx);
+    uint64_t hit = 0;
+    uint64_t repaired = 0;
+    uint64_t intact = 0;
+    for (std::map<uint32_t, test_frame_t>::iterator it = state.frames.begin(); it != state.frames.end(); ++it)
+    {
+        bool complete = (it->second.received >= it->second.sent);
+        intact += complete ? 1 : 0;
+        if (it->second.dropped > 0)
+        {
+            hit++;
+            repaired += complete ? 1 : 0;
+        }
+    }
+
+    uint64_t total = state.frames.size();
+    uint64_t wire = state.media_sent + state.fec_sent;
+    printf(">> Packets: %llu media, %llu FEC (%.1f%% overhead), %llu dropped (%.2f%%)\n",
+           (unsigned long long)state.media_sent, (unsigned long long)state.fec_sent,
+           state.media_sent ? 100.0 * state.fec_sent / state.media_sent : 0.0,
+           (unsigned long long)state.dropped, wire ? 100.0 * state.dropped / wire : 0.0);
+    printf(">> FEC decoder: %u packets recovered, %u unrecovered\n", recovered, unrecovered);
+    printf(">> Frames: %llu sent, %llu hit by loss, %llu of those repaired (%.1f%%), %.2f%% intact overall\n",
+           (unsigned long long)total, (unsigned long long)hit, (unsigned long long)repaired,
+           hit ? 100.0 * repaired / hit : 100.0, total ? 100.0 * intact / total : 0.0);
+
+    return total ? EXIT_SUCCESS : EXIT_FAILURE;
+}
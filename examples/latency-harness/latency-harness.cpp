@@ -0,0 +1,226 @@
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mutex>
+#include <string>
+
+#include "streaming/encoder-profiles.hpp"
+#include "processing/latency-stamp.hpp"
+
+typedef struct
+{
+    std::mutex mtx;
+    fish_latency_stats_t interval; // Reset after every report
+    fish_latency_stats_t total;
+    gint64 join_us;        // When the receiver started, 0 until it has
+    gint64 first_frame_us; // First decoded frame after joining, 0 until it arrives
+} harness_stats_t;
+
+static GstPadProbeReturn receiverProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    harness_stats_t *stats = (harness_stats_t *)user_data;
+    uint64_t now_us = (uint64_t)g_get_real_time();
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (caps == NULL)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstVideoInfo video_info;
+    gboolean have_info = gst_video_info_from_caps(&video_info, caps);
+    gst_caps_unref(caps);
+
+    GstVideoFrame frame;
+    if (!have_info || !gst_video_frame_map(&frame, &video_info, GST_PAD_PROBE_INFO_BUFFER(info), GST_MAP_READ))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    uint32_t frame_no;
+    uint64_t stamp_us;
+    fish_error_t err = readLatencyStamp(&frame, &frame_no, &stamp_us);
+    gst_video_frame_unmap(&frame);
+
+    std::lock_guard<std::mutex> lock(stats->mtx);
+    if (stats->first_frame_us == 0)
+    {
+        stats->first_frame_us = g_get_monotonic_time();
+    }
+    if (err != FISH_EOK)
+    {
+        stats->interval.invalid++;
+        stats->total.invalid++;
+        return GST_PAD_PROBE_OK;
+    }
+
+    updateLatencyStats(&stats->interval, frame_no, stamp_us, now_us);
+    updateLatencyStats(&stats->total, frame_no, stamp_us, now_us);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstElement *launch(const std::string &desc)
+{
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n%s\n", error->message, desc.c_str());
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        return NULL;
+    }
+    return pipeline;
+}
+
+static bool checkBus(GstElement *pipeline, const char *name, GstClockTime timeout)
+{
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gst_object_unref(bus);
+    if (msg == NULL)
+    {
+        return true;
+    }
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        printf("%s error: %s\n", name, error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    unsigned int seconds = (argc > 1) ? (unsigned int)atoi(argv[1]) : 30;
+    const char *profile = (argc > 2) ? argv[2] : "sliced";
+    fish_stream_config_t config = {};
+    config.abr_start_kbps = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1000;
+    std::string port = (argc > 4) ? argv[4] : "5004";
+    unsigned int join_ms = (argc > 5) ? (unsigned int)atoi(argv[5]) : 0;
+    bool request_keyframe = (argc > 6) ? (atoi(argv[6]) != 0) : true;
+    std::string send_port = (argc > 7) ? argv[7] : port; // Differs when a proxy sits in between
+
+    std::string encoder;
+    int profile_index = findEncoderProfile(profile);
+    if (profile_index >= 0)
+    {
+        encoder = x264EncoderDesc(&config, profile_index, "encoder");
+    }
+    else
+    {
+        encoder = profile;
+    }
+
+    std::string sender_desc = "videotestsrc name=source is-live=true pattern=smpte num-buffers=" + std::to_string(seconds * 30) +
+                              " ! video/x-raw,format=I420,width=1280,height=720,framerate=30/1"
+                              " ! " + encoder +
+                              " ! h264parse ! rtph264pay pt=100 ssrc=2222 config-interval=-1"
+                              " ! udpsink host=127.0.0.1 port=" + send_port + " sync=false async=false";
+    std::string receiver_desc = "udpsrc port=" + port +
+                                " caps=\"application/x-rtp,media=video,clock-rate=90000,encoding-name=H264,payload=100\""
+                                " ! rtpjitterbuffer latency=0"
+                                " ! rtph264depay wait-for-keyframe=true ! h264parse ! avdec_h264 max-threads=1"
+                                " ! videoconvert ! video/x-raw,format=I420"
+                                " ! fakesink name=sink sync=false";
+
+    printf(">> Encoder: %s\n", encoder.c_str());
+
+    GstElement *receiver = launch(receiver_desc);
+    GstElement *sender = launch(sender_desc);
+    if (receiver == NULL || sender == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    harness_stats_t stats;
+    initLatencyStats(&stats.interval);
+    initLatencyStats(&stats.total);
+    stats.join_us = 0;
+    stats.first_frame_us = 0;
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(receiver), "sink");
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, receiverProbe, &stats, NULL);
+    gst_object_unref(sink_pad);
+    gst_object_unref(sink);
+
+    GstElement *source = gst_bin_get_by_name(GST_BIN(sender), "source");
+    addLatencyStampProbe(source, "src");
+    gst_object_unref(source);
+
+    if (join_ms == 0)
+    {
+        // Receiver first so the first keyframe is not lost
+        gst_element_set_state(receiver, GST_STATE_PLAYING);
+        gst_element_set_state(sender, GST_STATE_PLAYING);
+    }
+    else
+    {
+        // Join mid-GOP like a viewer arriving late, then ask for a keyframe the way
+        // rtpbin does when the SFU relays the new consumer's PLI
+        gst_element_set_state(sender, GST_STATE_PLAYING);
+        g_usleep((gulong)join_ms * 1000);
+        gst_element_set_state(receiver, GST_STATE_PLAYING);
+        {
+            std::lock_guard<std::mutex> lock(stats.mtx);
+            stats.join_us = g_get_monotonic_time();
+        }
+        if (request_keyframe)
+        {
+            GstElement *encoder_element = gst_bin_get_by_name(GST_BIN(sender), "encoder");
+            if (encoder_element != NULL)
+            {
+                GstPad *encoder_src = gst_element_get_static_pad(encoder_element, "src");
+                gst_pad_send_event(encoder_src, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+                gst_object_unref(encoder_src);
+                gst_object_unref(encoder_element);
+            }
+        }
+    }
+
+    bool running = true;
+    while (running)
+    {
+        running = checkBus(sender, "Sender", GST_SECOND) && checkBus(receiver, "Receiver", 0);
+
+        std::lock_guard<std::mutex> lock(stats.mtx);
+        printLatencyStats("Last second", &stats.interval);
+        initLatencyStats(&stats.interval);
+    }
+
+    // Let the last frames drain through the decoder
+    checkBus(receiver, "Receiver", GST_SECOND / 2);
+    gst_element_set_state(sender, GST_STATE_NULL);
+    gst_element_set_state(receiver, GST_STATE_NULL);
+    gst_object_unref(sender);
+    gst_object_unref(receiver);
+
+    std::lock_guard<std::mutex> lock(stats.mtx);
+    printLatencyStats("Total", &stats.total);
+    if (stats.join_us != 0)
+    {
+        if (stats.first_frame_us != 0)
+        {
+            printf(">> Time to first frame after joining: %.1fms (keyframe %s)\n",
+                   (stats.first_frame_us - stats.join_us) / 1000.0, request_keyframe ? "requested" : "not requested");
+        }
+        else
+        {
+            printf(">> No frame decoded after joining\n");
+        }
+    }
+
+    return stats.total.frames ? EXIT_SUCCESS : EXIT_FAILURE;
+}
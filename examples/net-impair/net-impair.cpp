@@ -0,0 +1,772 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STATS_PERIOD_MS 1000
+#define MAX_DATAGRAM 65536
+#define TCP_CHUNK 16384
+
+/* What the network does to one direction of traffic */
+typedef struct
+{
+    double delay_ms;
+    double jitter_ms;   // Uniform +/- around delay_ms
+    double loss_pct;
+    double burst;       // Mean number of packets lost in a row, 1 for independent loss
+    double reorder_pct; // Packets sent without the delay, so they overtake the ones before
+    double rate_kbps;   // Bandwidth cap, 0 for none
+    double queue_ms;    // Bottleneck buffer in front of the cap, packets beyond it are dropped
+} impair_params_t;
+
+typedef enum
+{
+    DIR_UP,  // Client to target
+    DIR_DOWN // Target back to client
+} direction_t;
+
+typedef struct
+{
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> lost;
+    std::atomic<uint64_t> queue_drops;
+    std::atomic<uint64_t> reordered;
+    std::atomic<uint64_t> total_delay_us;
+} link_stats_t;
+
+/* One direction of one mapping */
+typedef struct
+{
+    std::string label;
+    direction_t dir;
+    bool stream; // TCP: never drop or reorder, only delay and cap
+
+    std::mutex mtx;
+    int64_t busy_until_us;   // When the emulated link finishes sending what is queued
+    int64_t last_release_us; // Keeps a byte stream in order
+    bool in_burst;
+    link_stats_t stats;
+} link_t;
+
+typedef struct tcp_conn tcp_conn_t;
+
+typedef struct
+{
+    int64_t release_us;
+    uint64_t seq;
+    int fd;
+    struct sockaddr_storage to;
+    socklen_t to_len; // 0 to use send() on a connected socket
+    std::vector<char> data;
+    bool close_after;               // TCP end of stream, shut the write side down on release
+    std::shared_ptr<tcp_conn_t> conn; // Keeps TCP sockets open while their data is in flight
+} scheduled_packet_t;
+
+struct packet_order
+{
+    bool operator()(const scheduled_packet_t *a, const scheduled_packet_t *b) const
+    {
+        return (a->release_us != b->release_us) ? a->release_us > b->release_us : a->seq > b->seq;
+    }
+};
+
+struct tcp_conn
+{
+    int client_fd;
+    int target_fd;
+    ~tcp_conn()
+    {
+        close(client_fd);
+        close(target_fd);
+    }
+};
+
+typedef struct
+{
+    bool tcp;
+    int local_port;
+    std::string host;
+    std::string port;
+    int listen_fd;
+    int upstream_fd; // UDP only: connected to the target, so replies come back on it
+    std::mutex client_mtx;
+    struct sockaddr_storage client;
+    socklen_t client_len;
+    link_t up;
+    link_t down;
+} mapping_t;
+
+static std::mutex params_mtx;
+static impair_params_t params[2];
+
+static std::mutex sched_mtx;
+static std::condition_variable sched_cv;
+static std::priority_queue<scheduled_packet_t *, std::vector<scheduled_packet_t *>, packet_order> sched_queue;
+static uint64_t sched_seq = 0;
+
+static std::mutex rng_mtx;
+static std::mt19937 rng(12345); // Fixed seed so a run can be repeated exactly
+
+static int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static double uniform()
+{
+    std::lock_guard<std::mutex> lock(rng_mtx);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+/* Applies "key=value" to the up, down or both parameter sets, e.g. "delay=40" or "up.loss=5" */
+static bool applySetting(const std::string &setting)
+{
+    size_t eq = setting.find('=');
+    if (eq == std::string::npos)
+    {
+        return false;
+    }
+    std::string key = setting.substr(0, eq);
+    double value = atof(setting.c_str() + eq + 1);
+
+    bool up = true;
+    bool down = true;
+    if (key.compare(0, 3, "up.") == 0)
+    {
+        down = false;
+        key = key.substr(3);
+    }
+    else if (key.compare(0, 5, "down.") == 0)
+    {
+        up = false;
+        key = key.substr(5);
+    }
+
+    std::lock_guard<std::mutex> lock(params_mtx);
+    for (int i = 0; i < 2; i++)
+    {
+        if ((i == DIR_UP && !up) || (i == DIR_DOWN && !down))
+        {
+            continue;
+        }
+        impair_params_t *p = &params[i];
+        if (key == "delay")
+        {
+            p->delay_ms = value;
+        }
+        else if (key == "jitter")
+        {
+            p->jitter_ms = value;
+        }
+        else if (key == "loss")
+        {
+            p->loss_pct = value;
+        }
+        else if (key == "burst")
+        {
+            p->burst = std::max(value, 1.0);
+        }
+        else if (key == "reorder")
+        {
+            p->reorder_pct = value;
+        }
+        else if (key == "rate")
+        {
+            p->rate_kbps = value;
+        }
+        else if (key == "queue")
+        {
+            p->queue_ms = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printParams()
+{
+    std::lock_guard<std::mutex> lock(params_mtx);
+    const char *names[2] = {"up", "down"};
+    for (int i = 0; i < 2; i++)
+    {
+        printf(">> %-4s delay %.0fms jitter %.0fms loss %.1f%% burst %.1f reorder %.1f%% rate %.0fkbps queue %.0fms\n",
+               names[i], params[i].delay_ms, params[i].jitter_ms, params[i].loss_pct, params[i].burst,
+               params[i].reorder_pct, params[i].rate_kbps, params[i].queue_ms);
+    }
+}
+
+/* Gilbert model: bursts start at a rate that keeps the mean loss at loss_pct */
+static bool losePacket(link_t *link, const impair_params_t *p)
+{
+    double loss = p->loss_pct / 100.0;
+    if (loss <= 0.0)
+    {
+        link->in_burst = false;
+        return false;
+    }
+    if (p->burst <= 1.0 || loss >= 1.0)
+    {
+        return uniform() < loss;
+    }
+
+    if (link->in_burst)
+    {
+        link->in_burst = uniform() >= 1.0 / p->burst;
+    }
+    else
+    {
+        link->in_burst = uniform() < loss / (p->burst * (1.0 - loss));
+    }
+    return link->in_burst;
+}
+
+/* Decides the packet's fate and queues it for release, or frees it if it is lost */
+static void schedulePacket(link_t *link, scheduled_packet_t *pkt)
+{
+    impair_params_t p;
+    {
+        std::lock_guard<std::mutex> lock(params_mtx);
+        p = params[link->dir];
+    }
+
+    int64_t now_us = nowUs();
+    size_t size = pkt->data.size();
+    link->stats.packets++;
+    link->stats.bytes += size;
+
+    {
+        std::lock_guard<std::mutex> lock(link->mtx);
+        if (!link->stream && losePacket(link, &p))
+        {
+            link->stats.lost++;
+            delete pkt;
+            return;
+        }
+
+        int64_t sent_us = now_us;
+        if (p.rate_kbps > 0)
+        {
+            int64_t start_us = std::max(now_us, link->busy_until_us);
+            if (!link->stream && start_us - now_us > p.queue_ms * 1000)
+            {
+                link->stats.queue_drops++;
+                delete pkt;
+                return;
+            }
+            link->busy_until_us = start_us + (int64_t)(size * 8 * 1000.0 / p.rate_kbps);
+            sent_us = link->busy_until_us;
+        }
+
+        double delay_ms = p.delay_ms + (uniform() * 2.0 - 1.0) * p.jitter_ms;
+        if (!link->stream && p.reorder_pct > 0 && uniform() * 100.0 < p.reorder_pct)
+        {
+            delay_ms = 0;
+            link->stats.reordered++;
+        }
+        pkt->release_us = sent_us + (int64_t)(std::max(delay_ms, 0.0) * 1000);
+        if (link->stream)
+        {
+            pkt->release_us = std::max(pkt->release_us, link->last_release_us);
+            link->last_release_us = pkt->release_us;
+        }
+    }
+    link->stats.total_delay_us += pkt->release_us - now_us;
+
+    std::lock_guard<std::mutex> lock(sched_mtx);
+    pkt->seq = sched_seq++;
+    sched_queue.push(pkt);
+    sched_cv.notify_one();
+}
+
+static void runScheduler()
+{
+    std::unique_lock<std::mutex> lock(sched_mtx);
+    while (true)
+    {
+        if (sched_queue.empty())
+        {
+            sched_cv.wait(lock);
+            continue;
+        }
+
+        int64_t wait_us = sched_queue.top()->release_us - nowUs();
+        if (wait_us > 0)
+        {
+            sched_cv.wait_for(lock, std::chrono::microseconds(wait_us));
+            continue;
+        }
+
+        scheduled_packet_t *pkt = sched_queue.top();
+        sched_queue.pop();
+        lock.unlock();
+
+        if (!pkt->data.empty())
+        {
+            ssize_t ret;
+            if (pkt->to_len > 0)
+            {
+                ret = sendto(pkt->fd, pkt->data.data(), pkt->data.size(), 0, (struct sockaddr *)&pkt->to, pkt->to_len);
+            }
+            else
+            {
+                ret = send(pkt->fd, pkt->data.data(), pkt->data.size(), MSG_NOSIGNAL);
+            }
+            (void)ret; // Like a real network, failures just lose the data
+        }
+        if (pkt->close_after)
+        {
+            shutdown(pkt->fd, SHUT_WR);
+        }
+        delete pkt;
+
+        lock.lock();
+    }
+}
+
+static bool resolve(const std::string &host, const std::string &port, int socktype,
+                    struct sockaddr_storage *addr, socklen_t *len)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = socktype;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || res == NULL)
+    {
+        printf("Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return false;
+    }
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+static int bindLocal(int socktype, int port)
+{
+    int fd = socket(AF_INET, socktype, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        printf("Cannot bind port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool setupUdpMapping(mapping_t *map)
+{
+    struct sockaddr_storage target;
+    socklen_t target_len;
+    if (!resolve(map->host, map->port, SOCK_DGRAM, &target, &target_len))
+    {
+        return false;
+    }
+
+    map->listen_fd = bindLocal(SOCK_DGRAM, map->local_port);
+    map->upstream_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (map->listen_fd < 0 || connect(map->upstream_fd, (struct sockaddr *)&target, target_len) != 0)
+    {
+        return false;
+    }
+
+    // Media bursts must only be lost where the emulated link says so
+    int buf = 4 * 1024 * 1024;
+    setsockopt(map->listen_fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    setsockopt(map->upstream_fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    map->client_len = 0;
+    return true;
+}
+
+/* Receives on every UDP socket; a mapping forwards to its target and back to whoever
+ * last sent to its local port */
+static void runUdpForwarder(std::vector<mapping_t *> maps)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<mapping_t *> owners;
+    for (size_t i = 0; i < maps.size(); i++)
+    {
+        struct pollfd listen_poll = {maps[i]->listen_fd, POLLIN, 0};
+        struct pollfd upstream_poll = {maps[i]->upstream_fd, POLLIN, 0};
+        fds.push_back(listen_poll);
+        owners.push_back(maps[i]);
+        fds.push_back(upstream_poll);
+        owners.push_back(maps[i]);
+    }
+
+    char buf[MAX_DATAGRAM];
+    while (!fds.empty())
+    {
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (!(fds[i].revents & POLLIN))
+            {
+                continue;
+            }
+            mapping_t *map = owners[i];
+            scheduled_packet_t *pkt = new scheduled_packet_t();
+            pkt->close_after = false;
+
+            if (fds[i].fd == map->listen_fd)
+            {
+                struct sockaddr_storage from;
+                socklen_t from_len = sizeof(from);
+                ssize_t len = recvfrom(map->listen_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+                if (len < 0)
+                {
+                    delete pkt;
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(map->client_mtx);
+                    memcpy(&map->client, &from, from_len);
+                    map->client_len = from_len;
+                }
+                pkt->fd = map->upstream_fd;
+                pkt->to_len = 0;
+                pkt->data.assign(buf, buf + len);
+                schedulePacket(&map->up, pkt);
+            }
+            else
+            {
+                ssize_t len = recv(map->upstream_fd, buf, sizeof(buf), 0);
+                std::lock_guard<std::mutex> lock(map->client_mtx);
+                if (len < 0 || map->client_len == 0)
+                {
+                    delete pkt; // Nobody to send it back to yet
+                    continue;
+                }
+                pkt->fd = map->listen_fd;
+                memcpy(&pkt->to, &map->client, map->client_len);
+                pkt->to_len = map->client_len;
+                pkt->data.assign(buf, buf + len);
+                schedulePacket(&map->down, pkt);
+            }
+        }
+    }
+}
+
+static void pumpTcp(std::shared_ptr<tcp_conn_t> conn, int from_fd, int to_fd, link_t *link)
+{
+    char buf[TCP_CHUNK];
+    while (true)
+    {
+        ssize_t len = recv(from_fd, buf, sizeof(buf), 0);
+        scheduled_packet_t *pkt = new scheduled_packet_t();
+        pkt->fd = to_fd;
+        pkt->to_len = 0;
+        pkt->conn = conn;
+        pkt->close_after = (len <= 0);
+        if (len > 0)
+        {
+            pkt->data.assign(buf, buf + len);
+        }
+        schedulePacket(link, pkt);
+        if (len <= 0)
+        {
+            return;
+        }
+    }
+}
+
+static void runTcpListener(mapping_t *map)
+{
+    struct sockaddr_storage target;
+    socklen_t target_len;
+    if (!resolve(map->host, map->port, SOCK_STREAM, &target, &target_len))
+    {
+        return;
+    }
+
+    while (true)
+    {
+        int client_fd = accept(map->listen_fd, NULL, NULL);
+        if (client_fd < 0)
+        {
+            continue;
+        }
+        int target_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(target_fd, (struct sockaddr *)&target, target_len) != 0)
+        {
+            printf("Cannot connect to %s:%s: %s\n", map->host.c_str(), map->port.c_str(), strerror(errno));
+            close(client_fd);
+            close(target_fd);
+            continue;
+        }
+
+        // The emulated delay is the only one wanted, so do not let Nagle add more
+        int on = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(target_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        std::shared_ptr<tcp_conn_t> conn(new tcp_conn_t());
+        conn->client_fd = client_fd;
+        conn->target_fd = target_fd;
+        std::thread(pumpTcp, conn, client_fd, target_fd, &map->up).detach();
+        std::thread(pumpTcp, conn, target_fd, client_fd, &map->down).detach();
+    }
+}
+
+/* Profile lines are "<seconds> key=value ...", applied when that many seconds have
+ * passed since the start. A line "<seconds> loop" starts the script over. */
+static void runProfile(std::string path)
+{
+    std::ifstream file(path.c_str());
+    std::vector<std::pair<double, std::string> > steps;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+        {
+            line = line.substr(0, hash);
+        }
+        std::istringstream in(line);
+        double t;
+        if (in >> t)
+        {
+            std::string rest;
+            std::getline(in >> std::ws, rest);
+            steps.push_back(std::make_pair(t, rest));
+        }
+    }
+    if (steps.empty())
+    {
+        printf("Profile %s has no steps\n", path.c_str());
+        return;
+    }
+
+    while (true)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool loop = false;
+        for (size_t i = 0; i < steps.size() && !loop; i++)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)(steps[i].first * 1e6)));
+
+            std::istringstream in(steps[i].second);
+            std::string setting;
+            while (in >> setting)
+            {
+                if (setting == "loop")
+                {
+                    loop = true;
+                }
+                else if (!applySetting(setting))
+                {
+                    printf("Ignoring profile setting %s\n", setting.c_str());
+                }
+            }
+            printf(">> Profile step at %.1fs: %s\n", steps[i].first, steps[i].second.c_str());
+            printParams();
+        }
+        if (!loop)
+        {
+            return;
+        }
+    }
+}
+
+static void printLinkStats(link_t *link, double seconds)
+{
+    uint64_t packets = link->stats.packets.exchange(0);
+    uint64_t bytes = link->stats.bytes.exchange(0);
+    uint64_t lost = link->stats.lost.exchange(0);
+    uint64_t queue_drops = link->stats.queue_drops.exchange(0);
+    uint64_t reordered = link->stats.reordered.exchange(0);
+    uint64_t delay_us = link->stats.total_delay_us.exchange(0);
+    if (packets == 0)
+    {
+        return;
+    }
+
+    uint64_t passed = packets - lost - queue_drops;
+    printf("%-24s %6llu pkts %8.0f kbps  lost %llu (%.1f%%)  queue drops %llu  reordered %llu  delay %.1fms\n",
+           link->label.c_str(), (unsigned long long)packets, bytes * 8 / seconds / 1000, (unsigned long long)lost,
+           100.0 * lost / packets, (unsigned long long)queue_drops, (unsigned long long)reordered,
+           passed ? delay_us / 1000.0 / passed : 0.0);
+}
+
+static bool parseMapping(const std::string &arg, mapping_t *map)
+{
+    // proto:local_port:host:port
+    std::vector<std::string> parts;
+    std::istringstream in(arg);
+    std::string part;
+    while (std::getline(in, part, ':'))
+    {
+        parts.push_back(part);
+    }
+    if (parts.size() != 4 || (parts[0] != "udp" && parts[0] != "tcp"))
+    {
+        return false;
+    }
+
+    map->tcp = (parts[0] == "tcp");
+    map->local_port = atoi(parts[1].c_str());
+    map->host = parts[2];
+    map->port = parts[3];
+
+    const char *proto = map->tcp ? "tcp" : "udp";
+    map->up.label = std::string(proto) + " " + parts[1] + " up";
+    map->up.dir = DIR_UP;
+    map->down.label = std::string(proto) + " " + parts[1] + " down";
+    map->down.dir = DIR_DOWN;
+    for (link_t *link : {&map->up, &map->down})
+    {
+        link->stream = map->tcp;
+        link->busy_until_us = 0;
+        link->last_release_us = 0;
+        link->in_burst = false;
+        link->stats.packets = 0;
+        link->stats.bytes = 0;
+        link->stats.lost = 0;
+        link->stats.queue_drops = 0;
+        link->stats.reordered = 0;
+        link->stats.total_delay_us = 0;
+    }
+    return true;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [--key=value ...] [--profile=file] [--seed=N] proto:local_port:host:port ...\n", name);
+    printf("  proto is udp or tcp. Keys: delay, jitter (ms), loss, reorder (%%), burst (packets),\n");
+    printf("  rate (kbps), queue (ms). Prefix a key with up. or down. for one direction only.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0); // Stats stay readable when piped to a log
+    for (int i = 0; i < 2; i++)
+    {
+        params[i] = {0, 0, 0, 1, 0, 0, 100};
+    }
+
+    std::string profile;
+    std::vector<mapping_t *> maps;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 10, "--profile=") == 0)
+        {
+            profile = arg.substr(10);
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            rng.seed((unsigned int)atoi(arg.c_str() + 7));
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            if (!applySetting(arg.substr(2)))
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            mapping_t *map = new mapping_t();
+            if (!parseMapping(arg, map))
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            maps.push_back(map);
+        }
+    }
+    if (maps.empty())
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<mapping_t *> udp_maps;
+    for (size_t i = 0; i < maps.size(); i++)
+    {
+        mapping_t *map = maps[i];
+        if (map->tcp)
+        {
+            map->listen_fd = bindLocal(SOCK_STREAM, map->local_port);
+            if (map->listen_fd < 0 || listen(map->listen_fd, 16) != 0)
+            {
+                return EXIT_FAILURE;
+            }
+            std::thread(runTcpListener, map).detach();
+        }
+        else
+        {
+            if (!setupUdpMapping(map))
+            {
+                return EXIT_FAILURE;
+            }
+            udp_maps.push_back(map);
+        }
+        printf(">> %s :%d -> %s:%s\n", map->tcp ? "tcp" : "udp", map->local_port, map->host.c_str(), map->port.c_str());
+    }
+
+    std::thread(runScheduler).detach();
+    if (!udp_maps.empty())
+    {
+        std::thread(runUdpForwarder, udp_maps).detach();
+    }
+    printParams();
+    if (!profile.empty())
+    {
+        std::thread(runProfile, profile).detach();
+    }
+
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(STATS_PERIOD_MS));
+        for (size_t i = 0; i < maps.size(); i++)
+        {
+            printLinkStats(&maps[i]->up, STATS_PERIOD_MS / 1000.0);
+            printLinkStats(&maps[i]->down, STATS_PERIOD_MS / 1000.0);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+#include <gst/gst.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "streaming/encoder-profiles.hpp"
+#include "streaming/latency-guard.hpp"
+#include "streaming/rtp-pacer.hpp"
+
+#define BURST_GAP_US 500 // Same threshold the pacer reports with
+
+/* A bottleneck with a drop-tail buffer, like a Wi-Fi hop: the buffer drains at the
+ * link rate, and packets arriving to a full buffer are lost */
+typedef struct
+{
+    int sock;
+    double link_rate;     // Bytes/s
+    double buffer_bytes;
+    std::atomic<bool> running;
+
+    double backlog;       // Bytes queued in the emulated buffer
+    gint64 last_arrival_us;
+    uint64_t packets;
+    uint64_t lost;
+    uint64_t bursts;
+    uint32_t burst_len;
+    uint32_t max_burst;
+    double max_backlog;
+} shaped_link_t;
+
+static void runShapedLink(shaped_link_t *link)
+{
+    char packet[2048];
+
+    while (link->running)
+    {
+        ssize_t size = recv(link->sock, packet, sizeof(packet), 0);
+        if (size <= 0)
+        {
+            continue; // Receive timeout, check running again
+        }
+        gint64 now_us = g_get_monotonic_time();
+
+        if (link->last_arrival_us != 0)
+        {
+            gint64 gap_us = now_us - link->last_arrival_us;
+            link->backlog = std::max(link->backlog - link->link_rate * gap_us / 1e6, 0.0);
+            if (gap_us < BURST_GAP_US)
+            {
+                link->burst_len++;
+            }
+            else
+            {
+                link->bursts++;
+                link->burst_len = 1;
+            }
+        }
+        else
+        {
+            link->bursts++;
+            link->burst_len = 1;
+        }
+        link->max_burst = std::max(link->max_burst, link->burst_len);
+        link->last_arrival_us = now_us;
+        link->packets++;
+
+        if (link->backlog + size > link->buffer_bytes)
+        {
+            link->lost++;
+        }
+        else
+        {
+            link->backlog += size;
+            link->max_backlog = std::max(link->max_backlog, link->backlog);
+        }
+    }
+}
+
+static bool checkBus(GstElement *pipeline, GstClockTime timeout)
+{
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gst_object_unref(bus);
+    if (msg == NULL)
+    {
+        return true;
+    }
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        printf("Sender error: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    unsigned int seconds = (argc > 1) ? (unsigned int)atoi(argv[1]) : 20;
+    fish_stream_config_t config = {};
+    config.pace_pct = (argc > 2) ? (uint32_t)atoi(argv[2]) : 250;
+    config.pace_max_ms = 40;
+    config.queue_max_ms = 100;
+    uint32_t link_kbps = (argc > 3) ? (uint32_t)atoi(argv[3]) : 4000;
+    uint32_t buffer_kb = (argc > 4) ? (uint32_t)atoi(argv[4]) : 16;
+    config.abr_start_kbps = (argc > 5) ? (uint32_t)atoi(argv[5]) : 1500;
+    int port = (argc > 6) ? atoi(argv[6]) : 5008;
+
+    shaped_link_t link = {};
+    link.link_rate = link_kbps * 1000.0 / 8;
+    link.buffer_bytes = buffer_kb * 1024.0;
+    link.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval timeout = {0, 100000};
+    setsockopt(link.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int rcvbuf = 4 * 1024 * 1024; // The emulated buffer should be the only place packets are lost
+    setsockopt(link.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(link.sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("bind");
+        return EXIT_FAILURE;
+    }
+
+    // The same send tail as videoSendDesc(), minus rtpbin
+    std::string desc = "videotestsrc is-live=true pattern=smpte num-buffers=" + std::to_string(seconds * 30) +
+                       " ! video/x-raw,format=I420,width=1280,height=720,framerate=30/1"
+                       " ! " + x264EncoderDesc(&config, findEncoderProfile("sliced"), "encoder") +
+                       " ! h264parse ! rtph264pay pt=100 ssrc=2222 config-interval=-1"
+                       " ! " + leakyQueueDesc("send_queue", config.queue_max_ms) +
+                       " ! udpsink host=127.0.0.1 port=" + std::to_string(port) + " sync=false async=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n", error->message);
+        g_clear_error(&error);
+        return EXIT_FAILURE;
+    }
+
+    fish_pacer_t pacer;
+    bool pacing = (setupPacer(&pacer, pipeline, "send_queue", &config) == FISH_EOK);
+    printf(">> %ukbps stream into a %ukbps link with a %uKB buffer, %s\n", config.abr_start_kbps, link_kbps,
+           buffer_kb, pacing ? "paced" : "unpaced");
+
+    link.running = true;
+    std::thread link_thread(runShapedLink, &link);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    while (checkBus(pipeline, GST_SECOND))
+    {
+        if (pacing)
+        {
+            updatePacer(&pacer);
+        }
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (pacing)
+    {
+        teardownPacer(&pacer);
+    }
+    gst_object_unref(pipeline);
+    link.running = false;
+    link_thread.join();
+    close(link.sock);
+
+    printf(">> Arrivals: %llu packets in %llu bursts, avg %.1f max %u packets per burst\n",
+           (unsigned long long)link.packets, (unsigned long long)link.bursts,
+           link.bursts ? (double)link.packets / link.bursts : 0.0, link.max_burst);
+    printf(">> Link: %llu lost (%.2f%%), deepest buffer %.1fKB\n", (unsigned long long)link.lost,
+           link.packets ? 100.0 * link.lost / link.packets : 0.0, link.max_backlog / 1024);
+
+    return link.packets ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,308 @@
+#include <gst/gst.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "streaming/stream-config.hpp"
+#include "streaming/video-source.hpp"
+#include "streaming/v4l2-capture.hpp"
+
+typedef struct
+{
+    std::mutex mtx;
+    GstElement *pipeline;
+    bool live;
+    gint64 first_us; // Arrival of the first buffer, 0 until then
+    gint64 last_us;
+    std::vector<double> latency_ms; // Pipeline clock at arrival minus capture PTS
+    std::vector<double> interval_ms;
+} source_stats_t;
+
+static GstPadProbeReturn sinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    source_stats_t *stats = (source_stats_t *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now_us = g_get_monotonic_time();
+
+    // Live sources stamp buffers with the pipeline running time at capture, so this is
+    // how long a frame took to get from the sensor (or the writer) to the first consumer
+    double latency_ms = -1.0;
+    GstClock *clock = gst_element_get_clock(stats->pipeline);
+    if (clock != NULL && stats->live && GST_BUFFER_PTS_IS_VALID(buf))
+    {
+        GstClockTime running = gst_clock_get_time(clock) - gst_element_get_base_time(stats->pipeline);
+        latency_ms = ((gint64)running - (gint64)GST_BUFFER_PTS(buf)) / (double)GST_MSECOND;
+    }
+    if (clock != NULL)
+    {
+        gst_object_unref(clock);
+    }
+
+    std::lock_guard<std::mutex> lock(stats->mtx);
+    if (stats->first_us == 0)
+    {
+        stats->first_us = now_us;
+    }
+    else
+    {
+        stats->interval_ms.push_back((now_us - stats->last_us) / 1000.0);
+    }
+    stats->last_us = now_us;
+    if (latency_ms >= 0.0)
+    {
+        stats->latency_ms.push_back(latency_ms);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1));
+    return values[index];
+}
+
+static void meanStddev(const std::vector<double> &values, double *mean, double *stddev)
+{
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        sum += values[i];
+        sum_sq += values[i] * values[i];
+    }
+
+    *mean = values.empty() ? 0.0 : sum / values.size();
+    *stddev = values.empty() ? 0.0 : sqrt(std::max(0.0, sum_sq / values.size() - *mean * *mean));
+}
+
+/* Feeds the shm source with test frames in the caps it expects, standing in for the
+ * process that would normally write to the socket */
+static GstElement *startShmWriter(const fish_stream_config_t *config)
+{
+    const char *caps = (config->source_caps[0] != '\0') ? config->source_caps : getVideoSource(FISH_SOURCE_SHM)->default_caps;
+    std::string desc = "videotestsrc is-live=true pattern=ball ! " + std::string(caps) +
+                       " ! shmsink socket-path=" + config->shm_socket + " wait-for-connection=false sync=true";
+
+    GError *error = NULL;
+    GstElement *writer = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create shm writer: %s\n", error->message);
+        g_clear_error(&error);
+        if (writer != NULL)
+        {
+            gst_object_unref(writer);
+        }
+        return NULL;
+    }
+
+    gst_element_set_state(writer, GST_STATE_PLAYING);
+    gst_element_get_state(writer, NULL, NULL, 5 * GST_SECOND);
+    return writer;
+}
+
+static bool runSource(const fish_stream_config_t *config, int type, unsigned int seconds)
+{
+    const fish_video_source_t *source = getVideoSource(type);
+    GstElement *writer = NULL;
+    if (type == FISH_SOURCE_SHM)
+    {
+        writer = startShmWriter(config);
+        if (writer == NULL)
+        {
+            return false;
+        }
+    }
+
+    // Startup includes opening the device for the direct capture, as in the streamer
+    gint64 start_us = g_get_monotonic_time();
+    fish_v4l2_capture_t capture;
+    bool direct = (type == FISH_SOURCE_V4L2_DIRECT);
+    if (direct && openV4l2Capture(&capture, config) != FISH_EOK)
+    {
+        printf("%-11s could not open %s\n", source->name, config->source_device);
+        return false;
+    }
+    std::string desc = (direct ? v4l2CaptureDesc(&capture) : videoSourceDesc(config, type)) + " ! fakesink name=sink sync=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("%-11s could not create pipeline: %s\n", source->name, error->message);
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        if (writer != NULL)
+        {
+            gst_element_set_state(writer, GST_STATE_NULL);
+            gst_object_unref(writer);
+        }
+        if (direct)
+        {
+            teardownV4l2Capture(&capture);
+        }
+        return false;
+    }
+
+    source_stats_t stats;
+    stats.pipeline = pipeline;
+    stats.live = source->live;
+    stats.first_us = 0;
+    stats.last_us = 0;
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, sinkProbe, &stats, NULL);
+    gst_object_unref(sink_pad);
+    gst_object_unref(sink);
+    if (direct && startV4l2Capture(&capture, pipeline) != FISH_EOK)
+    {
+        gst_object_unref(pipeline);
+        teardownV4l2Capture(&capture);
+        return false;
+    }
+
+    // Startup covers parsing, state changes, device open and negotiation up to the first frame
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, seconds * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    bool ok = true;
+    if (msg != NULL && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        gst_message_parse_error(msg, &error, NULL);
+        printf("%-11s failed: %s\n", source->name, error->message);
+        g_clear_error(&error);
+        ok = false;
+    }
+    if (msg != NULL)
+    {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    if (direct)
+    {
+        teardownV4l2Capture(&capture);
+    }
+    gst_object_unref(pipeline);
+    if (writer != NULL)
+    {
+        gst_element_set_state(writer, GST_STATE_NULL);
+        gst_object_unref(writer);
+    }
+
+    std::lock_guard<std::mutex> lock(stats.mtx);
+    if (stats.first_us == 0)
+    {
+        if (ok)
+        {
+            printf("%-11s no frames in %u s\n", source->name, seconds);
+        }
+        return false;
+    }
+
+    double interval_mean, interval_stddev;
+    meanStddev(stats.interval_ms, &interval_mean, &interval_stddev);
+    double fps = interval_mean > 0.0 ? 1000.0 / interval_mean : 0.0;
+    double startup_ms = (stats.first_us - start_us) / 1000.0;
+
+    if (stats.latency_ms.empty())
+    {
+        // File frames carry no capture time, so only startup and rate mean anything
+        printf("%-11s %10.1f %7zu %7.1f %9.2f %8s %8s %8s\n", source->name, startup_ms,
+               stats.interval_ms.size() + 1, fps, interval_stddev, "-", "-", "-");
+    }
+    else
+    {
+        double lat_mean, lat_stddev;
+        meanStddev(stats.latency_ms, &lat_mean, &lat_stddev);
+        printf("%-11s %10.1f %7zu %7.1f %9.2f %8.2f %8.2f %8.2f\n", source->name, startup_ms,
+               stats.interval_ms.size() + 1, fps, interval_stddev,
+               lat_mean, percentile(stats.latency_ms, 0.99), percentile(stats.latency_ms, 1.0));
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    fish_stream_config_t config;
+    initStreamConfig(&config);
+
+    unsigned int seconds = 5;
+    std::vector<int> sources;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            if (parseStreamOption(argv[i], &config) != FISH_EOK)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (isdigit((unsigned char)argv[i][0]))
+        {
+            seconds = (unsigned int)atoi(argv[i]);
+        }
+        else
+        {
+            int type = findVideoSource(argv[i]);
+            if (type < 0)
+            {
+                printf("Unknown video source: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            sources.push_back(type);
+        }
+    }
+
+    // Without a list, try every source whose element is installed
+    bool explicit_list = !sources.empty();
+    if (!explicit_list)
+    {
+        for (int i = 0; getVideoSource(i) != NULL; i++)
+        {
+            GstElementFactory *factory = gst_element_factory_find(getVideoSource(i)->element);
+            if (factory != NULL)
+            {
+                sources.push_back(i);
+                gst_object_unref(factory);
+            }
+        }
+    }
+
+    printf("%u s per source\n\n", seconds);
+    printf("%-11s %10s %7s %7s %9s %8s %8s %8s\n",
+           "source", "start(ms)", "frames", "fps", "jit(ms)", "lat(ms)", "p99(ms)", "max(ms)");
+
+    int failures = 0;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (!runSource(&config, sources[i], seconds))
+        {
+            failures++;
+        }
+    }
+
+    // Missing cameras are expected when probing everything, so only fail on an explicit list
+    return (explicit_list && failures) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
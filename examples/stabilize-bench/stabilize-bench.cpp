@@ -0,0 +1,211 @@
+#include <gst/gst.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "processing/frame-pipe.hpp"
+#include "processing/stabilizer.hpp"
+
+#define BENCH_WIDTH 1280
+#define BENCH_HEIGHT 720
+#define BENCH_CROP 0.05
+#define BENCH_SHAKE_HZ 1.7 // Roughly a fin beat
+
+typedef struct
+{
+    bool stabilize;
+    double shake_px;        // Amplitude of synthetic shake added before stabilizing, 0 for none
+    uint64_t index;
+    fish_frame_t shaken;
+    fish_stabilizer_t stabilizer;
+
+    // Only touched on the encoder's streaming thread
+    uint64_t frames;
+    uint64_t bytes;
+    GstClockTime first_pts;
+    GstClockTime last_pts;
+} bench_run_t;
+
+static cv::Mat affineMatrix(double scale, double angle, double tx, double ty)
+{
+    double cx = BENCH_WIDTH / 2.0;
+    double cy = BENCH_HEIGHT / 2.0;
+    double a = scale * cos(angle);
+    double b = scale * sin(angle);
+    cv::Mat m(2, 3, CV_64F);
+    m.at<double>(0, 0) = a;
+    m.at<double>(0, 1) = -b;
+    m.at<double>(0, 2) = a * (tx - cx) - b * (ty - cy) + cx;
+    m.at<double>(1, 0) = b;
+    m.at<double>(1, 1) = a;
+    m.at<double>(1, 2) = b * (tx - cx) + a * (ty - cy) + cy;
+    return m;
+}
+
+static fish_error_t benchProcess(const fish_frame_t *in, fish_frame_t *out, void *user_data)
+{
+    bench_run_t *run = (bench_run_t *)user_data;
+    const fish_frame_t *frame = in;
+
+    // Two unrelated frequencies so the shake is not a pure back-and-forth
+    if (run->shake_px > 0.0)
+    {
+        double t = run->index / 30.0;
+        double tx = run->shake_px * sin(2.0 * M_PI * BENCH_SHAKE_HZ * t);
+        double ty = 0.6 * run->shake_px * sin(2.0 * M_PI * BENCH_SHAKE_HZ * 1.37 * t + 1.0);
+        double angle = 0.002 * run->shake_px / 10.0 * sin(2.0 * M_PI * BENCH_SHAKE_HZ * 0.71 * t);
+        run->shaken.width = in->width;
+        run->shaken.height = in->height;
+        run->shaken.format = in->format;
+        run->shaken.pts = in->pts;
+        warpFrame(in, &run->shaken, affineMatrix(1.0, angle, tx, ty));
+        frame = &run->shaken;
+    }
+    run->index++;
+
+    if (run->stabilize)
+    {
+        return stabilizeFrame(&run->stabilizer, frame, out);
+    }
+
+    // Same zoom as the stabilizer, so both runs encode the same field of view
+    warpFrame(frame, out, affineMatrix(1.0 / (1.0 - 2.0 * BENCH_CROP), 0.0, 0.0, 0.0));
+    return FISH_EOK;
+}
+
+static GstBuffer *benchHook(fish_frame_pipe_t *frame_pipe, GstBuffer *in_buf, void *user_data)
+{
+    return processFrameBuffer(frame_pipe, frame_pipe->pool, &frame_pipe->info, in_buf, benchProcess, user_data);
+}
+
+static GstPadProbeReturn encodedProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    bench_run_t *run = (bench_run_t *)user_data;
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (run->frames == 0)
+    {
+        run->first_pts = GST_BUFFER_PTS(buf);
+    }
+    run->last_pts = GST_BUFFER_PTS(buf);
+    run->frames++;
+    run->bytes += gst_buffer_get_size(buf);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Decodes the file, optionally shakes and stabilizes it, and encodes it at a fixed quantizer */
+static bool runBench(const char *file, unsigned int qp, bench_run_t *run)
+{
+    std::string desc = std::string("filesrc location=") + file +
+                       " ! decodebin ! videoconvert ! videoscale ! video/x-raw,format=NV12,width=" +
+                       std::to_string(BENCH_WIDTH) + ",height=" + std::to_string(BENCH_HEIGHT) +
+                       " ! appsink name=frame_sink sync=false"
+                       " appsrc name=frame_src ! x264enc name=encoder pass=quant quantizer=" + std::to_string(qp) +
+                       " speed-preset=veryfast tune=zerolatency key-int-max=60 ! fakesink sync=false";
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n", error->message);
+        g_clear_error(&error);
+        if (pipeline != NULL)
+        {
+            gst_object_unref(pipeline);
+        }
+        return false;
+    }
+
+    fish_frame_pipe_t frame_pipe;
+    if (setupFramePipe(&frame_pipe, pipeline, "frame_sink", "frame_src", benchHook, run) != FISH_EOK)
+    {
+        gst_object_unref(pipeline);
+        return false;
+    }
+
+    GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), "encoder");
+    GstPad *src_pad = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, encodedProbe, run, NULL);
+    gst_object_unref(src_pad);
+    gst_object_unref(encoder);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    bool ok = (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (!ok)
+    {
+        gst_message_parse_error(msg, &error, NULL);
+        printf("Run failed: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    teardownFramePipe(&frame_pipe);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+static double runKbps(const bench_run_t *run)
+{
+    // The last frame is on screen for one more frame interval
+    double seconds = (run->last_pts - run->first_pts) / (double)GST_SECOND;
+    if (run->frames > 1)
+    {
+        seconds += seconds / (run->frames - 1);
+    }
+    return seconds > 0.0 ? run->bytes * 8.0 / seconds / 1000.0 : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <video file> [shake px] [quantizer]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *file = argv[1];
+    double shake_px = (argc > 2) ? atof(argv[2]) : 0.0;
+    unsigned int qp = (argc > 3) ? (unsigned int)atoi(argv[3]) : 26;
+
+    printf("%s at %dx%d, QP %u, %.0f px synthetic shake, %.0f%% crop per edge\n\n",
+           file, BENCH_WIDTH, BENCH_HEIGHT, qp, shake_px, BENCH_CROP * 100.0);
+    printf("%-14s %7s %9s %10s %9s %9s\n", "run", "frames", "kbit/s", "bytes/frm", "stab(ms)", "motion");
+
+    double kbps[2] = {0.0, 0.0};
+    for (int stabilize = 0; stabilize < 2; stabilize++)
+    {
+        bench_run_t *run = new bench_run_t();
+        run->stabilize = (stabilize == 1);
+        run->shake_px = shake_px;
+        initStabilizer(&run->stabilizer, BENCH_CROP);
+        if (!runBench(file, qp, run))
+        {
+            delete run;
+            return EXIT_FAILURE;
+        }
+
+        kbps[stabilize] = runKbps(run);
+        const fish_stabilizer_t *stabilizer = &run->stabilizer;
+        printf("%-14s %7llu %9.0f %10.0f %9.2f %9.1f\n", run->stabilize ? "stabilized" : "crop only",
+               (unsigned long long)run->frames, kbps[stabilize], run->frames ? (double)run->bytes / run->frames : 0.0,
+               stabilizer->frames ? stabilizer->total_us / 1000.0 / stabilizer->frames : 0.0,
+               stabilizer->frames ? stabilizer->motion_px / stabilizer->frames : 0.0);
+        delete run;
+    }
+
+    if (kbps[0] > 0.0)
+    {
+        printf("\nStabilization changes the bitrate by %+.1f%% at the same quantizer\n", 100.0 * (kbps[1] / kbps[0] - 1.0));
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "streaming/batch-udp-sink.hpp"
+
+#define RTP_HEADER_SIZE 12
+
+typedef struct
+{
+    const char *label;
+    const char *sink_desc;
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    {"udpsink", "udpsink"},
+    {"fishudpsink, sendmmsg only", BATCH_UDP_SINK_NAME " gso=false"},
+    {"fishudpsink, sendmmsg + GSO", BATCH_UDP_SINK_NAME " gso=true"},
+};
+
+typedef struct
+{
+    std::atomic<int64_t> first_cpu_ns; // Sink thread CPU time at the first and latest render
+    std::atomic<int64_t> last_cpu_ns;
+} sink_cpu_t;
+
+typedef struct
+{
+    int sock;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> packets;
+} drain_t;
+
+static int64_t threadCpuNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Runs on appsrc's streaming thread, which is also the thread that renders in the sink */
+static GstPadProbeReturn sinkCpuProbe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    sink_cpu_t *cpu = (sink_cpu_t *)user_data;
+    int64_t now = threadCpuNs();
+    if (cpu->first_cpu_ns == 0)
+    {
+        cpu->first_cpu_ns = now;
+    }
+    cpu->last_cpu_ns = now;
+    return GST_PAD_PROBE_OK;
+}
+
+/* Reads everything so the sender is not slowed by a full receive buffer */
+static void runDrain(drain_t *drain)
+{
+    char packet[2048];
+    while (drain->running)
+    {
+        if (recv(drain->sock, packet, sizeof(packet), 0) > 0)
+        {
+            drain->packets++;
+        }
+    }
+}
+
+/* One buffer list shaped like a fragmented NAL unit from rtph264pay: a separate header
+ * memory per packet and a shorter last fragment */
+static GstBufferList *makePacketList(guint packets, guint packet_size)
+{
+    GstBufferList *list = gst_buffer_list_new_sized(packets);
+    for (guint i = 0; i < packets; i++)
+    {
+        guint size = (i == packets - 1 && packets > 1) ? packet_size / 2 : packet_size;
+        GstBuffer *buf = gst_buffer_new_allocate(NULL, RTP_HEADER_SIZE, NULL);
+        gst_buffer_memset(buf, 0, 0x80, RTP_HEADER_SIZE);
+        GstBuffer *payload = gst_buffer_new_allocate(NULL, size - RTP_HEADER_SIZE, NULL);
+        gst_buffer_memset(payload, 0, 0xab, size - RTP_HEADER_SIZE);
+        buf = gst_buffer_append(buf, payload);
+        gst_buffer_list_add(list, buf);
+    }
+    return list;
+}
+
+static void runCase(const bench_case_t *bench, unsigned int seconds, guint packets, guint packet_size, int port)
+{
+    drain_t drain;
+    drain.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    drain.running = true;
+    drain.packets = 0;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval timeout = {0, 100000};
+    setsockopt(drain.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(drain.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(drain.sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("bind");
+        close(drain.sock);
+        return;
+    }
+    std::thread drain_thread(runDrain, &drain);
+
+    std::string desc = "appsrc name=src format=time max-bytes=4000000 block=true ! " + std::string(bench->sink_desc) +
+                       " name=sink host=127.0.0.1 port=" + std::to_string(port) + " sync=false async=false";
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(desc.c_str(), &error);
+    if (error != NULL)
+    {
+        printf("Could not create pipeline: %s\n", error->message);
+        g_clear_error(&error);
+        drain.running = false;
+        drain_thread.join();
+        close(drain.sock);
+        return;
+    }
+
+    sink_cpu_t cpu;
+    cpu.first_cpu_ns = 0;
+    cpu.last_cpu_ns = 0;
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                      sinkCpuProbe, &cpu, NULL);
+    gst_object_unref(sink_pad);
+
+    GstBufferList *list = makePacketList(packets, packet_size);
+    gsize list_bytes = 0;
+    for (guint i = 0; i < packets; i++)
+    {
+        list_bytes += gst_buffer_get_size(gst_buffer_list_get(list, i));
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    gint64 start_us = g_get_monotonic_time();
+    gint64 end_us = start_us + (gint64)seconds * G_USEC_PER_SEC;
+    uint64_t lists = 0;
+    while (g_get_monotonic_time() < end_us)
+    {
+        // Copying a list only refs its buffers; appsrc takes ownership of the copy
+        if (packets == 1)
+        {
+            gst_app_src_push_buffer(GST_APP_SRC(src), gst_buffer_ref(gst_buffer_list_get(list, 0)));
+        }
+        else
+        {
+            gst_app_src_push_buffer_list(GST_APP_SRC(src), gst_buffer_list_copy(list));
+        }
+        lists++;
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND, (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    if (msg != NULL)
+    {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    double elapsed_s = (g_get_monotonic_time() - start_us) / 1e6;
+
+    guint64 send_calls = 0;
+    if (strncmp(bench->sink_desc, BATCH_UDP_SINK_NAME, strlen(BATCH_UDP_SINK_NAME)) == 0)
+    {
+        g_object_get(sink, "send-calls", &send_calls, NULL);
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_buffer_list_unref(list);
+    gst_object_unref(sink);
+    gst_object_unref(src);
+    gst_object_unref(pipeline);
+
+    // Let the last packets land before counting
+    g_usleep(200000);
+    drain.running = false;
+    drain_thread.join();
+    close(drain.sock);
+
+    uint64_t sent = lists * packets;
+    double mbit = lists * list_bytes * 8 / 1e6;
+    double cpu_ms = (cpu.last_cpu_ns - cpu.first_cpu_ns) / 1e6;
+    printf(">> %-28s %9.0f pkt/s %8.0f Mbit/s %7.3f ms CPU/Mbit %6.2f pkt/call %5.1f%% received\n", bench->label,
+           sent / elapsed_s, mbit / elapsed_s, mbit > 0 ? cpu_ms / mbit : 0.0,
+           send_calls ? (double)sent / send_calls : 1.0, sent ? 100.0 * drain.packets / sent : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    gst_init(&argc, &argv);
+    registerBatchUdpSink();
+
+    unsigned int seconds = (argc > 1) ? (unsigned int)atoi(argv[1]) : 5;
+    guint packets = (argc > 2) ? (guint)atoi(argv[2]) : 16;
+    guint packet_size = (argc > 3) ? (guint)atoi(argv[3]) : 1200;
+    int port = (argc > 4) ? atoi(argv[4]) : 5010;
+
+    if (packets == 0 || packet_size <= 2 * RTP_HEADER_SIZE)
+    {
+        printf("Need at least one packet per list and packets above %d bytes\n", 2 * RTP_HEADER_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    printf(">> %u-packet lists of %u-byte packets, %u seconds per sink\n", packets, packet_size, seconds);
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+    {
+        runCase(&bench_cases[i], seconds, packets, packet_size, port);
+    }
+
+    return EXIT_SUCCESS;
+}